@@ -0,0 +1,98 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "pfs_common/pfs_common.hpp"
+#include "pfs_client/pfs_api.hpp"
+
+// Many threads of one client, each creating, writing, reading back and
+// deleting its own file at the same time
+static std::atomic<int> failures{0};
+static std::atomic<long> bytes_moved{0};
+
+static void fail(int thread_id, const char *what) {
+    fprintf(stderr, "thread %d: %s failed.\n", thread_id, what);
+    failures++;
+}
+
+static void run_thread(int thread_id, int rounds, size_t io_size) {
+    std::string filename = "pfs_mt_file" + std::to_string(thread_id);
+    if (pfs_create(filename.c_str(), 1 + thread_id % 3) == -1) {
+        return fail(thread_id, "pfs_create()");
+    }
+    int pfs_fd = pfs_open(filename.c_str(), 2);
+    if (pfs_fd == -1) {
+        return fail(thread_id, "pfs_open()");
+    }
+
+    std::vector<char> out(io_size), in(io_size);
+    unsigned int seed = thread_id;
+    for (int round = 0; round < rounds; ++round) {
+        for (auto &c : out) {
+            c = static_cast<char>(rand_r(&seed));
+        }
+        off_t offset = static_cast<off_t>(round) * io_size + thread_id;
+        if (pfs_write(pfs_fd, out.data(), io_size, offset) != static_cast<ssize_t>(io_size)) {
+            return fail(thread_id, "pfs_write()");
+        }
+        if (pfs_read(pfs_fd, in.data(), io_size, offset) != static_cast<ssize_t>(io_size) ||
+            memcmp(out.data(), in.data(), io_size) != 0) {
+            return fail(thread_id, "pfs_read() after pfs_write()");
+        }
+        bytes_moved += 2 * io_size;
+    }
+
+    struct pfs_metadata mymeta = {0};
+    if (pfs_fstat(pfs_fd, &mymeta) == -1 || mymeta.file_size != rounds * io_size + thread_id) {
+        return fail(thread_id, "pfs_fstat()");
+    }
+    if (pfs_close(pfs_fd) == -1) {
+        return fail(thread_id, "pfs_close()");
+    }
+    if (pfs_delete(filename.c_str()) == -1) {
+        return fail(thread_id, "pfs_delete()");
+    }
+}
+
+int main(int argc, char *argv[]) {
+    printf("%s:%s: Start! Hostname: %s, IP: %s\n", __FILE__, __func__, getMyHostname().c_str(), getMyIP().c_str());
+    int num_threads = argc > 1 ? atoi(argv[1]) : 64;
+    int rounds = argc > 2 ? atoi(argv[2]) : 16;
+    size_t io_size = argc > 3 ? atol(argv[3]) : 96 * 1024;
+    if (num_threads <= 0 || rounds <= 0 || io_size == 0) {
+        fprintf(stderr, "%s: usage: ./client-1-4 [threads] [rounds] [bytes per I/O]\n", __func__);
+        return -1;
+    }
+
+    // Initialize the PFS client
+    int client_id = pfs_initialize();
+    if (client_id == -1) {
+        fprintf(stderr, "pfs_initialize() failed.\n");
+        return -1;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (int i = 0; i < num_threads; ++i) {
+        threads.emplace_back(run_thread, i, rounds, io_size);
+    }
+    for (auto &thread : threads) {
+        thread.join();
+    }
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    printf("%s:%s: %d threads moved %.1f MiB in %.2f s (%.1f MiB/s), %d failures\n", __FILE__, __func__,
+           num_threads, bytes_moved / 1048576.0, secs, bytes_moved / 1048576.0 / secs, failures.load());
+
+    if (pfs_finish(client_id) == -1) {
+        fprintf(stderr, "pfs_finish() failed.\n");
+        return -1;
+    }
+    printf("%s:%s: Finish!\n", __FILE__, __func__);
+    return failures == 0 ? 0 : -1;
+}
@@ -0,0 +1,137 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <vector>
+
+#include "pfs_common/pfs_common.hpp"
+#include "pfs_client/pfs_api.hpp"
+
+// Noncontiguous I/O: three interleaved column blocks of a matrix written
+// with pfs_write_strided(), checked with pfs_read(), pfs_read_strided() and
+// pfs_readv(), and timed against one pfs_write() per block
+static double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char *argv[]) {
+    printf("%s:%s: Start! Hostname: %s, IP: %s\n", __FILE__, __func__, getMyHostname().c_str(), getMyIP().c_str());
+    size_t rows = argc > 1 ? atol(argv[1]) : 4096;
+    size_t block_length = argc > 2 ? atol(argv[2]) : 100;
+    if (rows == 0 || block_length == 0) {
+        fprintf(stderr, "%s: usage: ./client-1-5 [rows] [bytes per block]\n", __func__);
+        return -1;
+    }
+    const int columns = 3;
+    size_t row_length = columns * block_length;
+    size_t file_size = rows * row_length;
+
+    // Initialize the PFS client
+    int client_id = pfs_initialize();
+    if (client_id == -1) {
+        fprintf(stderr, "pfs_initialize() failed.\n");
+        return -1;
+    }
+
+    if (pfs_create("pfs_strided_file", 3) == -1) {
+        fprintf(stderr, "Unable to create a PFS file.\n");
+        return -1;
+    }
+    int pfs_fd = pfs_open("pfs_strided_file", 2);
+    if (pfs_fd == -1) {
+        fprintf(stderr, "Error opening PFS file.\n");
+        return -1;
+    }
+
+    // Column c holds the bytes 'a' + c, row by row
+    std::vector<char> expected(file_size);
+    auto start = std::chrono::steady_clock::now();
+    for (int c = 0; c < columns; ++c) {
+        std::vector<char> column(rows * block_length);
+        for (size_t i = 0; i < column.size(); ++i) {
+            column[i] = 'a' + c + (i / block_length) % 7;
+        }
+        for (size_t r = 0; r < rows; ++r) {
+            memcpy(&expected[r * row_length + c * block_length], &column[r * block_length], block_length);
+        }
+        struct pfs_stride stride = {static_cast<off_t>(c * block_length), block_length,
+                                    static_cast<off_t>(row_length), rows};
+        if (pfs_write_strided(pfs_fd, column.data(), &stride) != static_cast<ssize_t>(column.size())) {
+            fprintf(stderr, "pfs_write_strided() failed.\n");
+            return -1;
+        }
+    }
+    double strided_secs = seconds_since(start);
+
+    std::vector<char> whole(file_size);
+    if (pfs_read(pfs_fd, whole.data(), file_size, 0) != static_cast<ssize_t>(file_size) || whole != expected) {
+        fprintf(stderr, "pfs_read() does not match what pfs_write_strided() wrote.\n");
+        return -1;
+    }
+
+    // The middle column, and every other row of the first one in reverse
+    std::vector<char> column(rows * block_length);
+    struct pfs_stride middle = {static_cast<off_t>(block_length), block_length, static_cast<off_t>(row_length), rows};
+    if (pfs_read_strided(pfs_fd, column.data(), &middle) != static_cast<ssize_t>(column.size())) {
+        fprintf(stderr, "pfs_read_strided() failed.\n");
+        return -1;
+    }
+    for (size_t r = 0; r < rows; ++r) {
+        if (memcmp(&column[r * block_length], &expected[r * row_length + block_length], block_length) != 0) {
+            fprintf(stderr, "pfs_read_strided() returned the wrong data for row %zu.\n", r);
+            return -1;
+        }
+    }
+
+    std::vector<struct iovec> iov;
+    std::vector<off_t> offsets;
+    for (size_t r = 0; r < rows; r += 2) {
+        size_t row = rows - 1 - r;
+        iov.push_back({&column[iov.size() * block_length], block_length});
+        offsets.push_back(row * row_length);
+    }
+    ssize_t vector_bytes = static_cast<ssize_t>(iov.size() * block_length);
+    if (pfs_readv(pfs_fd, iov.data(), offsets.data(), iov.size()) != vector_bytes) {
+        fprintf(stderr, "pfs_readv() failed.\n");
+        return -1;
+    }
+    for (size_t i = 0; i < iov.size(); ++i) {
+        if (memcmp(iov[i].iov_base, &expected[offsets[i]], block_length) != 0) {
+            fprintf(stderr, "pfs_readv() returned the wrong data for piece %zu.\n", i);
+            return -1;
+        }
+    }
+
+    // A read past the end of the file is cut off there
+    struct iovec tail = {whole.data(), 2 * block_length};
+    off_t tail_offset = file_size - block_length;
+    if (pfs_readv(pfs_fd, &tail, &tail_offset, 1) != static_cast<ssize_t>(block_length)) {
+        fprintf(stderr, "pfs_readv() did not stop at the end of the file.\n");
+        return -1;
+    }
+
+    // The same first column with one pfs_write() per block
+    start = std::chrono::steady_clock::now();
+    for (size_t r = 0; r < rows; ++r) {
+        if (pfs_write(pfs_fd, &expected[r * row_length], block_length, r * row_length) !=
+            static_cast<ssize_t>(block_length)) {
+            fprintf(stderr, "pfs_write() failed.\n");
+            return -1;
+        }
+    }
+    double block_secs = seconds_since(start);
+
+    printf("%s:%s: %zu blocks of %zu bytes: %.3f s per column strided, %.3f s per column block by block\n",
+           __FILE__, __func__, rows, block_length, strided_secs / columns, block_secs);
+
+    if (pfs_close(pfs_fd) == -1 || pfs_delete("pfs_strided_file") == -1) {
+        fprintf(stderr, "Error closing or deleting the PFS file.\n");
+        return -1;
+    }
+    if (pfs_finish(client_id) == -1) {
+        fprintf(stderr, "pfs_finish() failed.\n");
+        return -1;
+    }
+    printf("%s:%s: Finish!\n", __FILE__, __func__);
+    return 0;
+}
@@ -0,0 +1,162 @@
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "pfs_common/pfs_common.hpp"
+#include "pfs_client/pfs_api.hpp"
+
+// N-to-1 checkpoint: several processes, each its own PFS client, write
+// interleaved small pieces of one shared file with pfs_write_all(), read
+// their neighbour's pieces back with pfs_read_all(), and then write the
+// same pattern independently, with pfs_writev() and with one pfs_write()
+// per piece, for comparison
+static const char *filename = "pfs_checkpoint_file";
+
+static char byte_at(off_t offset) {
+    return static_cast<char>(offset * 131 + 7);
+}
+
+static double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Piece i of rank r lies at (i * size + r) * piece_length
+static void checkpoint_pieces(int rank, int size, int pieces, size_t piece_length, std::vector<char> &buf,
+                              std::vector<struct iovec> &iov, std::vector<off_t> &offsets) {
+    buf.assign(pieces * piece_length, 0);
+    for (int i = 0; i < pieces; ++i) {
+        iov.push_back({&buf[i * piece_length], piece_length});
+        offsets.push_back((static_cast<off_t>(i) * size + rank) * piece_length);
+    }
+}
+
+static int run_rank(int rank, int size, int pieces, size_t piece_length) {
+    int client_id = pfs_initialize();
+    if (client_id == -1) {
+        fprintf(stderr, "rank %d: pfs_initialize() failed.\n", rank);
+        return -1;
+    }
+    if (rank == 0 && pfs_create(filename, 3) == -1) {
+        fprintf(stderr, "rank %d: Unable to create a PFS file.\n", rank);
+        return -1;
+    }
+    // Joining waits for everyone, so the file exists once it returns
+    int group = pfs_group_join("checkpoint", size, rank);
+    if (group == -1) {
+        fprintf(stderr, "rank %d: pfs_group_join() failed.\n", rank);
+        return -1;
+    }
+    int pfs_fd = pfs_open(filename, 2);
+    if (pfs_fd == -1) {
+        fprintf(stderr, "rank %d: Error opening PFS file.\n", rank);
+        return -1;
+    }
+
+    std::vector<char> out;
+    std::vector<struct iovec> out_iov;
+    std::vector<off_t> out_offsets;
+    checkpoint_pieces(rank, size, pieces, piece_length, out, out_iov, out_offsets);
+    for (int i = 0; i < pieces; ++i) {
+        for (size_t k = 0; k < piece_length; ++k) {
+            out[i * piece_length + k] = byte_at(out_offsets[i] + k);
+        }
+    }
+    ssize_t piece_bytes = static_cast<ssize_t>(out.size());
+
+    auto start = std::chrono::steady_clock::now();
+    if (pfs_write_all(group, pfs_fd, out_iov.data(), out_offsets.data(), pieces) != piece_bytes) {
+        fprintf(stderr, "rank %d: pfs_write_all() failed.\n", rank);
+        return -1;
+    }
+    double collective_secs = seconds_since(start);
+
+    std::vector<char> in;
+    std::vector<struct iovec> in_iov;
+    std::vector<off_t> in_offsets;
+    checkpoint_pieces((rank + 1) % size, size, pieces, piece_length, in, in_iov, in_offsets);
+    if (pfs_read_all(group, pfs_fd, in_iov.data(), in_offsets.data(), pieces) != piece_bytes) {
+        fprintf(stderr, "rank %d: pfs_read_all() failed.\n", rank);
+        return -1;
+    }
+    for (int i = 0; i < pieces; ++i) {
+        for (size_t k = 0; k < piece_length; ++k) {
+            if (in[i * piece_length + k] != byte_at(in_offsets[i] + k)) {
+                fprintf(stderr, "rank %d: pfs_read_all() returned the wrong data at offset %ld.\n", rank,
+                        static_cast<long>(in_offsets[i] + k));
+                return -1;
+            }
+        }
+    }
+
+    // The same checkpoint, every process on its own
+    start = std::chrono::steady_clock::now();
+    if (pfs_writev(pfs_fd, out_iov.data(), out_offsets.data(), pieces) != piece_bytes) {
+        fprintf(stderr, "rank %d: pfs_writev() failed.\n", rank);
+        return -1;
+    }
+    double vector_secs = seconds_since(start);
+
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < pieces; ++i) {
+        if (pfs_write(pfs_fd, out_iov[i].iov_base, piece_length, out_offsets[i]) != static_cast<ssize_t>(piece_length)) {
+            fprintf(stderr, "rank %d: pfs_write() failed.\n", rank);
+            return -1;
+        }
+    }
+    double piece_secs = seconds_since(start);
+
+    printf("%s:%s: rank %d wrote %d pieces of %zu bytes: %.3f s collective, %.3f s with pfs_writev(), "
+           "%.3f s piece by piece\n", __FILE__, __func__, rank, pieces, piece_length, collective_secs, vector_secs,
+           piece_secs);
+
+    if (pfs_close(pfs_fd) == -1 || pfs_group_leave(group) == -1 || pfs_finish(client_id) == -1) {
+        fprintf(stderr, "rank %d: Error shutting down.\n", rank);
+        return -1;
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    printf("%s:%s: Start! Hostname: %s, IP: %s\n", __FILE__, __func__, getMyHostname().c_str(), getMyIP().c_str());
+    int size = argc > 1 ? atoi(argv[1]) : 4;
+    int pieces = argc > 2 ? atoi(argv[2]) : 1024;
+    size_t piece_length = argc > 3 ? atol(argv[3]) : 1000;
+    if (size <= 0 || pieces <= 0 || piece_length == 0) {
+        fprintf(stderr, "%s: usage: ./client-1-6 [processes] [pieces per process] [bytes per piece]\n", __func__);
+        return -1;
+    }
+
+    // Fork before any PFS call; each process is a client of its own
+    fflush(stdout);
+    std::vector<pid_t> children;
+    for (int rank = 0; rank < size; ++rank) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            int result = run_rank(rank, size, pieces, piece_length);
+            fflush(stdout);
+            _exit(result == 0 ? 0 : 1);
+        }
+        children.push_back(pid);
+    }
+    int failures = 0;
+    for (pid_t pid : children) {
+        int status = 0;
+        if (waitpid(pid, &status, 0) == -1 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            failures++;
+        }
+    }
+
+    int client_id = pfs_initialize();
+    if (client_id == -1 || pfs_delete(filename) == -1 || pfs_finish(client_id) == -1) {
+        fprintf(stderr, "Cleanup of %s failed.\n", filename);
+        return -1;
+    }
+    printf("%s:%s: %d processes, %d failures\n", __FILE__, __func__, size, failures);
+    printf("%s:%s: Finish!\n", __FILE__, __func__);
+    return failures == 0 ? 0 : -1;
+}
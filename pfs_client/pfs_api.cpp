@@ -1,5 +1,7 @@
 #include "pfs_api.hpp"
 #include "pfs_cache.hpp"
+#include "pfs_fd_table.hpp"
+#include "pfs_collective.hpp"
 #include "pfs_proto/pfs_metaserver.pb.h"
 #include "pfs_proto/pfs_metaserver.grpc.pb.h"
 #include "pfs_proto/pfs_fileserver.pb.h"
@@ -13,20 +15,53 @@
 #include <unordered_map>
 #include <shared_mutex>
 #include <mutex>
+#include <thread>
+#include <algorithm>
+#include <functional>
+#include <chrono>
 
-std::unique_ptr<pfsmeta::MetadataServer::Stub> metadata_stub; // Metadata server stub
+std::vector<std::unique_ptr<pfsmeta::MetadataServer::Stub>> metadata_stubs; // One per metadata shard
 std::vector<std::unique_ptr<pfsfile::FileServer::Stub>> file_server_stubs; // File server stubs
 std::vector<std::string> file_server_addresses;
 
 static ClientState client_state; // Each client has its own state
+static FdTable open_files; // Open files by descriptor
+static std::mutex groups_mutex;
+static std::unordered_map<int, std::shared_ptr<CollectiveGroup>> groups; // Collective I/O groups by ID
+static int next_group_id = 1;
+static ShardMap metadata_shards; // Which metadata server holds which file name
 static ClientCache client_cache(CLIENT_CACHE_BLOCKS * PFS_BLOCK_SIZE, client_state);
 
+// Callbacks streams, one per metadata shard, on which the Metadata Servers
+// revoke our tokens. Closed at exit too, for programs that never call
+// pfs_finish().
+static void stop_callbacks();
+static struct CallbackListener {
+    std::vector<std::unique_ptr<grpc::ClientContext>> contexts;
+    std::vector<std::thread> threads;
+    ~CallbackListener() { stop_callbacks(); }
+} callbacks;
+
+// Renews our sessions when no token request has done so lately
+static void stop_heartbeat();
+static struct HeartbeatTimer {
+    std::thread thread;
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool stopping = false;
+    ~HeartbeatTimer() { stop_heartbeat(); }
+} heartbeat;
+
 
 
 // Forward declarations
 int metaserverUp(const std::string& metadata_server_address);
-bool metaserverPing(); // Function to ping Metadata Server
+bool metaserverPing(pfsmeta::MetadataServer::Stub* stub); // Function to ping Metadata Server
 bool fileserverPing(const std::string& file_server_address); // Function to ping File Server
+static bool start_callbacks();
+static void start_heartbeat();
+static bool request_tokens(std::vector<Token>& wants);
+static bool request_shard_tokens(int shard, std::vector<Token>& wants);
 
 
 int pfs_initialize() {
@@ -44,18 +79,32 @@ int pfs_initialize() {
     int line_num = 0;
     int meta_server_client_id = -1;
 
+    metadata_stubs.clear();
+    client_state.session_ids.clear();
+    client_state.lease_ms = 0;
     while (std::getline(pfs_list, line)) {
         std::string server_address = line.substr(0, line.find(':')) + ":" + line.substr(line.find(':') + 1);
         if (line_num == 0) {
-            // Connect to Metadata Server
-            std::cout << "[INFO] Connecting to Metadata Server at: " << server_address << std::endl;
-            meta_server_client_id = metaserverUp(server_address);
-            if (meta_server_client_id < 0) {
-                std::cerr << "[ERROR] Failed to initialize connection with Metadata Server." << std::endl;
+            // Connect to every Metadata Server; the namespace is split among them
+            for (const auto& metaserver_address : splitServerList(line)) {
+                std::cout << "[INFO] Connecting to Metadata Server at: " << metaserver_address << std::endl;
+                int session_id = metaserverUp(metaserver_address);
+                if (session_id < 0) {
+                    std::cerr << "[ERROR] Failed to initialize connection with Metadata Server." << std::endl;
+                    return -1;
+                }
+                client_state.session_ids.push_back(session_id);
+            }
+            if (client_state.session_ids.empty()) {
+                std::cerr << "[ERROR] No Metadata Server on the first line of pfs_list.txt." << std::endl;
                 return -1;
             }
+            metadata_shards = ShardMap(static_cast<int>(metadata_stubs.size()));
+            client_state.last_renewal_ms = std::make_unique<std::atomic<int64_t>[]>(metadata_stubs.size());
+            meta_server_client_id = client_state.session_ids[0];
             client_state.client_id = meta_server_client_id;  // Set Client ID in state
-            std::cout << "[INFO] Connected to Metadata Server. Assigned Client ID: " << meta_server_client_id << std::endl;
+            std::cout << "[INFO] Connected to " << metadata_stubs.size()
+                      << " Metadata Servers. Assigned Client ID: " << meta_server_client_id << std::endl;
         } else {
             // Store file server addresses
             std::cout << "[DEBUG] Adding File Server address: " << server_address << std::endl;
@@ -64,7 +113,8 @@ int pfs_initialize() {
         ++line_num;
     }
     pfs_list.close();
-    std::cout << "[INFO] Finished reading pfs_list.txt. Total servers: " << file_server_addresses.size() + 1 << std::endl;
+    std::cout << "[INFO] Finished reading pfs_list.txt. Total servers: "
+              << file_server_addresses.size() + metadata_stubs.size() << std::endl;
 
     // Ping File Servers
     for (const auto& address : file_server_addresses) {
@@ -79,10 +129,11 @@ int pfs_initialize() {
     std::cout << "[DEBUG] PFS Initialization completed successfully." << std::endl;
 
     // Reset Client State
+    open_files.take_all();
     {
         std::lock_guard<std::mutex> lock(client_state.state_mutex);
-        client_state.open_files.clear();
         client_state.tokens.clear();
+        client_state.recent_revokes.clear();
         client_state.num_read_hits = 0;
         client_state.num_write_hits = 0;
         client_state.num_evictions = 0;
@@ -95,28 +146,34 @@ int pfs_initialize() {
     // Initialize Client Cache
     client_cache.initialize();
 
+    // Without the callback stream every read and write asks for its token
+    if (!start_callbacks()) {
+        std::cerr << "[ERROR] Cannot open the callback stream; tokens will not be cached." << std::endl;
+    }
+    start_heartbeat();
+
     std::cout << "[INFO] Client state and cache successfully reset." << std::endl;
     return meta_server_client_id;
 }
 
 
-// Function to connect to the Metadata Server
+// Function to connect to a Metadata Server and open our session on it
 int metaserverUp(const std::string& metadata_server_address) {
-    metadata_stub = pfsmeta::MetadataServer::NewStub(
+    auto metadata_stub = pfsmeta::MetadataServer::NewStub(
         grpc::CreateChannel(metadata_server_address, grpc::InsecureChannelCredentials())
     );
 
-    if (!metaserverPing()) {
-        std::cerr << "[ERROR] Metadata Server is not responding to Ping." << std::endl;
-        return -1;
-    }
-
     // Check if the stub was created successfully
     if (!metadata_stub) {
         std::cerr << "Failed to create metadata_stub!" << std::endl;
         exit(EXIT_FAILURE);
     }
 
+    if (!metaserverPing(metadata_stub.get())) {
+        std::cerr << "[ERROR] Metadata Server is not responding to Ping." << std::endl;
+        return -1;
+    }
+
     pfsmeta::InitializeRequest request;
     pfsmeta::InitializeResponse response;
     grpc::ClientContext context;
@@ -124,6 +181,11 @@ int metaserverUp(const std::string& metadata_server_address) {
     grpc::Status status = metadata_stub->Initialize(&context, request, &response);
     if (status.ok()) {
         std::cout << "[INFO] Metadata Server assigned Client ID: " << response.client_id() << std::endl;
+        // Renew often enough for the shortest lease
+        if (client_state.lease_ms <= 0 || (response.lease_ms() > 0 && response.lease_ms() < client_state.lease_ms)) {
+            client_state.lease_ms = response.lease_ms();
+        }
+        metadata_stubs.push_back(std::move(metadata_stub));
         return response.client_id();
     } else {
         std::cerr << "[ERROR] Failed to connect to Metadata Server:\n"
@@ -133,13 +195,13 @@ int metaserverUp(const std::string& metadata_server_address) {
     }
 }
 
-// Function to ping the Metadata Server
-bool metaserverPing() {
+// Function to ping a Metadata Server
+bool metaserverPing(pfsmeta::MetadataServer::Stub* stub) {
     pfsmeta::PingRequest request;
     pfsmeta::PingResponse response;
     grpc::ClientContext context;
 
-    grpc::Status status = metadata_stub->Ping(&context, request, &response);
+    grpc::Status status = stub->Ping(&context, request, &response);
     if (status.ok() && response.success()) {
         std::cout << "[INFO] Metadata Server Response: " << response.response_message() << std::endl;
         return true;
@@ -175,6 +237,188 @@ bool fileserverPing(const std::string& file_server_address) {
     }
 }
 
+static bool overlaps(const Token& token, FileHandle handle, int64_t start, int64_t end) {
+    return token.handle == handle && token.start_byte <= end && token.end_byte >= start;
+}
+
+// Give back [start, end] of the file: wait until no read or write relies
+// on it, then cut it out of the cached tokens
+static void give_back_tokens(FileHandle handle, int64_t start, int64_t end) {
+    std::unique_lock<std::mutex> lock(client_state.state_mutex);
+    auto file = client_state.tokens.find(handle);
+    if (file != client_state.tokens.end()) {
+        for (auto& token : file->second) {
+            if (overlaps(token, handle, start, end)) {
+                token.revoking = true;
+            }
+        }
+    }
+    // The file's list may be dropped while we wait, so look it up afresh
+    client_state.tokens_cv.wait(lock, [&]() {
+        auto file = client_state.tokens.find(handle);
+        return file == client_state.tokens.end() ||
+               std::none_of(file->second.begin(), file->second.end(), [&](const Token& token) {
+                   return token.pins > 0 && overlaps(token, handle, start, end);
+               });
+    });
+
+    file = client_state.tokens.find(handle);
+    if (file != client_state.tokens.end()) {
+        auto& tokens = file->second;
+        for (auto it = tokens.begin(); it != tokens.end();) {
+            if (!overlaps(*it, handle, start, end)) {
+                ++it;
+                continue;
+            }
+            if (it->start_byte < start) {
+                Token head = *it;
+                head.end_byte = start - 1;
+                head.revoking = false;
+                tokens.insert(it, head);
+            }
+            if (it->end_byte > end) {
+                it->start_byte = end + 1;
+                it->revoking = false;
+                ++it;
+            } else {
+                it = tokens.erase(it);
+            }
+        }
+        if (tokens.empty()) {
+            client_state.tokens.erase(file);
+        }
+    }
+
+    client_state.recent_revokes.push_back({++client_state.revoke_epoch, handle, start, end});
+    if (client_state.recent_revokes.size() > PFS_RECENT_REVOKES) {
+        client_state.recent_revokes.pop_front();
+    }
+}
+
+using CallbackStream = grpc::ClientReaderWriter<pfsmeta::TokenRequest, pfsmeta::TokenResponse>;
+
+// Answer the REVOKE messages of one metadata shard until its stream ends
+static void serve_callbacks(int shard, std::unique_ptr<CallbackStream> stream) {
+    pfsmeta::TokenResponse message;
+    while (stream->Read(&message)) {
+        if (message.token_action() != pfsmeta::TOKEN_ACTION_REVOKE) {
+            continue;
+        }
+        give_back_tokens(message.handle(), message.start_byte(), message.end_byte());
+
+        pfsmeta::TokenRequest ack;
+        ack.set_client_id(client_state.session_ids[shard]);
+        ack.set_handle(message.handle());
+        ack.set_start_byte(message.start_byte());
+        ack.set_end_byte(message.end_byte());
+        ack.set_token_type(pfsmeta::TOKEN_OP_ACK);
+        ack.set_revoke_id(message.revoke_id());
+        if (!stream->Write(ack)) {
+            break;
+        }
+    }
+    grpc::Status status = stream->Finish();
+
+    // The Metadata Server reclaims the tokens of clients it cannot reach, so
+    // stop trusting the cache; that of the other shards too, for simplicity
+    std::lock_guard<std::mutex> lock(client_state.state_mutex);
+    if (!status.ok() && status.error_code() != grpc::StatusCode::CANCELLED) {
+        std::cerr << "[ERROR] Callback stream closed: " << status.error_message() << std::endl;
+    }
+    client_state.callbacks_alive = false;
+    for (auto file = client_state.tokens.begin(); file != client_state.tokens.end();) {
+        file->second.remove_if([](const Token& token) { return token.pins == 0; });
+        file = file->second.empty() ? client_state.tokens.erase(file) : std::next(file);
+    }
+}
+
+// Cached tokens are only trusted while the streams of all shards are up
+static bool start_callbacks() {
+    stop_callbacks();
+    std::vector<std::unique_ptr<CallbackStream>> streams;
+    for (size_t shard = 0; shard < metadata_stubs.size(); ++shard) {
+        callbacks.contexts.push_back(std::make_unique<grpc::ClientContext>());
+        auto stream = metadata_stubs[shard]->Callbacks(callbacks.contexts.back().get());
+
+        pfsmeta::TokenRequest request;
+        request.set_client_id(client_state.session_ids[shard]);
+        request.set_token_type(pfsmeta::TOKEN_OP_REGISTER);
+        if (!stream->Write(request)) {
+            stream->Finish();
+            for (auto& opened : streams) {
+                opened->WritesDone();
+                opened->Finish();
+            }
+            callbacks.contexts.clear();
+            return false;
+        }
+        streams.push_back(std::move(stream));
+    }
+    {
+        std::lock_guard<std::mutex> lock(client_state.state_mutex);
+        client_state.callbacks_alive = true;
+    }
+    for (size_t shard = 0; shard < streams.size(); ++shard) {
+        callbacks.threads.emplace_back(serve_callbacks, static_cast<int>(shard), std::move(streams[shard]));
+    }
+    return true;
+}
+
+static int64_t steady_ms() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Send an empty token request to each shard whenever a third of the lease
+// has gone by without one
+static void send_heartbeats() {
+    const int64_t interval = client_state.lease_ms / 3;
+    std::unique_lock<std::mutex> lock(heartbeat.mutex);
+    while (!heartbeat.cv.wait_for(lock, std::chrono::milliseconds(interval), []() { return heartbeat.stopping; })) {
+        lock.unlock();
+        for (size_t shard = 0; shard < metadata_stubs.size(); ++shard) {
+            if (steady_ms() - client_state.last_renewal_ms[shard].load() >= interval) {
+                std::vector<Token> none;
+                request_shard_tokens(static_cast<int>(shard), none);
+            }
+        }
+        lock.lock();
+    }
+}
+
+static void start_heartbeat() {
+    stop_heartbeat();
+    if (client_state.lease_ms <= 0) {
+        return;
+    }
+    for (size_t shard = 0; shard < metadata_stubs.size(); ++shard) {
+        client_state.last_renewal_ms[shard] = steady_ms();
+    }
+    heartbeat.stopping = false;
+    heartbeat.thread = std::thread(send_heartbeats);
+}
+
+static void stop_heartbeat() {
+    if (heartbeat.thread.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(heartbeat.mutex);
+            heartbeat.stopping = true;
+        }
+        heartbeat.cv.notify_one();
+        heartbeat.thread.join();
+    }
+}
+
+static void stop_callbacks() {
+    for (size_t i = 0; i < callbacks.threads.size(); ++i) {
+        callbacks.contexts[i]->TryCancel();
+        callbacks.threads[i].join();
+    }
+    callbacks.threads.clear();
+    callbacks.contexts.clear();
+}
+
+
 
 int pfs_finish(int client_id) {
     // Verify the client ID
@@ -185,63 +429,70 @@ int pfs_finish(int client_id) {
 
     std::cout << "[INFO] Starting PFS client shutdown for Client ID: " << client_id << std::endl;
 
-    // 1. Close all open files
+    // Leave any collective groups; their aggregators stop serving
     {
-        std::lock_guard<std::mutex> lock(client_state.state_mutex);
-        for (const auto& [fd, file_desc] : client_state.open_files) {
-            const std::string& filename = file_desc.filename;
+        std::lock_guard<std::mutex> lock(groups_mutex);
+        groups.clear();
+    }
 
-            // Release tokens associated with the file
-            grpc::ClientContext context;
-            pfsmeta::TokenRequest release_request;
-            pfsmeta::TokenResponse release_response;
-
-            release_request.set_client_id(client_id);
-            release_request.set_fd(fd);
-            release_request.set_filename(filename);
-            release_request.set_token_type("CLOSE");
-
-            auto stream = metadata_stub->StreamToken(&context);
-            if (stream->Write(release_request)) {
-                while (stream->Read(&release_response)) {
-                    if (release_response.token_action() == "ACK") {
-                        std::cout << "[INFO] Tokens successfully released for file: " << filename << std::endl;
-                        break;
-                    }
+    // 1. Close all open files
+    for (const auto& [fd, file] : open_files.take_all()) {
+        const FileDescriptor& file_desc = file->desc;
+        const std::string& filename = file_desc.filename;
+
+        // Release tokens associated with the file
+        grpc::ClientContext context;
+        pfsmeta::TokenRequest release_request;
+        pfsmeta::TokenResponse release_response;
+
+        release_request.set_client_id(client_state.session_ids[file_desc.meta_shard]);
+        release_request.set_fd(fd);
+        release_request.set_handle(file_desc.handle);
+        release_request.set_token_type(pfsmeta::TOKEN_OP_CLOSE);
+
+        auto stream = metadata_stubs[file_desc.meta_shard]->StreamToken(&context);
+        if (stream->Write(release_request)) {
+            while (stream->Read(&release_response)) {
+                if (release_response.token_action() == pfsmeta::TOKEN_ACTION_ACK) {
+                    std::cout << "[INFO] Tokens successfully released for file: " << filename << std::endl;
+                    break;
                 }
-                stream->WritesDone();
-            }
-            grpc::Status status = stream->Finish();
-            if (!status.ok()) {
-                std::cerr << "[ERROR] Failed to release tokens for file: " << filename
-                          << ". Error: " << status.error_message() << std::endl;
             }
+            stream->WritesDone();
+        }
+        grpc::Status status = stream->Finish();
+        if (!status.ok()) {
+            std::cerr << "[ERROR] Failed to release tokens for file: " << filename
+                      << ". Error: " << status.error_message() << std::endl;
         }
-
-        // Clear open files
-        client_state.open_files.clear();
     }
 
-    // 2. Notify the Metadata Server about client shutdown
-    grpc::ClientContext context;
-    pfsmeta::ClientShutdownRequest shutdown_request;
-    pfsmeta::ClientShutdownResponse shutdown_response;
+    stop_heartbeat();
+    stop_callbacks();
 
-    shutdown_request.set_client_id(client_id);
+    // 2. Notify every Metadata Server about client shutdown
+    for (size_t shard = 0; shard < metadata_stubs.size(); ++shard) {
+        grpc::ClientContext context;
+        pfsmeta::ClientShutdownRequest shutdown_request;
+        pfsmeta::ClientShutdownResponse shutdown_response;
 
-    grpc::Status shutdown_status = metadata_stub->ClientShutdown(&context, shutdown_request, &shutdown_response);
-    if (!shutdown_status.ok() || !shutdown_response.success()) {
-        std::cerr << "[ERROR] Metadata Server shutdown notification failed. Error: "
-                  << shutdown_status.error_message() << std::endl;
-        return -1;
+        shutdown_request.set_client_id(client_state.session_ids[shard]);
+
+        grpc::Status shutdown_status = metadata_stubs[shard]->ClientShutdown(&context, shutdown_request, &shutdown_response);
+        if (!shutdown_status.ok() || !shutdown_response.success()) {
+            std::cerr << "[ERROR] Metadata Server shutdown notification failed. Error: "
+                      << shutdown_status.error_message() << std::endl;
+            return -1;
+        }
     }
 
-    std::cout << "[INFO] Metadata Server acknowledged client shutdown." << std::endl;
+    std::cout << "[INFO] Metadata Servers acknowledged client shutdown." << std::endl;
 
     // 3. Reset client state
     {
         std::lock_guard<std::mutex> lock(client_state.state_mutex);
         client_state.tokens.clear();
+        client_state.recent_revokes.clear();
         client_state.num_read_hits = 0;
         client_state.num_write_hits = 0;
         client_state.num_evictions = 0;
@@ -252,7 +503,7 @@ int pfs_finish(int client_id) {
     }
 
     // 4. Clear Metadata and File Server Stubs
-    metadata_stub = nullptr;  // Reset metadata stub
+    metadata_stubs.clear();  // Reset metadata stubs
     file_server_stubs.clear();  // Clear file server stubs
 
     std::cout << "[INFO] PFS client shutdown completed successfully for Client ID: " << client_id << std::endl;
@@ -261,19 +512,32 @@ int pfs_finish(int client_id) {
 
 
 int pfs_create(const char* filename, int stripe_width) {
-    if (!filename || std::strlen(filename) == 0 || stripe_width <= 0 || stripe_width > NUM_FILE_SERVERS) {
+    struct pfs_create_options options = {PFS_DURABILITY_ON_FSYNC};
+    return pfs_create_ex(filename, stripe_width, &options);
+}
+
+
+int pfs_create_ex(const char* filename, int stripe_width, const struct pfs_create_options* options) {
+    if (!filename || std::strlen(filename) == 0 || stripe_width <= 0 || stripe_width > NUM_FILE_SERVERS || !options) {
         std::cerr << "[ERROR] Invalid arguments to pfs_create()." << std::endl;
         return -1;
     }
+    if (options->durability < PFS_DURABILITY_NONE || options->durability > PFS_DURABILITY_EVERY_WRITE) {
+        std::cerr << "[ERROR] Invalid durability policy provided to pfs_create()." << std::endl;
+        return -1;
+    }
 
     pfsmeta::CreateFileRequest request;
     pfsmeta::CreateFileResponse response;
 
     request.set_filename(filename);
     request.set_stripe_width(stripe_width);
+    request.set_durability(options->durability);
+    request.set_stripe_unit(options->stripe_unit);
+    request.set_stripe_blocks(options->stripe_blocks);
 
     grpc::ClientContext context;
-    grpc::Status status = metadata_stub->CreateFile(&context, request, &response);
+    grpc::Status status = metadata_stubs[metadata_shards.owner(filename)]->CreateFile(&context, request, &response);
 
     if (!status.ok()) {
         std::cerr << "[ERROR] gRPC call failed: " << status.error_message() << std::endl;
@@ -290,6 +554,41 @@ int pfs_create(const char* filename, int stripe_width) {
 }
 
 
+// Where a file's stripe units live. Files created before layouts were
+// formulas list a recipe per stripe position instead; those naming servers
+// we don't know predate placement and are striped over every file server.
+static FileLayout layout_of(const pfsmeta::FileMetadata& metadata) {
+    FileLayout layout;
+    if (metadata.stripe_unit() != 0) {
+        layout.stripe_unit = metadata.stripe_unit() * metadata.stripe_blocks();
+    }
+    if (metadata.server_count() != 0) {
+        layout.start_server = metadata.start_server();
+        layout.server_count = metadata.server_count();
+        layout.stripe_width = static_cast<int>(metadata.stripe_width());
+        layout.servers.assign(metadata.servers().begin(), metadata.servers().end());
+        return layout;
+    }
+
+    for (const auto& recipe : metadata.recipes()) {
+        auto it = std::find(file_server_addresses.begin(), file_server_addresses.end(),
+                            recipe.file_server_address());
+        if (it == file_server_addresses.end()) {
+            layout.servers.clear();
+            break;
+        }
+        layout.servers.push_back(static_cast<int>(it - file_server_addresses.begin()));
+    }
+    if (layout.servers.empty()) {
+        layout.server_count = static_cast<int>(file_server_stubs.size());
+        layout.stripe_width = layout.server_count;
+    } else {
+        layout.stripe_width = static_cast<int>(layout.servers.size());
+    }
+    return layout;
+}
+
+
 int pfs_open(const char* filename, int mode) {
     if (!filename || std::strlen(filename) == 0) {
         std::cerr << "[ERROR] Invalid filename provided to pfs_open()." << std::endl;
@@ -301,16 +600,6 @@ int pfs_open(const char* filename, int mode) {
     }
 
 
-    {
-        std::lock_guard<std::mutex> lock(client_state.state_mutex);
-        for (const auto& [fd, file_desc] : client_state.open_files) {
-            if (file_desc.filename == filename) {
-                std::cerr << "[ERROR] File '" << filename << "' is already open." << std::endl;
-                return -1;
-            }
-        }
-    }
-
 
     pfsmeta::FetchMetadataRequest request;
     pfsmeta::FetchMetadataResponse response;
@@ -318,7 +607,8 @@ int pfs_open(const char* filename, int mode) {
 
     request.set_filename(filename);
 
-    grpc::Status status = metadata_stub->FetchMetadata(&context, request, &response);
+    int meta_shard = metadata_shards.owner(filename);
+    grpc::Status status = metadata_stubs[meta_shard]->FetchMetadata(&context, request, &response);
     if (!status.ok() || !response.success()) {
         std::cerr << "[ERROR] Failed to fetch metadata for file '" << filename
                   << "': " << (response.success() ? response.message() : status.error_message()) << std::endl;
@@ -333,15 +623,28 @@ int pfs_open(const char* filename, int mode) {
         std::cerr << "[ERROR] Inconsistent metadata for file '" << filename << "'." << std::endl;
         return -1;
     }
+    if (metadata.directory()) {
+        std::cerr << "[ERROR] '" << filename << "' is a directory." << std::endl;
+        return -1;
+    }
 
 
-    static int next_fd = 1;
-    int fd = next_fd++;
+    FileLayout layout = layout_of(metadata);
+    for (int k = 0; k < layout.width(); ++k) {
+        if (layout.server(k) < 0 || layout.server(k) >= static_cast<int>(file_server_stubs.size())) {
+            std::cerr << "[ERROR] '" << filename << "' is on file servers missing from pfs_list.txt." << std::endl;
+            return -1;
+        }
+    }
 
- 
-    {
-        std::lock_guard<std::mutex> lock(client_state.state_mutex);
-        client_state.open_files[fd] = {filename, mode, metadata.filesize()};
+    FileDescriptor file_desc(filename, metadata.handle(), mode, static_cast<size_t>(metadata.filesize()),
+                             metadata.durability());
+    file_desc.meta_shard = meta_shard;
+    file_desc.layout = std::move(layout);
+    int fd = open_files.insert(std::move(file_desc));
+    if (fd < 0) {
+        std::cerr << "[ERROR] File '" << filename << "' is already open." << std::endl;
+        return -1;
     }
 
     std::cout << "[INFO] File '" << filename << "' opened successfully with FD " << fd 
@@ -350,27 +653,371 @@ int pfs_open(const char* filename, int mode) {
 }
 
 
-int pfs_read(int fd, void* buf, size_t num_bytes, off_t offset) {
+// Hands out the bytes of a DataChunk stream in the order they arrive
+struct ChunkCursor {
+    grpc::ClientReader<pfsfile::DataChunk>* reader;
+    pfsfile::DataChunk chunk;
+    size_t consumed = 0;
+
+    // Copy the next size bytes to dst; false if the stream ends first
+    bool copy(char* dst, int64_t size) {
+        while (size > 0) {
+            if (consumed == chunk.data().size()) {
+                if (!reader->Read(&chunk)) {
+                    return false;
+                }
+                consumed = 0;
+                continue;
+            }
+            size_t n = std::min<int64_t>(size, chunk.data().size() - consumed);
+            std::memcpy(dst, chunk.data().data() + consumed, n);
+            consumed += n;
+            dst += n;
+            size -= n;
+        }
+        return true;
+    }
+
+    // Drain the stream after a complete copy, or cancel it after a failed one
+    grpc::Status finish(bool ok, grpc::ClientContext& context) {
+        if (ok) {
+            while (reader->Read(&chunk)) {
+            }
+        } else {
+            context.TryCancel();
+        }
+        return reader->Finish();
+    }
+};
+
+// Stream the stripe units at position server_index of the layout within
+// [offset, offset + size) into buf. The server sends them back to back in
+// ascending order, so the same piece walk tells us where each received byte
+// belongs.
+static bool stream_read_from_server(const FileLayout& layout, size_t server_index, const std::string& filename,
+                                    FileHandle handle, char* buf, int64_t offset, int64_t size) {
+    int stripe_width = layout.width();
+
+    pfsfile::StripedExtent extent;
+    extent.set_handle(handle);
+    extent.set_offset(offset);
+    extent.set_size(size);
+    extent.set_stripe_unit(layout.stripe_unit);
+    extent.set_server_index(server_index);
+    extent.set_stripe_width(stripe_width);
+
+    grpc::ClientContext context;
+    auto reader = file_server_stubs[layout.server(server_index)]->ReadStream(&context, extent);
+
+    ChunkCursor cursor{reader.get()};
+    bool ok = forEachStripePiece(offset, size, layout.stripe_unit, server_index, stripe_width,
+        [&](int64_t piece_offset, int64_t piece_size) {
+            return cursor.copy(buf + (piece_offset - offset), piece_size);
+        });
+    grpc::Status status = cursor.finish(ok, context);
+    if (!ok || !status.ok()) {
+        std::cerr << "[ERROR] Streamed read failed on file server " << layout.server(server_index) << " for file: "
+                  << filename << ": " << status.error_message() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Stream the stripe units at position server_index of the layout within
+// [offset, offset + size) from buf in chunks of at most
+// PFS_STREAM_CHUNK_SIZE bytes. With sync set the server replies only once
+// the extent is durable.
+static bool stream_write_to_server(const FileLayout& layout, size_t server_index, const std::string& filename,
+                                   FileHandle handle, const char* buf, int64_t offset, int64_t size, bool sync) {
+    int stripe_width = layout.width();
+
+    grpc::ClientContext context;
+    pfsfile::WriteFileResponse response;
+    auto writer = file_server_stubs[layout.server(server_index)]->WriteStream(&context, &response);
+
+    pfsfile::WriteChunk chunk;
+    pfsfile::StripedExtent* extent = chunk.mutable_extent();
+    extent->set_handle(handle);
+    extent->set_offset(offset);
+    extent->set_size(size);
+    extent->set_stripe_unit(layout.stripe_unit);
+    extent->set_server_index(server_index);
+    extent->set_stripe_width(stripe_width);
+    chunk.set_sync(sync);
+
+    std::string* data = chunk.mutable_data();
+    data->reserve(PFS_STREAM_CHUNK_SIZE);
+
+    bool ok = forEachStripePiece(offset, size, layout.stripe_unit, server_index, stripe_width,
+        [&](int64_t piece_offset, int64_t piece_size) {
+            const char* src = buf + (piece_offset - offset);
+            while (piece_size > 0) {
+                size_t n = std::min<int64_t>(piece_size, PFS_STREAM_CHUNK_SIZE - data->size());
+                data->append(src, n);
+                src += n;
+                piece_size -= n;
+                if (data->size() == PFS_STREAM_CHUNK_SIZE) {
+                    if (!writer->Write(chunk)) {
+                        return false;
+                    }
+                    chunk.clear_extent();
+                    chunk.clear_sync();
+                    data->clear();
+                }
+            }
+            return true;
+        });
+    if (ok && (chunk.has_extent() || !data->empty())) {
+        ok = writer->Write(chunk);
+    }
+    writer->WritesDone();
+
+    grpc::Status status = writer->Finish();
+    if (!ok || !status.ok() || !response.success()) {
+        std::cerr << "[ERROR] Streamed write failed on file server " << layout.server(server_index) << " for file: "
+                  << filename << ": " << (status.ok() ? response.error_message() : status.error_message()) << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// Run transfer(server_index) in parallel for every position of the layout
+// marked active
+static bool transfer_on_positions(const std::vector<char>& active, const std::function<bool(size_t)>& transfer) {
+    std::vector<char> results(active.size(), 1);
+    std::vector<std::thread> workers;
+
+    for (size_t i = 0; i < active.size(); ++i) {
+        if (active[i]) {
+            workers.emplace_back([&, i]() { results[i] = transfer(i); });
+        }
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    return std::all_of(results.begin(), results.end(), [](char ok) { return ok; });
+}
+
+// Run transfer(server_index) in parallel for every position of the layout
+// whose file server owns part of [offset, offset + size).
+static bool transfer_on_servers(const FileLayout& layout, int64_t offset, int64_t size,
+                                const std::function<bool(size_t)>& transfer) {
+    size_t stripe_width = layout.width();
+    std::vector<char> active(stripe_width);
+    for (size_t i = 0; i < stripe_width; ++i) {
+        active[i] = stripeHasPieces(offset, size, layout.stripe_unit, i, stripe_width);
+    }
+    return transfer_on_positions(active, transfer);
+}
+
+
+// Ask one metadata shard for all wanted tokens of its files in one round
+// trip. On success each want holds the range actually granted, which may be
+// wider.
+static bool request_shard_tokens(int shard, std::vector<Token>& wants) {
+    pfsmeta::TokenBatchRequest request;
+    pfsmeta::TokenBatchResponse response;
+    request.set_client_id(client_state.session_ids[shard]);
+    for (const auto& want : wants) {
+        std::cout << "[INFO] Requesting " << (want.token_type == 2 ? "WRITE" : "READ") << " token for range ["
+                  << want.start_byte << ", " << want.end_byte << "] for file handle: " << want.handle << std::endl;
+        auto* range = request.add_ranges();
+        range->set_handle(want.handle);
+        range->set_start_byte(want.start_byte);
+        range->set_end_byte(want.end_byte);
+        range->set_token_type(want.token_type == 2 ? pfsmeta::TOKEN_OP_WRITE : pfsmeta::TOKEN_OP_READ);
+        range->set_exact(want.exact);
+    }
+
+    grpc::ClientContext context;
+    grpc::Status status = metadata_stubs[shard]->RequestTokens(&context, request, &response);
+    if (!status.ok() || !response.success() || response.granted_size() != static_cast<int>(wants.size())) {
+        std::cerr << "[ERROR] Communication with Metadata Server failed: "
+                  << (status.ok() ? response.error_message() : status.error_message()) << std::endl;
+        return false;
+    }
+    client_state.last_renewal_ms[shard] = steady_ms();
+    for (size_t i = 0; i < wants.size(); ++i) {
+        const auto& granted = response.granted(i);
+        std::cout << "[INFO] " << (granted.token_type() == pfsmeta::TOKEN_OP_WRITE ? "WRITE" : "READ")
+                  << " token granted for range [" << granted.start_byte() << ", " << granted.end_byte()
+                  << "] for file handle: " << granted.handle() << std::endl;
+        wants[i].start_byte = granted.start_byte();
+        wants[i].end_byte = granted.end_byte();
+    }
+    return true;
+}
+
+// Ask each shard for the wanted tokens of its files, one round trip per shard
+static bool request_tokens(std::vector<Token>& wants) {
+    std::map<int, std::vector<size_t>> by_shard;
+    for (size_t i = 0; i < wants.size(); ++i) {
+        by_shard[wants[i].meta_shard].push_back(i);
+    }
+    for (const auto& [shard, indices] : by_shard) {
+        std::vector<Token> shard_wants;
+        for (size_t i : indices) {
+            shard_wants.push_back(wants[i]);
+        }
+        if (!request_shard_tokens(shard, shard_wants)) {
+            return false;
+        }
+        for (size_t k = 0; k < indices.size(); ++k) {
+            wants[indices[k]] = shard_wants[k];
+        }
+    }
+    return true;
+}
+
+// Did a revocation acknowledged after epoch touch [start, end] of the file?
+static bool revoked_since(uint64_t epoch, FileHandle handle, int64_t start, int64_t end) {
+    const auto& revokes = client_state.recent_revokes;
+    if (client_state.revoke_epoch == epoch) {
+        return false;
+    }
+    if (revokes.empty() || revokes.front().epoch > epoch + 1) {
+        return true;  // Forgotten some of them; assume the worst
+    }
+    return std::any_of(revokes.begin(), revokes.end(), [&](const RevokeRecord& revoke) {
+        return revoke.epoch > epoch && revoke.handle == handle &&
+               revoke.start_byte <= end && revoke.end_byte >= start;
+    });
+}
+
+// Cache a token the metadata server just granted, dropping the unpinned
+// ones it covers
+static std::list<Token>::iterator cache_grant_locked(const Token& grant) {
+    auto& tokens = client_state.tokens[grant.handle];
+    for (auto it = tokens.begin(); it != tokens.end();) {
+        bool covered = it->pins == 0 && it->token_type <= grant.token_type &&
+                       it->start_byte >= grant.start_byte && it->end_byte <= grant.end_byte;
+        it = covered ? tokens.erase(it) : std::next(it);
+    }
+    Token cached = grant;
+    cached.pins = 0;
+    return tokens.insert(tokens.end(), cached);
+}
+
+// Pin tokens for every wanted (handle, token_type, range), reusing
+// cached ones where possible and asking for the rest in a single request.
+// Every successful call must be paired with unpin_token() on each held
+// token, normally through TokenPin.
+//
+// No pins are held across the request: a REVOKE of a pinned token waits
+// for the pin, so two clients each pinning a range the other asks for
+// would wait on each other. Grants are cached instead, and the whole set
+// is looked up again, until it can be pinned in one step.
+static bool acquire_tokens(const std::vector<Token>& wants, std::vector<std::list<Token>::iterator>& held) {
+    std::vector<Token> granted;
+    uint64_t epoch = 0;
+    for (;;) {
+        std::vector<Token> missing;
+        {
+            std::lock_guard<std::mutex> lock(client_state.state_mutex);
+            // The REVOKE for a range granted to us may overtake the grant itself
+            auto valid = std::remove_if(granted.begin(), granted.end(), [&](const Token& grant) {
+                return revoked_since(epoch, grant.handle, grant.start_byte, grant.end_byte);
+            });
+
+            // Without callbacks nothing stays cached, so the grants serve
+            // this call only, and only if all of them still hold
+            if (!client_state.callbacks_alive) {
+                if (!granted.empty() && valid == granted.end()) {
+                    for (const auto& grant : granted) {
+                        auto it = cache_grant_locked(grant);
+                        ++it->pins;
+                        held.push_back(it);
+                    }
+                    return true;
+                }
+                missing = wants;
+            } else {
+                for (auto it = granted.begin(); it != valid; ++it) {
+                    cache_grant_locked(*it);
+                }
+
+                std::vector<std::list<Token>::iterator> found;
+                for (const auto& want : wants) {
+                    auto file = client_state.tokens.find(want.handle);
+                    if (file == client_state.tokens.end()) {
+                        missing.push_back(want);
+                        continue;
+                    }
+                    auto& tokens = file->second;
+                    auto it = std::find_if(tokens.begin(), tokens.end(), [&](const Token& token) {
+                        return !token.revoking && token.token_type >= want.token_type &&
+                               token.start_byte <= want.start_byte && token.end_byte >= want.end_byte;
+                    });
+                    if (it == tokens.end()) {
+                        missing.push_back(want);
+                    } else {
+                        found.push_back(it);
+                    }
+                }
+                if (missing.empty()) {
+                    for (auto it : found) {
+                        ++it->pins;
+                        held.push_back(it);
+                    }
+                    return true;
+                }
+            }
+            epoch = client_state.revoke_epoch;
+        }
+
+        granted = missing;
+        if (!request_tokens(granted)) {
+            return false;
+        }
+    }
+}
+
+static void unpin_token(std::list<Token>::iterator held) {
+    std::lock_guard<std::mutex> lock(client_state.state_mutex);
+    if (--held->pins == 0) {
+        if (held->revoking || !client_state.callbacks_alive) {
+            FileHandle handle = held->handle;
+            auto& tokens = client_state.tokens[handle];
+            tokens.erase(held);
+            if (tokens.empty()) {
+                client_state.tokens.erase(handle);
+            }
+        }
+        client_state.tokens_cv.notify_all();
+    }
+}
+
+// Keeps tokens pinned for the rest of a read or write
+struct TokenPin {
+    std::vector<std::list<Token>::iterator> held;
+    ~TokenPin() {
+        for (auto it : held) {
+            unpin_token(it);
+        }
+    }
+};
+
+ssize_t pfs_read(int fd, void* buf, size_t num_bytes, off_t offset) {
     if (!buf || num_bytes <= 0) {
         std::cerr << "[ERROR] Invalid buffer or size provided to pfs_read()." << std::endl;
         return -1;
     }
 
     // Validate file descriptor and fetch associated metadata
-    std::string filename;
+    auto file = open_files.find(fd);
+    if (!file) {
+        std::cerr << "[ERROR] Invalid file descriptor: " << fd << std::endl;
+        return -1;
+    }
+    const std::string& filename = file->desc.filename;
+    FileHandle handle = file->desc.handle;
+    int meta_shard = file->desc.meta_shard;
+    const FileLayout& layout = file->desc.layout;
+    int mode = file->desc.mode;
     size_t filesize;
-    int mode;
     {
-        std::lock_guard<std::mutex> lock(client_state.state_mutex);
-        auto it = client_state.open_files.find(fd);
-        if (it == client_state.open_files.end()) {
-            std::cerr << "[ERROR] Invalid file descriptor: " << fd << std::endl;
-            return -1;
-        }
-        const FileDescriptor& file_desc = it->second;
-        filename = file_desc.filename;
-        filesize = file_desc.offset;  
-        mode = file_desc.mode;
+        std::lock_guard<std::mutex> lock(file->mutex);
+        filesize = file->desc.filesize;
     }
 
     if (mode != 1 && mode != 2) { 
@@ -385,41 +1032,8 @@ int pfs_read(int fd, void* buf, size_t num_bytes, off_t offset) {
     num_bytes = std::min(num_bytes, filesize - offset);
 
 
-    std::cout << "[INFO] Requesting READ token for range [" << offset << ", "
-              << offset + num_bytes - 1 << "] for file: " << filename << std::endl;
-
-    grpc::ClientContext context;
-    auto stream = metadata_stub->StreamToken(&context);
-
-    pfsmeta::TokenRequest token_request;
-    token_request.set_client_id(client_state.client_id);
-    token_request.set_fd(fd);
-    token_request.set_filename(filename);
-    token_request.set_start_byte(offset);
-    token_request.set_end_byte(offset + num_bytes - 1);
-    token_request.set_token_type("READ");
-
-    stream->Write(token_request);
-
-    // Wait for token grant or handle revocation
-    pfsmeta::TokenResponse token_response;
-    while (stream->Read(&token_response)) {
-        if (token_response.token_action() == "GRANT") {
-            std::cout << "[INFO] READ token granted for range [" << token_response.start_byte()
-                      << ", " << token_response.end_byte() << "] for file: " << filename << std::endl;
-            break;
-        } else if (token_response.token_action() == "REVOKE") {
-            std::cerr << "[ERROR] Received token revocation during READ request. Aborting read." << std::endl;
-            stream->WritesDone();
-            return -1;
-        }
-    }
-
-    stream->WritesDone();
-    grpc::Status status = stream->Finish();
-    if (!status.ok()) {
-        std::cerr << "[ERROR] Communication with Metadata Server failed: "
-                  << status.error_message() << std::endl;
+    TokenPin pin;
+    if (!acquire_tokens({Token(client_state.client_id, fd, handle, 1, offset, offset + num_bytes - 1, meta_shard)}, pin.held)) {
         return -1;
     }
 
@@ -427,24 +1041,40 @@ int pfs_read(int fd, void* buf, size_t num_bytes, off_t offset) {
     std::cout << "[INFO] Fetching data from file servers for file: " << filename
               << " in range [" << offset << ", " << offset + num_bytes - 1 << "]." << std::endl;
 
+    if (num_bytes > PFS_STREAM_THRESHOLD) {
+        bool ok = transfer_on_servers(layout, offset, num_bytes, [&](size_t server_index) {
+            return stream_read_from_server(layout, server_index, filename, handle, static_cast<char*>(buf), offset,
+                                           num_bytes);
+        });
+        if (!ok) {
+            return -1;
+        }
+        std::cout << "[INFO] Completed streamed read for file: " << filename << ". Bytes read: "
+                  << num_bytes << "." << std::endl;
+        return static_cast<ssize_t>(num_bytes);
+    }
+
     size_t total_bytes_read = 0;
     size_t remaining_bytes = num_bytes;
     off_t current_offset = offset;
     char* write_ptr = static_cast<char*>(buf);
 
     while (remaining_bytes > 0) {
-        size_t block_offset = current_offset % PFS_BLOCK_SIZE;
-        size_t bytes_to_read = std::min(remaining_bytes, PFS_BLOCK_SIZE - block_offset);
+        size_t block_offset = current_offset % layout.stripe_unit;
+        size_t bytes_to_read = std::min<size_t>(remaining_bytes, layout.stripe_unit - block_offset);
 
-        size_t server_index = (current_offset / PFS_BLOCK_SIZE) % file_server_stubs.size();
-        auto& file_server_stub = file_server_stubs[server_index];
+        size_t server_index = stripeServer(current_offset, layout.stripe_unit, layout.width());
+        auto& file_server_stub = file_server_stubs[layout.server(server_index)];
 
         pfsfile::ReadFileRequest read_request;
         pfsfile::ReadFileResponse read_response;
 
-        read_request.set_filename(filename);
+        read_request.set_handle(handle);
         read_request.set_offset(current_offset);
         read_request.set_size(bytes_to_read);
+        read_request.set_stripe_unit(layout.stripe_unit);
+        read_request.set_server_index(server_index);
+        read_request.set_stripe_width(layout.width());
 
         grpc::ClientContext read_context;
         grpc::Status read_status = file_server_stub->ReadFile(&read_context, read_request, &read_response);
@@ -472,28 +1102,57 @@ int pfs_read(int fd, void* buf, size_t num_bytes, off_t offset) {
     std::cout << "[INFO] Completed read for file: " << filename << ". Bytes read: "
               << total_bytes_read << "." << std::endl;
 
-    return static_cast<int>(total_bytes_read);
+    return static_cast<ssize_t>(total_bytes_read);
 }
 
 
-int pfs_write(int fd, const void* buf, size_t num_bytes, off_t offset) {
+// Tell the file's metadata shard that a write reached end, and let later
+// reads through the descriptor see it
+static bool record_write(OpenFile& file, int64_t end) {
+    grpc::ClientContext metadata_context;
+    pfsmeta::UpdateMetadataRequest update_request;
+    pfsmeta::UpdateMetadataResponse update_response;
+
+    update_request.set_filename(file.desc.filename);
+    update_request.set_filesize(end);
+    update_request.set_mtime(std::time(nullptr));
+
+    grpc::Status metadata_status =
+        metadata_stubs[file.desc.meta_shard]->UpdateMetadata(&metadata_context, update_request, &update_response);
+    if (!metadata_status.ok() || !update_response.success()) {
+        std::cerr << "[ERROR] Failed to update metadata for file: " << file.desc.filename
+                  << ": " << metadata_status.error_message() << std::endl;
+        return false;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(file.mutex);
+        file.desc.filesize = std::max<size_t>(file.desc.filesize, end);
+    }
+
+    std::cout << "[INFO] Metadata updated successfully for file: " << file.desc.filename
+              << ". New file size: " << end << "." << std::endl;
+    return true;
+}
+
+ssize_t pfs_write(int fd, const void* buf, size_t num_bytes, off_t offset) {
     if (!buf || num_bytes <= 0) {
         std::cerr << "[ERROR] Invalid buffer or size provided to pfs_write()." << std::endl;
         return -1;
     }
 
     // Validate file descriptor
-    std::string filename;
-    int mode;
-    {
-        std::lock_guard<std::mutex> lock(client_state.state_mutex);
-        if (client_state.open_files.find(fd) == client_state.open_files.end()) {
-            std::cerr << "[ERROR] Invalid file descriptor: " << fd << std::endl;
-            return -1;
-        }
-        filename = client_state.open_files[fd].filename;
-        mode = client_state.open_files[fd].mode;
+    auto file = open_files.find(fd);
+    if (!file) {
+        std::cerr << "[ERROR] Invalid file descriptor: " << fd << std::endl;
+        return -1;
     }
+    const std::string& filename = file->desc.filename;
+    FileHandle handle = file->desc.handle;
+    int meta_shard = file->desc.meta_shard;
+    const FileLayout& layout = file->desc.layout;
+    int mode = file->desc.mode;
+    bool sync = file->desc.durability == PFS_DURABILITY_EVERY_WRITE;
 
     if (mode != 2) { 
         std::cerr << "[ERROR] File not opened in write mode." << std::endl;
@@ -501,43 +1160,9 @@ int pfs_write(int fd, const void* buf, size_t num_bytes, off_t offset) {
     }
 
     
-    std::cout << "[INFO] Requesting WRITE token for range [" << offset << ", "
-              << offset + num_bytes - 1 << "] for file: " << filename << std::endl;
-
-    grpc::ClientContext context;
-    auto stream = metadata_stub->StreamToken(&context);
-
-   
-    pfsmeta::TokenRequest token_request;
-    token_request.set_client_id(client_state.client_id);
-    token_request.set_fd(fd);
-    token_request.set_filename(filename);
-    token_request.set_start_byte(offset);
-    token_request.set_end_byte(offset + num_bytes - 1);
-    token_request.set_token_type("WRITE");
-
-    stream->Write(token_request);
-
-    // Wait for token grant or handle revocation
-    pfsmeta::TokenResponse token_response;
-    while (stream->Read(&token_response)) {
-        if (token_response.token_action() == "GRANT") {
-            std::cout << "[INFO] WRITE token granted for range [" << token_response.start_byte()
-                      << ", " << token_response.end_byte() << "] for file: " << filename << std::endl;
-            break;
-        } else if (token_response.token_action() == "REVOKE") {
-            std::cerr << "[ERROR] Received token revocation during WRITE request. Aborting write." << std::endl;
-            stream->WritesDone();
-            return -1;
-        }
-    }
-
-    stream->WritesDone();
-    grpc::Status status = stream->Finish();
-    if (!status.ok()) {
-        std::cerr << "[ERROR] Communication with Metadata Server failed: "
-                  << status.error_message() << std::endl;
-        return -1;
+    TokenPin pin;
+    if (!acquire_tokens({Token(client_state.client_id, fd, handle, 2, offset, offset + num_bytes - 1, meta_shard)}, pin.held)) {
+        return -1;
     }
 
     
@@ -549,20 +1174,36 @@ int pfs_write(int fd, const void* buf, size_t num_bytes, off_t offset) {
     off_t current_offset = offset;
     const char* read_ptr = static_cast<const char*>(buf);
 
+    if (num_bytes > PFS_STREAM_THRESHOLD) {
+        bool ok = transfer_on_servers(layout, offset, num_bytes, [&](size_t server_index) {
+            return stream_write_to_server(layout, server_index, filename, handle, static_cast<const char*>(buf), offset,
+                                          num_bytes, sync);
+        });
+        if (!ok) {
+            return -1;
+        }
+        total_bytes_written = num_bytes;
+        remaining_bytes = 0;
+    }
+
     while (remaining_bytes > 0) {
-        size_t block_offset = current_offset % PFS_BLOCK_SIZE;
-        size_t bytes_to_write = std::min(remaining_bytes, PFS_BLOCK_SIZE - block_offset);
+        size_t block_offset = current_offset % layout.stripe_unit;
+        size_t bytes_to_write = std::min<size_t>(remaining_bytes, layout.stripe_unit - block_offset);
 
-        size_t server_index = (current_offset / PFS_BLOCK_SIZE) % file_server_stubs.size();
-        auto& file_server_stub = file_server_stubs[server_index];
+        size_t server_index = stripeServer(current_offset, layout.stripe_unit, layout.width());
+        auto& file_server_stub = file_server_stubs[layout.server(server_index)];
 
        
         pfsfile::WriteFileRequest write_request;
         pfsfile::WriteFileResponse write_response;
 
-        write_request.set_filename(filename);
+        write_request.set_handle(handle);
         write_request.set_offset(current_offset);
         write_request.set_data(std::string(read_ptr, bytes_to_write));
+        write_request.set_stripe_unit(layout.stripe_unit);
+        write_request.set_server_index(server_index);
+        write_request.set_stripe_width(layout.width());
+        write_request.set_sync(sync);
 
         grpc::ClientContext write_context;
         grpc::Status write_status = file_server_stub->WriteFile(&write_context, write_request, &write_response);
@@ -582,56 +1223,690 @@ int pfs_write(int fd, const void* buf, size_t num_bytes, off_t offset) {
     std::cout << "[INFO] Completed write for file: " << filename << ". Bytes written: "
               << total_bytes_written << "." << std::endl;
 
-    
-    grpc::ClientContext metadata_context;
-    pfsmeta::UpdateMetadataRequest update_request;
-    pfsmeta::UpdateMetadataResponse update_response;
+    if (!record_write(*file, offset + num_bytes)) {
+        return -1;
+    }
+    return static_cast<ssize_t>(total_bytes_written);
+}
 
-    update_request.set_filename(filename);
-    update_request.set_filesize(std::max(static_cast<size_t>(offset + num_bytes), total_bytes_written));
-    update_request.set_mtime(std::time(nullptr));  
 
-    grpc::Status metadata_status = metadata_stub->UpdateMetadata(&metadata_context, update_request, &update_response);
-    if (!metadata_status.ok() || !update_response.success()) {
-        std::cerr << "[ERROR] Failed to update metadata for file: " << filename
-                  << ": " << metadata_status.error_message() << std::endl;
+
+
+// One piece of a list I/O: size bytes at file offset, read into or written
+// from buf
+struct ListPiece {
+    int64_t offset;
+    int64_t size;
+    char* buf;
+};
+
+// The pieces share[first, last) as the extent list of one layout position
+static pfsfile::ExtentList extent_list(FileHandle handle, const FileLayout& layout, size_t server_index,
+                                       const std::vector<ListPiece>& pieces, const std::vector<size_t>& share,
+                                       size_t first, size_t last) {
+    pfsfile::ExtentList list;
+    list.set_handle(handle);
+    list.set_stripe_unit(layout.stripe_unit);
+    list.set_server_index(server_index);
+    list.set_stripe_width(layout.width());
+    for (size_t k = first; k < last; ++k) {
+        list.add_offsets(pieces[share[k]].offset);
+        list.add_sizes(pieces[share[k]].size);
+    }
+    return list;
+}
+
+// Read the stripe units at position server_index of every piece in share,
+// PFS_LIST_IO_BATCH pieces per request. Data arrives in the order of the
+// extents, so walking the pieces the same way puts each byte in place.
+static bool read_list_from_server(const FileLayout& layout, size_t server_index, const std::string& filename,
+                                  FileHandle handle, const std::vector<ListPiece>& pieces,
+                                  const std::vector<size_t>& share) {
+    for (size_t first = 0; first < share.size(); first += PFS_LIST_IO_BATCH) {
+        size_t last = std::min<size_t>(share.size(), first + PFS_LIST_IO_BATCH);
+        pfsfile::ExtentList list = extent_list(handle, layout, server_index, pieces, share, first, last);
+
+        grpc::ClientContext context;
+        auto reader = file_server_stubs[layout.server(server_index)]->ReadList(&context, list);
+
+        ChunkCursor cursor{reader.get()};
+        bool ok = true;
+        for (size_t k = first; ok && k < last; ++k) {
+            const ListPiece& item = pieces[share[k]];
+            ok = forEachStripePiece(item.offset, item.size, layout.stripe_unit, server_index, layout.width(),
+                [&](int64_t piece_offset, int64_t piece_size) {
+                    return cursor.copy(item.buf + (piece_offset - item.offset), piece_size);
+                });
+        }
+        grpc::Status status = cursor.finish(ok, context);
+        if (!ok || !status.ok()) {
+            std::cerr << "[ERROR] List read failed on file server " << layout.server(server_index) << " for file: "
+                      << filename << ": " << status.error_message() << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+// Write the stripe units at position server_index of every piece in share,
+// packed into chunks of at most PFS_STREAM_CHUNK_SIZE bytes
+static bool write_list_to_server(const FileLayout& layout, size_t server_index, const std::string& filename,
+                                 FileHandle handle, const std::vector<ListPiece>& pieces,
+                                 const std::vector<size_t>& share, bool sync) {
+    for (size_t first = 0; first < share.size(); first += PFS_LIST_IO_BATCH) {
+        size_t last = std::min<size_t>(share.size(), first + PFS_LIST_IO_BATCH);
+
+        grpc::ClientContext context;
+        pfsfile::WriteFileResponse response;
+        auto writer = file_server_stubs[layout.server(server_index)]->WriteList(&context, &response);
+
+        pfsfile::ListChunk chunk;
+        *chunk.mutable_extents() = extent_list(handle, layout, server_index, pieces, share, first, last);
+        chunk.set_sync(sync);
+        std::string* data = chunk.mutable_data();
+        data->reserve(PFS_STREAM_CHUNK_SIZE);
+
+        bool ok = true;
+        for (size_t k = first; ok && k < last; ++k) {
+            const ListPiece& item = pieces[share[k]];
+            ok = forEachStripePiece(item.offset, item.size, layout.stripe_unit, server_index, layout.width(),
+                [&](int64_t piece_offset, int64_t piece_size) {
+                    const char* src = item.buf + (piece_offset - item.offset);
+                    while (piece_size > 0) {
+                        size_t n = std::min<int64_t>(piece_size, PFS_STREAM_CHUNK_SIZE - data->size());
+                        data->append(src, n);
+                        src += n;
+                        piece_size -= n;
+                        if (data->size() == PFS_STREAM_CHUNK_SIZE) {
+                            if (!writer->Write(chunk)) {
+                                return false;
+                            }
+                            chunk.clear_extents();
+                            chunk.clear_sync();
+                            data->clear();
+                        }
+                    }
+                    return true;
+                });
+        }
+        if (ok && (chunk.has_extents() || !data->empty())) {
+            ok = writer->Write(chunk);
+        }
+        writer->WritesDone();
+
+        grpc::Status status = writer->Finish();
+        if (!ok || !status.ok() || !response.success()) {
+            std::cerr << "[ERROR] List write failed on file server " << layout.server(server_index) << " for file: "
+                      << filename << ": " << (status.ok() ? response.error_message() : status.error_message())
+                      << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+// Read or write all pieces of one list I/O call. The pieces' byte ranges,
+// merged, are asked for in a single token request (one covering range past
+// PFS_LIST_IO_TOKENS of them, unless the ranges must be exact), and each
+// file server of the layout then gets one transfer for its share of every
+// piece, in parallel.
+static ssize_t list_io(int fd, std::vector<ListPiece> pieces, bool write, bool exact_tokens = false) {
+    auto file = open_files.find(fd);
+    if (!file) {
+        std::cerr << "[ERROR] Invalid file descriptor: " << fd << std::endl;
         return -1;
     }
+    const std::string& filename = file->desc.filename;
+    FileHandle handle = file->desc.handle;
+    int meta_shard = file->desc.meta_shard;
+    const FileLayout& layout = file->desc.layout;
+    int mode = file->desc.mode;
+    bool sync = file->desc.durability == PFS_DURABILITY_EVERY_WRITE;
+    int64_t filesize;
+    {
+        std::lock_guard<std::mutex> lock(file->mutex);
+        filesize = file->desc.filesize;
+    }
 
-    std::cout << "[INFO] Metadata updated successfully for file: " << filename
-              << ". New file size: " << update_request.filesize() << "." << std::endl;
+    if (write ? mode != 2 : mode != 1 && mode != 2) {
+        std::cerr << "[ERROR] File not opened in " << (write ? "write" : "read or read/write") << " mode." << std::endl;
+        return -1;
+    }
+
+    // Reads stop at the end of the file; empty pieces move nothing
+    int64_t total_bytes = 0;
+    std::vector<std::pair<int64_t, int64_t>> ranges;
+    size_t kept = 0;
+    for (ListPiece item : pieces) {
+        if (!write) {
+            item.size = std::min(item.size, std::max<int64_t>(filesize - item.offset, 0));
+        }
+        if (item.size > 0) {
+            total_bytes += item.size;
+            ranges.emplace_back(item.offset, item.offset + item.size - 1);
+            pieces[kept++] = item;
+        }
+    }
+    pieces.resize(kept);
+    if (pieces.empty()) {
+        return 0;
+    }
+
+    std::sort(ranges.begin(), ranges.end());
+    size_t merged = 0;
+    for (size_t i = 1; i < ranges.size(); ++i) {
+        if (ranges[i].first <= ranges[merged].second + 1) {
+            ranges[merged].second = std::max(ranges[merged].second, ranges[i].second);
+        } else {
+            ranges[++merged] = ranges[i];
+        }
+    }
+    ranges.resize(merged + 1);
+    if (!exact_tokens && ranges.size() > PFS_LIST_IO_TOKENS) {
+        ranges = {{ranges.front().first, ranges.back().second}};
+    }
+
+    std::vector<Token> wants;
+    for (const auto& [start_byte, end_byte] : ranges) {
+        wants.emplace_back(client_state.client_id, fd, handle, write ? 2 : 1, start_byte, end_byte, meta_shard);
+        wants.back().exact = exact_tokens;
+    }
+    TokenPin pin;
+    if (!acquire_tokens(wants, pin.held)) {
+        return -1;
+    }
+
+    std::cout << "[INFO] " << (write ? "Writing " : "Reading ") << pieces.size() << " pieces (" << total_bytes
+              << " bytes) of file: " << filename << " in " << ranges.size() << " token ranges." << std::endl;
+
+    size_t stripe_width = layout.width();
+    std::vector<std::vector<size_t>> shares(stripe_width);
+    std::vector<char> active(stripe_width);
+    for (size_t i = 0; i < pieces.size(); ++i) {
+        for (size_t k = 0; k < stripe_width; ++k) {
+            if (stripeHasPieces(pieces[i].offset, pieces[i].size, layout.stripe_unit, k, stripe_width)) {
+                shares[k].push_back(i);
+                active[k] = 1;
+            }
+        }
+    }
+    bool ok = transfer_on_positions(active, [&](size_t server_index) {
+        return write ? write_list_to_server(layout, server_index, filename, handle, pieces, shares[server_index], sync)
+                     : read_list_from_server(layout, server_index, filename, handle, pieces, shares[server_index]);
+    });
+    if (!ok) {
+        return -1;
+    }
 
-    return static_cast<int>(total_bytes_written);
+    if (write) {
+        int64_t end = 0;
+        for (const auto& item : pieces) {
+            end = std::max(end, item.offset + item.size);
+        }
+        if (!record_write(*file, end)) {
+            return -1;
+        }
+    }
+    return static_cast<ssize_t>(total_bytes);
 }
 
+static bool iov_pieces(const char* caller, const struct iovec* iov, const off_t* offsets, int count,
+                       std::vector<ListPiece>& pieces) {
+    if (count < 0 || (count > 0 && (!iov || !offsets))) {
+        std::cerr << "[ERROR] Invalid piece list provided to " << caller << "()." << std::endl;
+        return false;
+    }
+    for (int i = 0; i < count; ++i) {
+        if (offsets[i] < 0 || (!iov[i].iov_base && iov[i].iov_len > 0)) {
+            std::cerr << "[ERROR] Invalid piece " << i << " provided to " << caller << "()." << std::endl;
+            return false;
+        }
+        pieces.push_back({offsets[i], static_cast<int64_t>(iov[i].iov_len), static_cast<char*>(iov[i].iov_base)});
+    }
+    return true;
+}
 
+static bool strided_pieces(const char* caller, const void* buf, const struct pfs_stride* stride,
+                           std::vector<ListPiece>& pieces) {
+    if (!stride || (!buf && stride->count > 0 && stride->block_length > 0)) {
+        std::cerr << "[ERROR] Invalid buffer or stride provided to " << caller << "()." << std::endl;
+        return false;
+    }
+    char* dst = static_cast<char*>(const_cast<void*>(buf));
+    for (size_t i = 0; i < stride->count; ++i) {
+        int64_t offset = stride->offset + static_cast<int64_t>(i) * stride->stride;
+        if (offset < 0) {
+            std::cerr << "[ERROR] Block " << i << " of the stride given to " << caller
+                      << "() starts before the file." << std::endl;
+            return false;
+        }
+        pieces.push_back({offset, static_cast<int64_t>(stride->block_length), dst + i * stride->block_length});
+    }
+    return true;
+}
 
+ssize_t pfs_readv(int fd, const struct iovec* iov, const off_t* offsets, int count) {
+    std::vector<ListPiece> pieces;
+    if (!iov_pieces(__func__, iov, offsets, count, pieces)) {
+        return -1;
+    }
+    return list_io(fd, std::move(pieces), false);
+}
 
-int pfs_close(int fd) {
-    
-    std::string filename;
+ssize_t pfs_writev(int fd, const struct iovec* iov, const off_t* offsets, int count) {
+    std::vector<ListPiece> pieces;
+    if (!iov_pieces(__func__, iov, offsets, count, pieces)) {
+        return -1;
+    }
+    return list_io(fd, std::move(pieces), true);
+}
+
+ssize_t pfs_read_strided(int fd, void* buf, const struct pfs_stride* stride) {
+    std::vector<ListPiece> pieces;
+    if (!strided_pieces(__func__, buf, stride, pieces)) {
+        return -1;
+    }
+    return list_io(fd, std::move(pieces), false);
+}
+
+ssize_t pfs_write_strided(int fd, const void* buf, const struct pfs_stride* stride) {
+    std::vector<ListPiece> pieces;
+    if (!strided_pieces(__func__, buf, stride, pieces)) {
+        return -1;
+    }
+    return list_io(fd, std::move(pieces), true);
+}
+
+
+static std::shared_ptr<CollectiveGroup> find_group(int group_id) {
+    std::lock_guard<std::mutex> lock(groups_mutex);
+    auto it = groups.find(group_id);
+    return it == groups.end() ? nullptr : it->second;
+}
+
+int pfs_group_join(const char* name, int size, int rank) {
+    if (!name || std::strlen(name) == 0 || size <= 0 || rank < 0 || rank >= size) {
+        std::cerr << "[ERROR] Invalid name, size or rank provided to pfs_group_join()." << std::endl;
+        return -1;
+    }
+
+    // One aggregator per file server, as long as there are enough members
+    int aggregators = std::min<int>(size, file_server_stubs.size());
+    auto group = std::make_shared<CollectiveGroup>(name, size, rank, aggregators);
+
+    pfsmeta::JoinGroupRequest request;
+    pfsmeta::JoinGroupResponse response;
+    request.set_name(name);
+    request.set_size(size);
+    request.set_rank(rank);
+    if (group->is_aggregator()) {
+        request.set_address(group->listen());
+        if (request.address().empty()) {
+            return -1;
+        }
+    }
+
+    // Ask again until the others are in
+    auto& stub = metadata_stubs[metadata_shards.owner(name)];
+    auto give_up = std::chrono::steady_clock::now() + std::chrono::milliseconds(PFS_COLLECTIVE_TIMEOUT_MS);
+    while (true) {
+        grpc::ClientContext context;
+        context.set_deadline(std::chrono::system_clock::now() + std::chrono::milliseconds(PFS_COLLECTIVE_TIMEOUT_MS));
+        grpc::Status status = stub->JoinGroup(&context, request, &response);
+        if (!status.ok() || !response.success()) {
+            std::cerr << "[ERROR] Failed to join group '" << name << "': "
+                      << (status.ok() ? response.message() : status.error_message()) << std::endl;
+            return -1;
+        }
+        if (response.complete()) {
+            break;
+        }
+        if (std::chrono::steady_clock::now() >= give_up) {
+            std::cerr << "[ERROR] Failed to join group '" << name << "': timed out waiting for the other members"
+                      << std::endl;
+            return -1;
+        }
+        request.set_poll(true);
+        std::this_thread::sleep_for(std::chrono::milliseconds(PFS_COLLECTIVE_POLL_MS));
+    }
+    if (response.addresses_size() != size) {
+        std::cerr << "[ERROR] Failed to join group '" << name << "': the group has the wrong size" << std::endl;
+        return -1;
+    }
+    group->connect(std::vector<std::string>(response.addresses().begin(), response.addresses().end()));
+
+    int group_id;
     {
-        std::lock_guard<std::mutex> lock(client_state.state_mutex);
-        if (client_state.open_files.find(fd) == client_state.open_files.end()) {
-            std::cerr << "[ERROR] Invalid file descriptor: " << fd << std::endl;
+        std::lock_guard<std::mutex> lock(groups_mutex);
+        group_id = next_group_id++;
+        groups[group_id] = group;
+    }
+    std::cout << "[INFO] Joined group '" << name << "' as rank " << rank << " of " << size << " with "
+              << aggregators << " aggregators." << std::endl;
+    return group_id;
+}
+
+int pfs_group_leave(int group_id) {
+    std::shared_ptr<CollectiveGroup> group;
+    {
+        std::lock_guard<std::mutex> lock(groups_mutex);
+        auto it = groups.find(group_id);
+        if (it == groups.end()) {
+            std::cerr << "[ERROR] Invalid group: " << group_id << std::endl;
+            return -1;
+        }
+        group = std::move(it->second);
+        groups.erase(it);
+    }
+    std::cout << "[INFO] Left group '" << group->name << "'." << std::endl;
+    return 0;
+}
+
+// Collective domain blocks: PFS_COLLECTIVE_BUFFER in whole stripe units
+static int64_t domain_block(const FileLayout& layout) {
+    return std::max<int64_t>(1, PFS_COLLECTIVE_BUFFER / layout.stripe_unit) * layout.stripe_unit;
+}
+
+// The aggregator's half of a collective call: merge every member's pieces
+// in its domain into contiguous runs, move those with exact tokens, which
+// no other aggregator ever asks for, and answer each member.
+static void aggregate(CollectiveGroup& group, uint64_t call, int fd, bool write) {
+    std::vector<pfscoll::Contribution> parts;
+    std::vector<pfscoll::ContributionResult> results(group.size);
+    std::string error;
+    auto fail = [&](const std::string& message) {
+        std::cerr << "[ERROR] Collective call " << call << " of group '" << group.name << "' failed: "
+                  << message << std::endl;
+        for (auto& result : results) {
+            result.set_success(false);
+            result.set_message(message);
+        }
+        group.scatter(call, std::move(results));
+    };
+    if (!group.gather(call, parts, error)) {
+        return fail(error);
+    }
+    auto file = open_files.find(fd);
+    for (const auto& part : parts) {
+        if (!file || part.handle() != file->desc.handle || part.write() != write ||
+            part.offsets_size() != part.sizes_size()) {
+            return fail("Members disagree on the file or direction of the call");
+        }
+    }
+
+    // Every member's pieces in file order. As in MPI-IO, what overlapping
+    // writes leave behind is undefined.
+    struct Part {
+        int64_t offset;
+        int64_t size;
+        const char* data;
+    };
+    std::vector<Part> all;
+    for (const auto& part : parts) {
+        int64_t at = 0;
+        for (int i = 0; i < part.offsets_size(); ++i) {
+            all.push_back({part.offsets(i), part.sizes(i), write ? part.data().data() + at : nullptr});
+            at += part.sizes(i);
+        }
+        if (write && at != static_cast<int64_t>(part.data().size())) {
+            return fail("Contribution of rank " + std::to_string(part.rank()) + " is malformed");
+        }
+    }
+    std::stable_sort(all.begin(), all.end(), [](const Part& a, const Part& b) { return a.offset < b.offset; });
+
+    std::vector<int64_t> run_offsets;
+    std::vector<std::string> runs;
+    for (const auto& item : all) {
+        if (runs.empty() || item.offset > run_offsets.back() + static_cast<int64_t>(runs.back().size())) {
+            run_offsets.push_back(item.offset);
+            runs.emplace_back();
+        }
+        std::string& run = runs.back();
+        int64_t at = item.offset - run_offsets.back();
+        run.resize(std::max<int64_t>(run.size(), at + item.size));
+        if (write) {
+            std::memcpy(&run[at], item.data, item.size);
+        }
+    }
+
+    int64_t filesize;
+    {
+        std::lock_guard<std::mutex> lock(file->mutex);
+        filesize = file->desc.filesize;
+    }
+    std::vector<ListPiece> pieces;
+    int64_t end = 0;
+    for (size_t r = 0; r < runs.size(); ++r) {
+        pieces.push_back({run_offsets[r], static_cast<int64_t>(runs[r].size()), &runs[r][0]});
+        end = std::max<int64_t>(end, run_offsets[r] + runs[r].size());
+    }
+    if (!pieces.empty() && list_io(fd, pieces, write, true) < 0) {
+        return fail("File server I/O failed");
+    }
+
+    for (int r = 0; r < group.size; ++r) {
+        results[r].set_success(true);
+        if (write) {
+            results[r].set_filesize(end);
+            continue;
+        }
+        // Hand each member back its own pieces, cut off at the end of the file
+        const auto& part = parts[r];
+        std::string* data = results[r].mutable_data();
+        for (int i = 0; i < part.offsets_size(); ++i) {
+            int64_t offset = part.offsets(i);
+            int64_t size = std::min(part.sizes(i), std::max<int64_t>(filesize - offset, 0));
+            size_t run = std::upper_bound(run_offsets.begin(), run_offsets.end(), offset) - run_offsets.begin() - 1;
+            data->append(runs[run], offset - run_offsets[run], size);
+            results[r].add_sizes(size);
+        }
+    }
+    std::cout << "[INFO] Aggregated " << all.size() << " pieces of " << group.size << " members into "
+              << runs.size() << " runs for collective call " << call << " of group '" << group.name << "'."
+              << std::endl;
+    group.scatter(call, std::move(results));
+}
+
+// Two-phase collective I/O. Each member splits its pieces at domain block
+// boundaries and sends every aggregator its share, an empty one included,
+// so the aggregators know when everyone is in. Aggregators serve the call
+// on this thread while their own contributions wait for the answer.
+static ssize_t collective_io(const char* caller, int group_id, int fd, const struct iovec* iov, const off_t* offsets,
+                             int count, bool write) {
+    std::vector<ListPiece> pieces;
+    if (!iov_pieces(caller, iov, offsets, count, pieces)) {
+        return -1;
+    }
+    auto group = find_group(group_id);
+    if (!group) {
+        std::cerr << "[ERROR] Invalid group: " << group_id << std::endl;
+        return -1;
+    }
+    auto file = open_files.find(fd);
+    if (!file) {
+        std::cerr << "[ERROR] Invalid file descriptor: " << fd << std::endl;
+        return -1;
+    }
+    if (write && file->desc.mode != 2) {
+        std::cerr << "[ERROR] File not opened in write mode." << std::endl;
+        return -1;
+    }
+
+    int64_t block = domain_block(file->desc.layout);
+    uint64_t call = group->next_call();
+    std::vector<pfscoll::Contribution> shares(group->aggregators);
+    std::vector<std::vector<ListPiece>> targets(group->aggregators);  // Reads: where the answers go
+    for (auto& share : shares) {
+        share.set_call(call);
+        share.set_rank(group->rank);
+        share.set_handle(file->desc.handle);
+        share.set_write(write);
+    }
+    for (const auto& item : pieces) {
+        for (int64_t offset = item.offset; offset < item.offset + item.size;) {
+            int64_t next = std::min(item.offset + item.size, (offset / block + 1) * block);
+            int aggregator = (offset / block) % group->aggregators;
+            char* buf = item.buf + (offset - item.offset);
+            shares[aggregator].add_offsets(offset);
+            shares[aggregator].add_sizes(next - offset);
+            if (write) {
+                shares[aggregator].mutable_data()->append(buf, next - offset);
+            } else {
+                targets[aggregator].push_back({offset, next - offset, buf});
+            }
+            offset = next;
+        }
+    }
+
+    std::vector<pfscoll::ContributionResult> results(group->aggregators);
+    std::vector<char> delivered(group->aggregators);
+    std::vector<std::thread> senders;
+    for (int a = 0; a < group->aggregators; ++a) {
+        senders.emplace_back([&, a]() { delivered[a] = group->contribute(a, shares[a], results[a]); });
+    }
+    if (group->is_aggregator()) {
+        aggregate(*group, call, fd, write);
+    }
+    for (auto& sender : senders) {
+        sender.join();
+    }
+
+    ssize_t total_bytes = 0;
+    int64_t end = 0;
+    for (int a = 0; a < group->aggregators; ++a) {
+        if (!delivered[a] || !results[a].success()) {
+            std::cerr << "[ERROR] " << caller << "() failed at aggregator " << a << ": " << results[a].message()
+                      << std::endl;
             return -1;
         }
-        filename = client_state.open_files[fd].filename; 
+        if (write) {
+            total_bytes += shares[a].data().size();
+            end = std::max(end, results[a].filesize());
+            continue;
+        }
+        const std::string& data = results[a].data();
+        size_t at = 0;
+        for (size_t i = 0; i < targets[a].size() && i < static_cast<size_t>(results[a].sizes_size()); ++i) {
+            int64_t size = std::min<int64_t>(results[a].sizes(i), data.size() - at);
+            std::memcpy(targets[a][i].buf, data.data() + at, size);
+            at += size;
+            total_bytes += size;
+        }
+    }
+    if (write) {
+        // The aggregators told the metadata server; later reads here see it too
+        std::lock_guard<std::mutex> lock(file->mutex);
+        file->desc.filesize = std::max<size_t>(file->desc.filesize, end);
+    }
+    return total_bytes;
+}
+
+ssize_t pfs_write_all(int group, int fd, const struct iovec* iov, const off_t* offsets, int count) {
+    return collective_io(__func__, group, fd, iov, offsets, count, true);
+}
+
+ssize_t pfs_read_all(int group, int fd, const struct iovec* iov, const off_t* offsets, int count) {
+    return collective_io(__func__, group, fd, iov, offsets, count, false);
+}
+
+
+// Run fn(server_index) on every file server in parallel
+static bool run_on_all_servers(const std::function<bool(size_t)>& fn) {
+    std::vector<char> results(file_server_stubs.size(), 1);
+    std::vector<std::thread> workers;
+
+    for (size_t i = 0; i < file_server_stubs.size(); ++i) {
+        workers.emplace_back([&, i]() { results[i] = fn(i); });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    return std::all_of(results.begin(), results.end(), [](char ok) { return ok; });
+}
+
+
+// Ask every file server of the layout to flush its part of the file. The
+// servers group concurrent requests into shared flushes, so this is cheap
+// under load.
+static bool sync_on_servers(const std::string& filename, FileHandle handle, const FileLayout& layout) {
+    // One stripe unit per position reaches every server of the layout
+    return transfer_on_servers(layout, 0, static_cast<int64_t>(layout.width()) * layout.stripe_unit,
+                               [&](size_t position) {
+        int i = layout.server(position);
+        pfsfile::SyncFileRequest request;
+        pfsfile::SyncFileResponse response;
+        request.set_handle(handle);
+
+        grpc::ClientContext context;
+        grpc::Status status = file_server_stubs[i]->SyncFile(&context, request, &response);
+        if (!status.ok() || !response.success()) {
+            std::cerr << "[ERROR] Sync failed on file server " << i << " for file: " << filename << ": "
+                      << (status.ok() ? response.error_message() : status.error_message()) << std::endl;
+            return false;
+        }
+        return true;
+    });
+}
+
+
+int pfs_fsync(int fd) {
+    auto file = open_files.find(fd);
+    if (!file) {
+        std::cerr << "[ERROR] Invalid file descriptor: " << fd << std::endl;
+        return -1;
+    }
+
+    // Files created without durability never pay for a flush
+    if (file->desc.durability == PFS_DURABILITY_NONE) {
+        return 0;
+    }
+    return sync_on_servers(file->desc.filename, file->desc.handle, file->desc.layout) ? 0 : -1;
+}
+
+
+int pfs_close(int fd) {
+    
+    auto file = open_files.find(fd);
+    if (!file) {
+        std::cerr << "[ERROR] Invalid file descriptor: " << fd << std::endl;
+        return -1;
     }
+    const std::string& filename = file->desc.filename;
+    FileHandle handle = file->desc.handle;
+    int meta_shard = file->desc.meta_shard;
+    const FileLayout& layout = file->desc.layout;
+    bool sync = file->desc.mode == 2 && file->desc.durability == PFS_DURABILITY_ON_CLOSE;
+
+    // Like close(2), the descriptor is released even if the flush fails
+    bool synced = !sync || sync_on_servers(filename, handle, layout);
 
 
     std::cout << "[INFO] Releasing tokens for file: " << filename << " and FD: " << fd << std::endl;
+    {
+        // The Metadata Server drops all our tokens on the file
+        std::lock_guard<std::mutex> lock(client_state.state_mutex);
+        auto tokens = client_state.tokens.find(handle);
+        if (tokens != client_state.tokens.end()) {
+            for (auto& token : tokens->second) {
+                token.revoking = true;
+            }
+            tokens->second.remove_if([](const Token& token) { return token.pins == 0; });
+            if (tokens->second.empty()) {
+                client_state.tokens.erase(tokens);
+            }
+        }
+    }
     grpc::ClientContext context;
     pfsmeta::TokenRequest release_request;
     pfsmeta::TokenResponse release_response;
 
-    release_request.set_client_id(client_state.client_id);
+    release_request.set_client_id(client_state.session_ids[meta_shard]);
     release_request.set_fd(fd);
-    release_request.set_filename(filename);
-    release_request.set_token_type("CLOSE");
+    release_request.set_handle(handle);
+    release_request.set_token_type(pfsmeta::TOKEN_OP_CLOSE);
 
   
-    auto stream = metadata_stub->StreamToken(&context);
+    auto stream = metadata_stubs[meta_shard]->StreamToken(&context);
 
 
     if (!stream->Write(release_request)) {
@@ -642,7 +1917,7 @@ int pfs_close(int fd) {
 
     // Wait for Metadata Server acknowledgment
     while (stream->Read(&release_response)) {
-        if (release_response.token_action() == "ACK") {
+        if (release_response.token_action() == pfsmeta::TOKEN_ACTION_ACK) {
             std::cout << "[INFO] Tokens successfully released for file: " << filename << std::endl;
             break;
         } else {
@@ -661,11 +1936,12 @@ int pfs_close(int fd) {
     }
 
  
-    {
-        std::lock_guard<std::mutex> lock(client_state.state_mutex);
-        client_state.open_files.erase(fd); 
-    }
+    open_files.erase(fd);
 
+    if (!synced) {
+        std::cerr << "[ERROR] File descriptor " << fd << " closed, but its data could not be made durable." << std::endl;
+        return -1;
+    }
     std::cout << "[INFO] File descriptor " << fd << " for file '" << filename << "' closed successfully." << std::endl;
     return 0;
 }
@@ -686,28 +1962,41 @@ int pfs_delete(const char* filename) {
 
     delete_request.set_filename(filename);
 
-    grpc::Status status = metadata_stub->DeleteFile(&context, delete_request, &delete_response);
+    grpc::Status status = metadata_stubs[metadata_shards.owner(filename)]->DeleteFile(&context, delete_request, &delete_response);
     if (!status.ok() || !delete_response.success()) {
         std::cerr << "[ERROR] Metadata server failed to delete file '" << filename
                   << "': " << (delete_response.success() ? delete_response.message() : status.error_message()) << std::endl;
         return -1;
     }
 
+    // Directories have no data on the file servers
+    if (delete_response.handle() == 0) {
+        std::cout << "[INFO] Directory '" << filename << "' deleted." << std::endl;
+        return 0;
+    }
+
     // Metadata deleted successfully
     std::cout << "[INFO] Metadata server confirmed file deletion. Proceeding to delete physical files." << std::endl;
 
-    for (const auto& file_server_stub : file_server_stubs) {
+    // Servers only move the file aside and free its space later, so all of
+    // them can be asked at once
+    bool deleted = run_on_all_servers([&](size_t i) {
         grpc::ClientContext fs_context;
         pfsfile::DeleteFileRequest fs_delete_request;
         pfsfile::DeleteFileResponse fs_delete_response;
 
-        fs_delete_request.set_filename(filename);
+        fs_delete_request.set_handle(delete_response.handle());
 
-        grpc::Status fs_status = file_server_stub->DeleteFile(&fs_context, fs_delete_request, &fs_delete_response);
+        grpc::Status fs_status = file_server_stubs[i]->DeleteFile(&fs_context, fs_delete_request, &fs_delete_response);
         if (!fs_status.ok() || !fs_delete_response.success()) {
-            std::cerr << "[ERROR] Failed to delete file on a file server: " << fs_status.error_message() << std::endl;
-            return -1;
+            std::cerr << "[ERROR] Failed to delete file on file server " << i << ": "
+                      << (fs_status.ok() ? fs_delete_response.message() : fs_status.error_message()) << std::endl;
+            return false;
         }
+        return true;
+    });
+    if (!deleted) {
+        return -1;
     }
 
     std::cout << "[INFO] File '" << filename << "' successfully deleted from all servers." << std::endl;
@@ -716,16 +2005,25 @@ int pfs_delete(const char* filename) {
 
 
 
-int pfs_fstat(int fd, struct pfs_metadata *meta_data) {
-    std::lock_guard<std::mutex> lock(client_state.state_mutex);
-
+static void fill_metadata(const pfsmeta::FileMetadata& metadata, struct pfs_metadata* meta_data) {
+    std::strncpy(meta_data->filename, metadata.filename().c_str(), sizeof(meta_data->filename));
+    meta_data->file_size = metadata.filesize();
+    meta_data->ctime = metadata.ctime();
+    meta_data->mtime = metadata.mtime();
+    meta_data->recipe.stripe_width = metadata.stripe_width();
+    meta_data->recipe.stripe_unit = metadata.stripe_unit() != 0 ? metadata.stripe_unit() : PFS_BLOCK_SIZE;
+    meta_data->recipe.stripe_blocks = metadata.stripe_unit() != 0 ? metadata.stripe_blocks() : 1;
+    meta_data->durability = metadata.durability();
+}
 
-    if (client_state.open_files.find(fd) == client_state.open_files.end()) {
+int pfs_fstat(int fd, struct pfs_metadata *meta_data) {
+    auto file = open_files.find(fd);
+    if (!file) {
         std::cerr << "[ERROR] Invalid file descriptor: " << fd << std::endl;
         return -1;
     }
 
-    const std::string& filename = client_state.open_files[fd].filename;
+    const std::string& filename = file->desc.filename;
 
 
     pfsmeta::FetchMetadataRequest request;
@@ -734,24 +2032,311 @@ int pfs_fstat(int fd, struct pfs_metadata *meta_data) {
 
     request.set_filename(filename);
 
-    grpc::Status status = metadata_stub->FetchMetadata(&context, request, &response);
+    grpc::Status status = metadata_stubs[file->desc.meta_shard]->FetchMetadata(&context, request, &response);
     if (!status.ok() || !response.success()) {
         std::cerr << "[ERROR] Failed to fetch metadata for file '" << filename << "': " << response.message() << std::endl;
         return -1;
     }
 
  
-    const auto& metadata = response.metadata();
-    std::strncpy(meta_data->filename, metadata.filename().c_str(), sizeof(meta_data->filename));
-    meta_data->file_size = metadata.filesize();
-    meta_data->ctime = metadata.ctime();
-    meta_data->mtime = metadata.mtime();
-    meta_data->recipe.stripe_width = metadata.stripe_width();
+    fill_metadata(response.metadata(), meta_data);
 
     std::cout << "[INFO] Fetched metadata for file '" << filename << "' successfully." << std::endl;
     return 0;
 }
 
+// Group entries by the shard holding them and call send(shard, entries)
+// with at most PFS_METADATA_BATCH of them at a time. Shards are served in
+// parallel.
+static void send_metadata_batches(const char** filenames, int count,
+                                  const std::function<void(int, const std::vector<int>&)>& send) {
+    std::vector<std::vector<int>> by_shard(metadata_stubs.size());
+    for (int i = 0; i < count; ++i) {
+        by_shard[metadata_shards.owner(filenames[i])].push_back(i);
+    }
+
+    std::vector<std::thread> workers;
+    for (size_t shard = 0; shard < by_shard.size(); ++shard) {
+        if (by_shard[shard].empty()) {
+            continue;
+        }
+        workers.emplace_back([&, shard]() {
+            const std::vector<int>& entries = by_shard[shard];
+            for (size_t start = 0; start < entries.size(); start += PFS_METADATA_BATCH) {
+                size_t end = std::min(entries.size(), start + PFS_METADATA_BATCH);
+                send(static_cast<int>(shard), std::vector<int>(entries.begin() + start, entries.begin() + end));
+            }
+        });
+    }
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+static bool valid_batch(const char** filenames, int count, int* results) {
+    if (!filenames || count < 0 || !results) {
+        return false;
+    }
+    for (int i = 0; i < count; ++i) {
+        if (!filenames[i]) {
+            return false;
+        }
+        results[i] = -1;
+    }
+    return true;
+}
+
+int pfs_create_many(const char** filenames, int count, int stripe_width, int* results) {
+    if (!valid_batch(filenames, count, results)) {
+        std::cerr << "[ERROR] Invalid arguments to pfs_create_many()." << std::endl;
+        return -1;
+    }
+
+    std::atomic<int> created{0};
+    send_metadata_batches(filenames, count, [&](int shard, const std::vector<int>& entries) {
+        pfsmeta::CreateFilesRequest request;
+        pfsmeta::CreateFilesResponse response;
+        for (int i : entries) {
+            auto* file = request.add_files();
+            file->set_filename(filenames[i]);
+            file->set_stripe_width(stripe_width);
+            file->set_durability(PFS_DURABILITY_ON_FSYNC);
+        }
+
+        grpc::ClientContext context;
+        grpc::Status status = metadata_stubs[shard]->CreateFiles(&context, request, &response);
+        if (!status.ok() || !response.success() || response.results_size() != static_cast<int>(entries.size())) {
+            std::cerr << "[ERROR] CreateFiles failed: "
+                      << (status.ok() ? response.message() : status.error_message()) << std::endl;
+            return;
+        }
+        for (size_t k = 0; k < entries.size(); ++k) {
+            if (response.results(k).success()) {
+                results[entries[k]] = 0;
+                ++created;
+            } else {
+                std::cerr << "[ERROR] Cannot create '" << filenames[entries[k]] << "': "
+                          << response.results(k).message() << std::endl;
+            }
+        }
+    });
+
+    std::cout << "[INFO] Created " << created << " of " << count << " files." << std::endl;
+    return created;
+}
+
+int pfs_stat_many(const char** filenames, int count, struct pfs_metadata* meta_data, int* results) {
+    if (!valid_batch(filenames, count, results) || !meta_data) {
+        std::cerr << "[ERROR] Invalid arguments to pfs_stat_many()." << std::endl;
+        return -1;
+    }
+
+    std::atomic<int> found{0};
+    send_metadata_batches(filenames, count, [&](int shard, const std::vector<int>& entries) {
+        pfsmeta::StatFilesRequest request;
+        pfsmeta::StatFilesResponse response;
+        for (int i : entries) {
+            request.add_filenames(filenames[i]);
+        }
+
+        grpc::ClientContext context;
+        grpc::Status status = metadata_stubs[shard]->StatFiles(&context, request, &response);
+        if (!status.ok() || !response.success() || response.files_size() != static_cast<int>(entries.size()) ||
+            response.results_size() != static_cast<int>(entries.size())) {
+            std::cerr << "[ERROR] StatFiles failed: "
+                      << (status.ok() ? response.message() : status.error_message()) << std::endl;
+            return;
+        }
+        for (size_t k = 0; k < entries.size(); ++k) {
+            if (response.results(k).success()) {
+                fill_metadata(response.files(k), &meta_data[entries[k]]);
+                results[entries[k]] = 0;
+                ++found;
+            }
+        }
+    });
+    return found;
+}
+
+// The file servers only move deleted files aside and reclaim their space in
+// the background, so each gets a single request for the whole batch
+int pfs_delete_many(const char** filenames, int count, int* results) {
+    if (!valid_batch(filenames, count, results)) {
+        std::cerr << "[ERROR] Invalid arguments to pfs_delete_many()." << std::endl;
+        return -1;
+    }
+
+    std::mutex handles_mutex;
+    std::vector<FileHandle> handles;
+    std::vector<int> with_data;  // Entries whose data the file servers still hold
+    send_metadata_batches(filenames, count, [&](int shard, const std::vector<int>& entries) {
+        pfsmeta::DeleteFilesRequest request;
+        pfsmeta::DeleteFilesResponse response;
+        for (int i : entries) {
+            request.add_filenames(filenames[i]);
+        }
+
+        grpc::ClientContext context;
+        grpc::Status status = metadata_stubs[shard]->DeleteFiles(&context, request, &response);
+        if (!status.ok() || !response.success() || response.results_size() != static_cast<int>(entries.size())) {
+            std::cerr << "[ERROR] DeleteFiles failed: "
+                      << (status.ok() ? response.message() : status.error_message()) << std::endl;
+            return;
+        }
+        std::lock_guard<std::mutex> lock(handles_mutex);
+        for (size_t k = 0; k < entries.size(); ++k) {
+            const auto& result = response.results(k);
+            if (!result.success()) {
+                std::cerr << "[ERROR] Cannot delete '" << filenames[entries[k]] << "': " << result.message() << std::endl;
+                continue;
+            }
+            results[entries[k]] = 0;
+            if (result.handle() != 0) {
+                handles.push_back(result.handle());
+                with_data.push_back(entries[k]);
+            }
+        }
+    });
+
+    if (!handles.empty()) {
+        bool deleted = run_on_all_servers([&](size_t i) {
+            pfsfile::DeleteFilesRequest request;
+            pfsfile::DeleteFileResponse response;
+            for (FileHandle handle : handles) {
+                request.add_handles(handle);
+            }
+
+            grpc::ClientContext context;
+            grpc::Status status = file_server_stubs[i]->DeleteFiles(&context, request, &response);
+            if (!status.ok() || !response.success()) {
+                std::cerr << "[ERROR] Failed to delete files on file server " << i << ": "
+                          << (status.ok() ? response.message() : status.error_message()) << std::endl;
+                return false;
+            }
+            return true;
+        });
+        // Like pfs_delete(), a file whose data may be left behind counts as failed
+        if (!deleted) {
+            for (int i : with_data) {
+                results[i] = -1;
+            }
+        }
+    }
+
+    int succeeded = static_cast<int>(std::count(results, results + count, 0));
+    std::cout << "[INFO] Deleted " << succeeded << " of " << count << " files." << std::endl;
+    return succeeded;
+}
+
+int pfs_mkdir(const char* path) {
+    if (!path || !validPath(path)) {
+        std::cerr << "[ERROR] Invalid path provided to pfs_mkdir()." << std::endl;
+        return -1;
+    }
+
+    pfsmeta::CreateFileRequest request;
+    pfsmeta::CreateFileResponse response;
+    request.set_filename(path);
+    request.set_directory(true);
+
+    grpc::ClientContext context;
+    grpc::Status status = metadata_stubs[metadata_shards.owner(path)]->CreateFile(&context, request, &response);
+    if (!status.ok() || !response.success()) {
+        std::cerr << "[ERROR] Failed to create directory '" << path << "': "
+                  << (status.ok() ? response.message() : status.error_message()) << std::endl;
+        return -1;
+    }
+    std::cout << "[INFO] Directory '" << path << "' created successfully." << std::endl;
+    return 0;
+}
+
+
+// The entries of a directory are spread over the shards by name, and each
+// shard streams its own in name order, so the listing is a merge of one
+// stream per shard
+long pfs_readdirplus(const char* path, int (*fn)(const struct pfs_dirent* entry, void* arg), void* arg) {
+    if (!path || !fn || (*path && !validPath(path))) {
+        std::cerr << "[ERROR] Invalid arguments to pfs_readdirplus()." << std::endl;
+        return -1;
+    }
+    if (*path) {
+        pfsmeta::FetchMetadataRequest request;
+        pfsmeta::FetchMetadataResponse response;
+        request.set_filename(path);
+        grpc::ClientContext context;
+        grpc::Status status = metadata_stubs[metadata_shards.owner(path)]->FetchMetadata(&context, request, &response);
+        if (!status.ok() || !response.success() || !response.metadata().directory()) {
+            std::cerr << "[ERROR] No such directory: " << path << std::endl;
+            return -1;
+        }
+    }
+
+    struct ShardListing {
+        grpc::ClientContext context;
+        std::unique_ptr<grpc::ClientReader<pfsmeta::DirPage>> reader;
+        pfsmeta::DirPage page;
+        int next = 0;
+        bool done = false;
+    };
+    std::vector<ShardListing> listings(metadata_stubs.size());
+    pfsmeta::ReadDirRequest request;
+    request.set_path(path);
+    for (size_t shard = 0; shard < listings.size(); ++shard) {
+        listings[shard].reader = metadata_stubs[shard]->ReadDirPlus(&listings[shard].context, request);
+    }
+    auto refill = [](ShardListing& listing) {
+        while (!listing.done && listing.next == listing.page.entries_size()) {
+            listing.next = 0;
+            listing.done = !listing.reader->Read(&listing.page);
+        }
+    };
+
+    long visited = 0;
+    bool stopped = false;
+    std::string last;
+    while (!stopped) {
+        ShardListing* first = nullptr;
+        for (auto& listing : listings) {
+            refill(listing);
+            if (!listing.done &&
+                (!first || listing.page.entries(listing.next).name() < first->page.entries(first->next).name())) {
+                first = &listing;
+            }
+        }
+        if (!first) {
+            break;
+        }
+        const pfsmeta::DirEntry& entry = first->page.entries(first->next++);
+        // A file being handed over to another shard may briefly be on both
+        if (visited > 0 && entry.name() == last) {
+            continue;
+        }
+        last = entry.name();
+
+        struct pfs_dirent dirent = {};
+        std::strncpy(dirent.name, entry.name().c_str(), sizeof(dirent.name) - 1);
+        dirent.is_directory = entry.directory();
+        dirent.file_size = entry.filesize();
+        dirent.ctime = entry.ctime();
+        dirent.mtime = entry.mtime();
+        ++visited;
+        stopped = fn(&dirent, arg) != 0;
+    }
+
+    bool ok = true;
+    for (auto& listing : listings) {
+        if (stopped) {
+            listing.context.TryCancel();
+        }
+        grpc::Status status = listing.reader->Finish();
+        if (!status.ok() && !stopped) {
+            std::cerr << "[ERROR] Listing of directory '" << path << "' failed: " << status.error_message() << std::endl;
+            ok = false;
+        }
+    }
+    return ok ? visited : -1;
+}
+
 int pfs_execstat(struct pfs_execstat *execstat_data) {
 
     return 0;
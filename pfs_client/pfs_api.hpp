@@ -4,11 +4,14 @@
 #include <cstdint>
 #include <cstdlib>
 #include <cstdbool>
+#include <sys/uio.h>
 #include <vector>
 #include <list>
+#include <deque>
 #include <unordered_map>
 #include <mutex>
 #include <condition_variable>
+#include <atomic>
 //#include <semaphore>
 #include <fstream>
 #include <iostream>
@@ -25,9 +28,27 @@ struct pfs_filerecipe {
     int stripe_width;
 
     // Additional...
+    int64_t stripe_unit;  // Bytes per stripe unit
+    int stripe_blocks;    // Units a file server holds back to back before the next one takes over
 
 };
 
+// Options for pfs_create_ex()
+struct pfs_create_options {
+    int durability;      // PFS_DURABILITY_* (pfs_create() uses PFS_DURABILITY_ON_FSYNC)
+    int64_t stripe_unit; // Bytes per stripe unit, up to PFS_MAX_STRIPE_UNIT; 0 for PFS_STRIPE_UNIT
+    int stripe_blocks;   // Units a file server holds back to back; 0 for STRIPE_BLOCKS
+};
+
+// count blocks of block_length bytes, the first at offset and each next
+// one stride bytes further on
+struct pfs_stride {
+    off_t offset;
+    size_t block_length;
+    off_t stride;
+    size_t count;
+};
+
 struct pfs_metadata {
     // Given metadata
     char filename[256];
@@ -37,9 +58,19 @@ struct pfs_metadata {
     struct pfs_filerecipe recipe;
 
     // Additional...
+    int durability;  // PFS_DURABILITY_* policy chosen at create time
 
 };
 
+// One entry of a directory listing
+struct pfs_dirent {
+    char name[256];      // Name within the directory
+    int is_directory;
+    uint64_t file_size;
+    time_t ctime;
+    time_t mtime;
+};
+
 struct pfs_execstat {
     long num_read_hits;
     long num_write_hits;
@@ -55,18 +86,40 @@ struct pfs_execstat {
 //     std::string filename;
 //     int mode;  // 1 for read, 2 for read/write
 // };
+// The file servers holding a file's stripe units: byte b of the file lives
+// on server(stripeServer(b, stripe_unit, width())). Servers are indices
+// into the file servers of pfs_list.txt.
+struct FileLayout {
+    int start_server = 0;
+    int server_count = 1;      // The formula wraps around after this many servers
+    int stripe_width = 0;
+    int64_t stripe_unit = PFS_BLOCK_SIZE;  // Bytes a server holds back to back (unit times blocks)
+    std::vector<int> servers;  // Explicit list when the servers are not consecutive
+
+    int width() const { return stripe_width; }
+    int server(int position) const {
+        return servers.empty() ? (start_server + position) % server_count : servers[position];
+    }
+};
+
 struct FileDescriptor {
     std::string filename; // The name of the file
+    FileHandle handle;    // What tokens and file servers know the file by
+    int meta_shard;       // Metadata server holding the file and its tokens
+    FileLayout layout;    // File servers holding the data
     int mode;             // Open mode: 1 for read, 2 for write
     int64_t offset;       // Current file offset
     size_t filesize;      // File size (added field)
+    int durability;       // PFS_DURABILITY_* policy of the file
 
     // Default constructor
-    FileDescriptor() : filename(""), mode(0), offset(0), filesize(0) {}
+    FileDescriptor() : filename(""), handle(0), meta_shard(0), mode(0), offset(0), filesize(0), durability(PFS_DURABILITY_ON_FSYNC) {}
 
     // Constructor for initialization
-    FileDescriptor(const std::string& file, int open_mode, size_t file_size, int64_t file_offset = 0)
-        : filename(file), mode(open_mode), offset(file_offset), filesize(file_size) {}
+    FileDescriptor(const std::string& file, FileHandle file_handle, int open_mode, size_t file_size,
+                   int file_durability = PFS_DURABILITY_ON_FSYNC, int64_t file_offset = 0)
+        : filename(file), handle(file_handle), meta_shard(0), mode(open_mode), offset(file_offset), filesize(file_size),
+          durability(file_durability) {}
 };
 
 
@@ -75,30 +128,52 @@ struct FileDescriptor {
 struct Token {
     int client_id;          // Client ID associated with the token
     int fd;                 // File descriptor associated with the token
-    std::string filename;   // File name for the token
+    FileHandle handle;      // File handle for the token
+    int meta_shard;         // Metadata server that grants it
     int token_type;         // 1 for READ, 2 for WRITE
     int64_t start_byte;     // Start byte range of the token
     int64_t end_byte;       // End byte range of the token
+    int pins;               // Reads and writes currently relying on the token
+    bool revoking;          // Being given back; no new pins
+    bool exact;             // Ask for this range only, not the free space around it
 
-    Token(int c_id, int file_d, const std::string& file, int type, int64_t start, int64_t end)
-        : client_id(c_id), fd(file_d), filename(file), token_type(type), start_byte(start), end_byte(end) {}
+    Token(int c_id, int file_d, FileHandle file, int type, int64_t start, int64_t end, int shard = 0)
+        : client_id(c_id), fd(file_d), handle(file), meta_shard(shard), token_type(type), start_byte(start), end_byte(end),
+          pins(0), revoking(false), exact(false) {}
+};
+
+// A revocation the client has acknowledged, kept for a short while so a
+// grant that raced with it can be recognised
+struct RevokeRecord {
+    uint64_t epoch;
+    FileHandle handle;
+    int64_t start_byte;
+    int64_t end_byte;
 };
 
 
 
-// Client State
+// Client State. Open files live in their own table (see FdTable);
+// state_mutex guards the token cache and revocation history and is never
+// held across an RPC.
 struct ClientState {
     int client_id;  // Unique client ID assigned by Metadata Server
-    std::unordered_map<int, FileDescriptor> open_files;  // Open files
-    std::vector<Token> tokens;  // Active tokens
+    std::vector<int> session_ids;  // Our client ID on each metadata shard; client_id is shard 0's
+    std::unordered_map<FileHandle, std::list<Token>> tokens;  // Cached tokens by file, kept until revoked
     std::mutex state_mutex;  // Thread-safety
-    int num_read_hits = 0;
-    int num_write_hits = 0;
-    int num_evictions = 0;
-    int num_writebacks = 0;
-    int num_invalidations = 0;
-    int num_close_writebacks = 0;
-    int num_close_evictions = 0;
+    std::condition_variable tokens_cv;  // Signalled when a token loses its last pin
+    bool callbacks_alive = false;  // Revocations reach us, so cached tokens can be reused
+    uint64_t revoke_epoch = 0;  // Number of revocations acknowledged so far
+    std::deque<RevokeRecord> recent_revokes;  // The last PFS_RECENT_REVOKES of them
+    int lease_ms = 0;  // Session lease granted by the Metadata Servers
+    std::unique_ptr<std::atomic<int64_t>[]> last_renewal_ms;  // Per shard, steady clock time our session was last renewed
+    std::atomic<int> num_read_hits{0};
+    std::atomic<int> num_write_hits{0};
+    std::atomic<int> num_evictions{0};
+    std::atomic<int> num_writebacks{0};
+    std::atomic<int> num_invalidations{0};
+    std::atomic<int> num_close_writebacks{0};
+    std::atomic<int> num_close_evictions{0};
 
     ClientState() : client_id(-1) {}
 };
@@ -107,10 +182,53 @@ struct ClientState {
 int pfs_initialize();
 int pfs_finish(int client_id);
 int pfs_create(const char *filename, int stripe_width);
+int pfs_create_ex(const char *filename, int stripe_width, const struct pfs_create_options *options);
 int pfs_open(const char *filename, int mode);
-int pfs_read(int fd, void *buf, size_t num_bytes, off_t offset);
-int pfs_write(int fd, const void *buf, size_t num_bytes, off_t offset);
+ssize_t pfs_read(int fd, void *buf, size_t num_bytes, off_t offset);
+ssize_t pfs_write(int fd, const void *buf, size_t num_bytes, off_t offset);
+int pfs_fsync(int fd);
+
+// List I/O: piece i is iov[i] at file offset offsets[i]. Tokens for all
+// pieces are acquired at once, and each file server gets one request for
+// its share. Reads are cut off at the end of the file. Returns the bytes
+// moved, or -1.
+ssize_t pfs_readv(int fd, const struct iovec *iov, const off_t *offsets, int count);
+ssize_t pfs_writev(int fd, const struct iovec *iov, const off_t *offsets, int count);
+// The same for a regular pattern, whose blocks lie back to back in buf
+ssize_t pfs_read_strided(int fd, void *buf, const struct pfs_stride *stride);
+ssize_t pfs_write_strided(int fd, const void *buf, const struct pfs_stride *stride);
+
+// Collective I/O. size clients, possibly in different processes, join a
+// group under the same name, each with its own rank, and then make the
+// same collective calls in the same order on the same file. Every call
+// moves the caller's list of pieces, as pfs_readv()/pfs_writev() do, but
+// in two phases: the first min(size, file servers) ranks act as
+// aggregators, each owning every n-th PFS_COLLECTIVE_BUFFER block of the
+// file, and do all file server I/O for their blocks in large runs under
+// tokens nobody else asks for. pfs_group_join() waits until all members
+// are in and returns a group ID, or -1.
+int pfs_group_join(const char *name, int size, int rank);
+ssize_t pfs_write_all(int group, int fd, const struct iovec *iov, const off_t *offsets, int count);
+ssize_t pfs_read_all(int group, int fd, const struct iovec *iov, const off_t *offsets, int count);
+int pfs_group_leave(int group);
 int pfs_close(int fd);
 int pfs_delete(const char *filename);
 int pfs_fstat(int fd, struct pfs_metadata *meta_data);
 int pfs_execstat(struct pfs_execstat *execstat_data);
+
+// Batched forms for workloads with many small files: one RPC per metadata
+// shard for up to PFS_METADATA_BATCH entries. results[i] is 0 or -1 for
+// entry i; each returns how many entries succeeded, or -1 for invalid
+// arguments.
+int pfs_create_many(const char **filenames, int count, int stripe_width, int *results);
+int pfs_stat_many(const char **filenames, int count, struct pfs_metadata *meta_data, int *results);
+int pfs_delete_many(const char **filenames, int count, int *results);
+
+// Paths are '/'-separated below the root, whose path is "". Files and
+// directories can only be created in an existing directory, and
+// pfs_delete() removes a directory once it is empty.
+int pfs_mkdir(const char *path);
+
+// Call fn on every entry of a directory in name order, until it returns
+// nonzero. Returns the number of entries passed to fn, or -1.
+long pfs_readdirplus(const char *path, int (*fn)(const struct pfs_dirent *entry, void *arg), void *arg);
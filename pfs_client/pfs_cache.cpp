@@ -26,11 +26,11 @@ void ClientCache::initialize() {
     cache_map.clear();
 }
 
-bool ClientCache::hasBlock(const std::string& key) {
+bool ClientCache::hasBlock(const BlockKey& key) {
     return cache_map.find(key) != cache_map.end();
 }
 
-void ClientCache::addBlock(const std::string& key, const std::string& data, int token) {
+void ClientCache::addBlock(const BlockKey& key, const std::string& data, int token) {
     if (cache_map.size() >= cache_size) {
         evictBlock();
     }
@@ -40,14 +40,14 @@ void ClientCache::addBlock(const std::string& key, const std::string& data, int
 
 void ClientCache::evictBlock() {
     if (!lru_list.empty()) {
-        std::string key = lru_list.back();
+        BlockKey key = lru_list.back();
         lru_list.pop_back();
         cache_map.erase(key);
         client_state.num_evictions++; // Increment eviction stat
     }
 }
 
-void ClientCache::invalidateBlock(const std::string& key) {
+void ClientCache::invalidateBlock(const BlockKey& key) {
     if (cache_map.find(key) != cache_map.end()) {
         lru_list.remove(key);
         cache_map.erase(key);
@@ -31,24 +31,38 @@ struct CacheBlock {
     int token;        // Token for read/write permissions
 };
 
+// Identifies a cached block: (file handle, block index)
+struct BlockKey {
+    FileHandle handle;
+    uint64_t block;
+
+    bool operator==(const BlockKey& other) const { return handle == other.handle && block == other.block; }
+};
+
+struct BlockKeyHash {
+    size_t operator()(const BlockKey& key) const {
+        return std::hash<uint64_t>()(key.handle * 0x9E3779B97F4A7C15ULL ^ key.block);
+    }
+};
+
 // Cache class
 class ClientCache {
 private:
     size_t cache_size;                     // Maximum number of blocks
     ClientState& client_state;             // Reference to the client state
-    std::list<std::string> lru_list;       // LRU list for cache management
-    std::unordered_map<std::string, CacheBlock> cache_map; // Key: filename+block_id -> CacheBlock
+    std::list<BlockKey> lru_list;          // LRU list for cache management
+    std::unordered_map<BlockKey, CacheBlock, BlockKeyHash> cache_map; // Key: (handle, block_id) -> CacheBlock
 
 public:
     ClientCache(size_t size, ClientState& state);
 
     void initialize();
 
-    bool hasBlock(const std::string& key);
+    bool hasBlock(const BlockKey& key);
 
-    void addBlock(const std::string& key, const std::string& data, int token);
+    void addBlock(const BlockKey& key, const std::string& data, int token);
 
     void evictBlock();
 
-    void invalidateBlock(const std::string& key);
+    void invalidateBlock(const BlockKey& key);
 };
\ No newline at end of file
@@ -0,0 +1,150 @@
+#include "pfs_collective.hpp"
+
+#include <chrono>
+#include <iostream>
+
+#include "pfs_common/pfs_common.hpp"
+
+class CollectiveGroup::Service final : public pfscoll::Aggregator::Service {
+public:
+    explicit Service(CollectiveGroup& group) : group(group) {}
+
+    grpc::Status Contribute(grpc::ServerContext* context,
+                            const pfscoll::Contribution* request,
+                            pfscoll::ContributionResult* response) override {
+        if (request->rank() < 0 || request->rank() >= group.size || request->rank() == group.rank) {
+            response->set_success(false);
+            response->set_message("Invalid rank");
+            return grpc::Status::OK;
+        }
+        group.deposit(*request, *response);
+        return grpc::Status::OK;
+    }
+
+private:
+    CollectiveGroup& group;
+};
+
+CollectiveGroup::CollectiveGroup(std::string name, int size, int rank, int aggregators)
+    : name(std::move(name)), size(size), rank(rank), aggregators(aggregators) {}
+
+CollectiveGroup::~CollectiveGroup() {
+    if (server) {
+        server->Shutdown(std::chrono::system_clock::now() + std::chrono::seconds(1));
+    }
+}
+
+std::string CollectiveGroup::listen() {
+    service = std::make_unique<Service>(*this);
+    int port = 0;
+    grpc::ServerBuilder builder;
+    builder.AddListeningPort("0.0.0.0:0", grpc::InsecureServerCredentials(), &port);
+    builder.SetMaxReceiveMessageSize(-1);
+    builder.SetMaxSendMessageSize(-1);
+    builder.RegisterService(service.get());
+    server = builder.BuildAndStart();
+    if (!server || port == 0) {
+        std::cerr << "[ERROR] Aggregator of group '" << name << "' could not start listening." << std::endl;
+        return "";
+    }
+    return getMyIP() + ":" + std::to_string(port);
+}
+
+void CollectiveGroup::connect(const std::vector<std::string>& addresses) {
+    grpc::ChannelArguments args;
+    args.SetMaxReceiveMessageSize(-1);
+    args.SetMaxSendMessageSize(-1);
+    for (int a = 0; a < aggregators; ++a) {
+        stubs.push_back(a == rank ? nullptr : pfscoll::Aggregator::NewStub(
+            grpc::CreateCustomChannel(addresses[a], grpc::InsecureChannelCredentials(), args)));
+    }
+}
+
+bool CollectiveGroup::contribute(int aggregator, const pfscoll::Contribution& contribution,
+                                 pfscoll::ContributionResult& result) {
+    if (aggregator == rank) {
+        deposit(contribution, result);
+        return true;
+    }
+
+    // The aggregator answers once the slowest member has contributed
+    grpc::ClientContext context;
+    context.set_deadline(std::chrono::system_clock::now() + std::chrono::milliseconds(2 * PFS_COLLECTIVE_TIMEOUT_MS));
+    grpc::Status status = stubs[aggregator]->Contribute(&context, contribution, &result);
+    if (!status.ok()) {
+        std::cerr << "[ERROR] Aggregator " << aggregator << " of group '" << name << "' is unreachable: "
+                  << status.error_message() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+CollectiveGroup::CallSlot& CollectiveGroup::slot(uint64_t call) {
+    CallSlot& slot = slots[call];
+    if (slot.arrived.empty()) {
+        slot.parts.resize(size);
+        slot.arrived.resize(size);
+    }
+    return slot;
+}
+
+void CollectiveGroup::deposit(const pfscoll::Contribution& contribution, pfscoll::ContributionResult& result) {
+    std::unique_lock<std::mutex> lock(mutex);
+    uint64_t call = contribution.call();
+    if (call < closed_below) {
+        result.set_success(false);
+        result.set_message("Call " + std::to_string(call) + " is already over");
+        return;
+    }
+    CallSlot& entry = slot(call);
+    int from = contribution.rank();
+    if (entry.arrived[from]) {
+        result.set_success(false);
+        result.set_message("Rank " + std::to_string(from) + " contributed twice to one call");
+        return;
+    }
+    entry.parts[from] = contribution;
+    entry.arrived[from] = 1;
+    if (++entry.count == size) {
+        cv.notify_all();
+    }
+
+    // std::map keeps the slot in place until the last member takes its answer
+    if (!cv.wait_for(lock, std::chrono::milliseconds(2 * PFS_COLLECTIVE_TIMEOUT_MS),
+                     [&]() { return entry.answered; })) {
+        entry.count--;  // Not waiting for an answer any more
+        result.set_success(false);
+        result.set_message("Aggregator " + std::to_string(rank) + " never got to the call");
+        return;
+    }
+    result = std::move(entry.results[from]);
+    if (++entry.taken == entry.count) {
+        slots.erase(call);
+    }
+}
+
+bool CollectiveGroup::gather(uint64_t call, std::vector<pfscoll::Contribution>& parts, std::string& error) {
+    std::unique_lock<std::mutex> lock(mutex);
+    CallSlot& entry = slot(call);
+    if (!cv.wait_for(lock, std::chrono::milliseconds(PFS_COLLECTIVE_TIMEOUT_MS),
+                     [&]() { return entry.count == size; })) {
+        error = "Only " + std::to_string(entry.count) + " of " + std::to_string(size) + " members contributed";
+        return false;
+    }
+    parts.swap(entry.parts);
+    return true;
+}
+
+void CollectiveGroup::scatter(uint64_t call, std::vector<pfscoll::ContributionResult> results) {
+    std::lock_guard<std::mutex> lock(mutex);
+    // Calls are answered in order; whoever is late to this one is turned away
+    closed_below = call + 1;
+    CallSlot& entry = slot(call);
+    if (entry.count == 0) {
+        slots.erase(call);  // Nobody is waiting for the answer
+        return;
+    }
+    entry.results = std::move(results);
+    entry.answered = true;
+    cv.notify_all();
+}
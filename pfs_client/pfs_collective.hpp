@@ -0,0 +1,86 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <grpcpp/grpcpp.h>
+
+#include "pfs_common/pfs_config.hpp"
+#include "pfs_proto/pfs_collective.grpc.pb.h"
+
+// One member's view of a collective I/O group: size clients, each with a
+// rank, making the same collective calls in the same order. The first
+// `aggregators` ranks are aggregators. The file is cut into domain blocks
+// that go round robin to the aggregators. In each call every member sends
+// each aggregator the pieces that fall in its blocks. The aggregator waits
+// for all of them, does the file server I/O for its blocks in large
+// contiguous runs, and then answers every member.
+//
+// Aggregators serve the Aggregator service on a port of their own. The
+// group's calls are numbered, so contributions that arrive early wait for
+// their call.
+class CollectiveGroup {
+public:
+    CollectiveGroup(std::string name, int size, int rank, int aggregators);
+    ~CollectiveGroup();
+
+    // Start serving the Aggregator service; returns the address to publish,
+    // or "" if the server could not start
+    std::string listen();
+
+    // Dial the aggregators at addresses, in rank order
+    void connect(const std::vector<std::string>& addresses);
+
+    bool is_aggregator() const { return rank < aggregators; }
+    uint64_t next_call() { return calls_made++; }
+
+    // Send one contribution to aggregator and wait for its result; false
+    // if it could not be delivered
+    bool contribute(int aggregator, const pfscoll::Contribution& contribution, pfscoll::ContributionResult& result);
+
+    // Aggregators: wait for every member's contribution to call, by rank
+    bool gather(uint64_t call, std::vector<pfscoll::Contribution>& parts, std::string& error);
+
+    // ... and answer them, results[r] going to rank r. This ends the call,
+    // whether gather() succeeded or not: the members that contributed get
+    // their answer and later contributions to it are refused.
+    void scatter(uint64_t call, std::vector<pfscoll::ContributionResult> results);
+
+    const std::string name;
+    const int size;
+    const int rank;
+    const int aggregators;
+
+private:
+    class Service;
+
+    // A call as seen by an aggregator
+    struct CallSlot {
+        std::vector<pfscoll::Contribution> parts;  // By rank
+        std::vector<char> arrived;
+        int count = 0;  // Members waiting for the answer
+        bool answered = false;
+        std::vector<pfscoll::ContributionResult> results;
+        int taken = 0;  // The slot goes once all count have taken theirs
+    };
+
+    // Hand contribution to its call and wait for the answer
+    void deposit(const pfscoll::Contribution& contribution, pfscoll::ContributionResult& result);
+    CallSlot& slot(uint64_t call);
+
+    uint64_t calls_made = 0;
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::map<uint64_t, CallSlot> slots;
+    uint64_t closed_below = 0;  // Calls before this one have been answered
+
+    std::unique_ptr<Service> service;
+    std::unique_ptr<grpc::Server> server;
+    std::vector<std::unique_ptr<pfscoll::Aggregator::Stub>> stubs;  // By aggregator rank
+};
@@ -0,0 +1,62 @@
+#include "pfs_fd_table.hpp"
+
+int FdTable::insert(FileDescriptor desc) {
+    // Claim the name first, so two threads cannot open the same file
+    {
+        Shard& shard = name_shard(desc.filename);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        if (!shard.names.insert(desc.filename).second) {
+            return -1;
+        }
+    }
+
+    int fd = next_fd.fetch_add(1, std::memory_order_relaxed);
+    auto file = std::make_shared<OpenFile>(std::move(desc));
+    Shard& shard = fd_shard(fd);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    shard.files.emplace(fd, std::move(file));
+    return fd;
+}
+
+std::shared_ptr<OpenFile> FdTable::find(int fd) const {
+    Shard& shard = fd_shard(fd);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.files.find(fd);
+    return it == shard.files.end() ? nullptr : it->second;
+}
+
+bool FdTable::erase(int fd) {
+    std::shared_ptr<OpenFile> file;
+    {
+        Shard& shard = fd_shard(fd);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.files.find(fd);
+        if (it == shard.files.end()) {
+            return false;
+        }
+        file = std::move(it->second);
+        shard.files.erase(it);
+    }
+
+    Shard& shard = name_shard(file->desc.filename);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    shard.names.erase(file->desc.filename);
+    return true;
+}
+
+std::vector<std::pair<int, std::shared_ptr<OpenFile>>> FdTable::take_all() {
+    std::vector<std::pair<int, std::shared_ptr<OpenFile>>> taken;
+    for (Shard& shard : shards) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        for (auto& entry : shard.files) {
+            taken.emplace_back(entry.first, std::move(entry.second));
+        }
+        shard.files.clear();
+    }
+    for (const auto& entry : taken) {
+        Shard& shard = name_shard(entry.second->desc.filename);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.names.erase(entry.second->desc.filename);
+    }
+    return taken;
+}
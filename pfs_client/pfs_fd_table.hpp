@@ -0,0 +1,57 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "pfs_common/pfs_config.hpp"
+#include "pfs_api.hpp"
+
+// An open file. Everything in desc but filesize and offset is fixed once
+// the file is open, so I/O reads it without a lock; mutex guards the rest.
+struct OpenFile {
+    FileDescriptor desc;
+    std::mutex mutex;
+
+    explicit OpenFile(FileDescriptor file_desc) : desc(std::move(file_desc)) {}
+};
+
+// The client's open files, split into PFS_FD_SHARDS shards with a lock
+// each, so threads working on different descriptors rarely meet. Lookups
+// hand out a reference to the open file and drop the shard lock at once;
+// the file stays valid for its holder even if another thread closes it.
+// Descriptors come from an atomic counter and are not reused.
+class FdTable {
+public:
+    // Add the file and return its descriptor; -1 if it is already open
+    int insert(FileDescriptor desc);
+
+    // The open file behind fd; null if fd is not open
+    std::shared_ptr<OpenFile> find(int fd) const;
+
+    // Drop fd; false if it was not open
+    bool erase(int fd);
+
+    // Drop every open file, returning them by descriptor
+    std::vector<std::pair<int, std::shared_ptr<OpenFile>>> take_all();
+
+private:
+    struct alignas(64) Shard {
+        mutable std::mutex mutex;
+        std::unordered_map<int, std::shared_ptr<OpenFile>> files;  // By descriptor
+        std::unordered_set<std::string> names;  // Open filenames that hash here
+    };
+
+    Shard& fd_shard(int fd) const { return shards[static_cast<unsigned>(fd) % PFS_FD_SHARDS]; }
+    Shard& name_shard(const std::string& filename) const {
+        return shards[std::hash<std::string>{}(filename) % PFS_FD_SHARDS];
+    }
+
+    std::atomic<int> next_fd{1};
+    mutable Shard shards[PFS_FD_SHARDS];
+};
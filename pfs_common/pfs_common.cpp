@@ -1,5 +1,7 @@
 #include "pfs_common.hpp"
 
+#include <algorithm>
+
 // Get the current node's hostname
 std::string getMyHostname() {
     char hostname[255] = {0};
@@ -17,3 +19,198 @@ std::string getMyIP() {
     std::string ret(temp);
     return ret;
 }
+
+// Offset arithmetic for one stripe unit size. The striping routines below
+// are templates over it, so power-of-two units (every unit pfs_create()
+// accepts by default) get loops built from shifts and masks, and other
+// sizes fall back to division.
+namespace {
+
+struct PowerOfTwoUnit {
+    int shift;
+    int64_t mask;
+
+    explicit PowerOfTwoUnit(int64_t stripe_unit)
+        : shift(__builtin_ctzll(static_cast<uint64_t>(stripe_unit))), mask(stripe_unit - 1) {}
+    int64_t index(int64_t offset) const { return offset >> shift; }
+    int64_t within(int64_t offset) const { return offset & mask; }
+    int64_t start(int64_t unit) const { return unit << shift; }
+};
+
+struct AnyUnit {
+    int64_t size;
+
+    explicit AnyUnit(int64_t stripe_unit) : size(stripe_unit) {}
+    int64_t index(int64_t offset) const { return offset / size; }
+    int64_t within(int64_t offset) const { return offset % size; }
+    int64_t start(int64_t unit) const { return unit * size; }
+};
+
+template <typename Fn>
+auto withStripeUnit(int64_t stripe_unit, Fn&& fn) {
+    if ((stripe_unit & (stripe_unit - 1)) == 0) {
+        return fn(PowerOfTwoUnit(stripe_unit));
+    }
+    return fn(AnyUnit(stripe_unit));
+}
+
+// Units to skip from `unit` to the next one owned by server_index
+inline int64_t unitsUntilOwned(int64_t unit, int server_index, int stripe_width) {
+    return (server_index - unit % stripe_width + stripe_width) % stripe_width;
+}
+
+template <typename Unit>
+bool forEachPiece(const Unit& u, int64_t offset, int64_t size, int server_index, int stripe_width,
+                  const std::function<bool(int64_t, int64_t)>& fn) {
+    int64_t end = offset + size;
+    int64_t unit = u.index(offset);
+
+    // Jump to the first unit owned by this server
+    unit += unitsUntilOwned(unit, server_index, stripe_width);
+
+    for (; u.start(unit) < end; unit += stripe_width) {
+        int64_t piece_start = std::max(u.start(unit), offset);
+        int64_t piece_end = std::min(u.start(unit + 1), end);
+        if (!fn(piece_start, piece_end - piece_start)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+template <typename Unit>
+bool hasPieces(const Unit& u, int64_t offset, int64_t size, int server_index, int stripe_width) {
+    int64_t first_unit = u.index(offset);
+    int64_t last_unit = u.index(offset + size - 1);
+    return first_unit + unitsUntilOwned(first_unit, server_index, stripe_width) <= last_unit;
+}
+
+template <typename Unit>
+int64_t localOffset(const Unit& u, int64_t offset, int stripe_width) {
+    return u.start(u.index(offset) / stripe_width) + u.within(offset);
+}
+
+template <typename Unit>
+void localRange(const Unit& u, int64_t offset, int64_t size, int server_index, int stripe_width,
+                int64_t* local_begin, int64_t* local_end) {
+    int64_t first_unit = u.index(offset);
+    first_unit += unitsUntilOwned(first_unit, server_index, stripe_width);
+    int64_t first_byte = std::max(u.start(first_unit), offset);
+
+    int64_t last_unit = u.index(offset + size - 1);
+    last_unit -= (last_unit % stripe_width - server_index + stripe_width) % stripe_width;
+    int64_t last_byte = std::min(u.start(last_unit + 1), offset + size) - 1;
+
+    *local_begin = localOffset(u, first_byte, stripe_width);
+    *local_end = localOffset(u, last_byte, stripe_width) + 1;
+}
+
+}  // namespace
+
+bool forEachStripePiece(int64_t offset, int64_t size, int64_t stripe_unit,
+                        int server_index, int stripe_width,
+                        const std::function<bool(int64_t, int64_t)>& fn) {
+    if (size <= 0) {
+        return true;
+    }
+    return withStripeUnit(stripe_unit, [&](const auto& u) {
+        return forEachPiece(u, offset, size, server_index, stripe_width, fn);
+    });
+}
+
+bool stripeHasPieces(int64_t offset, int64_t size, int64_t stripe_unit,
+                     int server_index, int stripe_width) {
+    if (size <= 0) {
+        return false;
+    }
+    return withStripeUnit(stripe_unit, [&](const auto& u) {
+        return hasPieces(u, offset, size, server_index, stripe_width);
+    });
+}
+
+int stripeServer(int64_t offset, int64_t stripe_unit, int stripe_width) {
+    return withStripeUnit(stripe_unit, [&](const auto& u) {
+        return static_cast<int>(u.index(offset) % stripe_width);
+    });
+}
+
+int64_t stripeLocalOffset(int64_t offset, int64_t stripe_unit, int stripe_width) {
+    return withStripeUnit(stripe_unit, [&](const auto& u) {
+        return localOffset(u, offset, stripe_width);
+    });
+}
+
+void stripeLocalRange(int64_t offset, int64_t size, int64_t stripe_unit,
+                      int server_index, int stripe_width,
+                      int64_t* local_begin, int64_t* local_end) {
+    *local_begin = 0;
+    *local_end = 0;
+    if (!stripeHasPieces(offset, size, stripe_unit, server_index, stripe_width)) {
+        return;
+    }
+    withStripeUnit(stripe_unit, [&](const auto& u) {
+        localRange(u, offset, size, server_index, stripe_width, local_begin, local_end);
+    });
+}
+
+// 64-bit FNV-1a, finished with the splitmix64 mixer so neighbouring
+// inputs land far apart on the ring
+static uint64_t ringHash(const std::string& key) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (unsigned char c : key) {
+        hash = (hash ^ c) * 0x100000001b3ULL;
+    }
+    hash = (hash ^ (hash >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    hash = (hash ^ (hash >> 27)) * 0x94d049bb133111ebULL;
+    return hash ^ (hash >> 31);
+}
+
+ShardMap::ShardMap(int num_shards) {
+    for (int i = 0; i < num_shards; ++i) {
+        addShard();
+    }
+}
+
+void ShardMap::addShard() {
+    int shard = num_shards++;
+    for (int vnode = 0; vnode < PFS_META_VNODES; ++vnode) {
+        ring.emplace_back(ringHash("shard-" + std::to_string(shard) + "-" + std::to_string(vnode)), shard);
+    }
+    std::sort(ring.begin(), ring.end());
+}
+
+int ShardMap::owner(const std::string& filename) const {
+    auto it = std::lower_bound(ring.begin(), ring.end(), std::make_pair(ringHash(filename), 0));
+    return it == ring.end() ? ring.front().second : it->second;
+}
+
+std::vector<std::string> splitServerList(const std::string& line) {
+    std::vector<std::string> servers;
+    size_t start = 0;
+    while (start <= line.size()) {
+        size_t end = line.find(',', start);
+        if (end == std::string::npos) {
+            end = line.size();
+        }
+        if (end > start) {
+            servers.push_back(line.substr(start, end - start));
+        }
+        start = end + 1;
+    }
+    return servers;
+}
+
+bool validPath(const std::string& path) {
+    return !path.empty() && path.front() != '/' && path.back() != '/' &&
+           path.find("//") == std::string::npos;
+}
+
+std::string parentPath(const std::string& path) {
+    size_t slash = path.rfind('/');
+    return slash == std::string::npos ? "" : path.substr(0, slash);
+}
+
+std::string baseName(const std::string& path) {
+    size_t slash = path.rfind('/');
+    return slash == std::string::npos ? path : path.substr(slash + 1);
+}
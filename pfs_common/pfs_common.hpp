@@ -13,8 +13,81 @@
 #include <iostream>
 #include <fstream>
 #include <vector>
+#include <functional>
+#include <utility>
 
 #include "pfs_config.hpp"
 
+// Names a file in token and data requests. Assigned by the metadata server
+// when the file is created and never reused; 0 is not a valid handle. The
+// top PFS_HANDLE_SHARD_BITS bits hold the metadata shard that created it,
+// so shards never hand out the same handle.
+using FileHandle = uint64_t;
+
+inline FileHandle makeFileHandle(int shard, uint64_t sequence) {
+    return (static_cast<uint64_t>(shard) << (64 - PFS_HANDLE_SHARD_BITS)) | sequence;
+}
+
+inline int handleShard(FileHandle handle) {
+    return static_cast<int>(handle >> (64 - PFS_HANDLE_SHARD_BITS));
+}
+
+inline uint64_t handleSequence(FileHandle handle) {
+    return handle & ((uint64_t(1) << (64 - PFS_HANDLE_SHARD_BITS)) - 1);
+}
+
+// Assigns file names to metadata server shards by consistent hashing. Each
+// shard owns PFS_META_VNODES points on a 64-bit ring, and a name belongs to
+// the shard of the first point at or after the name's hash. Adding a shard
+// only moves the names that fall just before its points, about 1/N of all.
+class ShardMap {
+public:
+    explicit ShardMap(int num_shards = 1);
+
+    void addShard();
+    int size() const { return num_shards; }
+    int owner(const std::string& filename) const;
+
+private:
+    std::vector<std::pair<uint64_t, int>> ring;  // (point, shard), sorted
+    int num_shards = 0;
+};
+
+// The entries of a comma-separated server list, such as the metadata
+// servers on the first line of pfs_list.txt
+std::vector<std::string> splitServerList(const std::string& line);
+
+// Paths name files and directories below the root, whose path is "". They
+// are '/'-separated, with no leading, trailing or doubled '/'.
+bool validPath(const std::string& path);
+std::string parentPath(const std::string& path);  // "" for top-level names
+std::string baseName(const std::string& path);
+
 std::string getMyHostname();
 std::string getMyIP();
+
+// Visit the pieces of the logical range [offset, offset + size) that land on
+// server `server_index` when a file is striped over `stripe_width` servers in
+// units of `stripe_unit` bytes. Pieces are visited in ascending offset order;
+// the walk stops early when fn returns false.
+bool forEachStripePiece(int64_t offset, int64_t size, int64_t stripe_unit,
+                        int server_index, int stripe_width,
+                        const std::function<bool(int64_t, int64_t)>& fn);
+
+// Whether server `server_index` owns any stripe unit of [offset, offset + size)
+bool stripeHasPieces(int64_t offset, int64_t size, int64_t stripe_unit,
+                     int server_index, int stripe_width);
+
+// Position in the stripe of the server that owns logical byte `offset`
+int stripeServer(int64_t offset, int64_t stripe_unit, int stripe_width);
+
+// Offset inside a server's compact local file of logical byte `offset`. Each
+// server stores only its own stripe units, back to back in logical order.
+int64_t stripeLocalOffset(int64_t offset, int64_t stripe_unit, int stripe_width);
+
+// Local byte range [*local_begin, *local_end) that holds server
+// `server_index`'s stripe units of the logical range [offset, offset + size).
+// The range is contiguous because consecutive owned units are stored adjacently.
+void stripeLocalRange(int64_t offset, int64_t size, int64_t stripe_unit,
+                      int server_index, int stripe_width,
+                      int64_t* local_begin, int64_t* local_end);
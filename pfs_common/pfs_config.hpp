@@ -1,6 +1,47 @@
 #pragma once
 
-#define PFS_BLOCK_SIZE 512 // 512 Bytes
+#define PFS_BLOCK_SIZE 512 // 512 Bytes; also the stripe unit of files created before units were per file
 #define NUM_FILE_SERVERS 4 // 4 File Servers
-#define STRIPE_BLOCKS 2 // 2 Blocks
+#define STRIPE_BLOCKS 2 // 2 Blocks; default stripe units a file server holds back to back
+#define PFS_STRIPE_UNIT (1 << 20) // Default stripe unit of new files, 1 MiB
+#define PFS_MAX_STRIPE_UNIT (16 << 20) // Largest stripe unit pfs_create_ex() accepts
+#define PFS_MAX_STRIPE_BLOCKS 64 // Most stripe units a file server may hold back to back
 #define CLIENT_CACHE_BLOCKS 16 // 16 Blocks
+#define PFS_STREAM_CHUNK_SIZE (1 << 20) // 1 MiB per streamed message
+#define PFS_STREAM_THRESHOLD (64 * 1024) // Transfers above 64 KiB are streamed
+#define PFS_LOG_SEGMENT_SIZE (64 << 20) // 64 MiB log segments
+#define PFS_LOG_COMPACT_THRESHOLD 50 // Clean segments that are less than 50% live
+#define PFS_LOG_COMPACT_RATE (32 << 20) // Cleaner copies at most 32 MiB/s
+
+// Per-file durability policies, chosen at create time
+#define PFS_DURABILITY_NONE 0 // Never flush; data reaches disk with the page cache
+#define PFS_DURABILITY_ON_CLOSE 1 // Flush on pfs_close() and pfs_fsync()
+#define PFS_DURABILITY_ON_FSYNC 2 // Flush on pfs_fsync() only (default)
+#define PFS_DURABILITY_EVERY_WRITE 3 // Every pfs_write() is durable before it returns
+#define PFS_GROUP_COMMIT_REPORT_SECS 10 // Interval of the file server's group commit summary
+#define PFS_RECLAIM_RATE (256 << 20) // Deleted files are reclaimed at most 256 MiB/s
+#define PFS_RECLAIM_STEP (16 << 20) // Bytes freed per hole punch while reclaiming
+#define PFS_TOKEN_SHARDS 0 // Metadata server token shards; 0 means one per core
+#define PFS_METADATA_STRIPES 64 // Lock stripes of the metadata server's file table
+#define PFS_METADATA_SNAPSHOT_BYTES (64 << 20) // Snapshot the namespace once the metadata WAL passes 64 MiB
+#define PFS_METADATA_SNAPSHOT_SECS 300 // ... or every 5 minutes if the WAL is not empty
+#define PFS_REVOKE_TIMEOUT_MS 2000 // Clients that do not acknowledge a revocation in time lose all their tokens
+#define PFS_RECENT_REVOKES 64 // Acknowledged revocations a client remembers to detect grants that raced with them
+#define PFS_STATS_PUBLISH_MS 1000 // Token shards publish table sizes, rates and hot files this often
+#define PFS_STATS_HOT_FILES 10 // Busiest files reported by GetStats
+#define PFS_STATS_BUCKETS 24 // Power-of-two latency buckets; the last one holds everything from ~4 s up
+#define PFS_LEASE_MS 10000 // Clients not heard from for this long lose their session and all their tokens
+#define PFS_META_VNODES 64 // Points per metadata shard on the consistent-hash ring
+#define PFS_HANDLE_SHARD_BITS 16 // High bits of a file handle naming the metadata shard that created it
+#define PFS_HANDOFF_BATCH 256 // Files per ImportFiles call when moving files to the shard that owns them
+#define PFS_HANDOFF_RETRY_MS 1000 // Wait before retrying a hand-off to an unreachable shard
+#define PFS_READDIR_PAGE 1024 // Entries per ReadDirPlus message
+#define PFS_METADATA_BATCH 4096 // Entries per batched create, stat or delete RPC
+#define PFS_LOAD_POLL_MS 1000 // The metadata server polls file server load this often for placement
+#define PFS_PLACEMENT_MIN_FREE (1LL << 30) // New files avoid file servers with less free space than this
+#define PFS_FD_SHARDS 64 // Lock shards of the client's open file table
+#define PFS_LIST_IO_BATCH 16384 // Pieces per ReadList or WriteList request of a list I/O call
+#define PFS_LIST_IO_TOKENS 64 // Token ranges a list I/O call asks for before it takes one covering range
+#define PFS_COLLECTIVE_BUFFER (4 << 20) // File domain blocks of collective I/O are this large, rounded to whole stripe units
+#define PFS_COLLECTIVE_TIMEOUT_MS 60000 // Collective calls fail if a member is missing for this long
+#define PFS_COLLECTIVE_POLL_MS 20 // Members joining a collective group poll for the others this often
@@ -0,0 +1,280 @@
+#include "pfs_chunk_store.hpp"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+void ExtentMap::add(int64_t start, int64_t end) {
+    if (start >= end) {
+        return;
+    }
+
+    // Absorb every extent that overlaps or touches [start, end)
+    auto it = extents.upper_bound(start);
+    if (it != extents.begin() && std::prev(it)->second >= start) {
+        --it;
+    }
+    while (it != extents.end() && it->first <= end) {
+        start = std::min(start, it->first);
+        end = std::max(end, it->second);
+        it = extents.erase(it);
+    }
+    extents.emplace(start, end);
+}
+
+ChunkStore::Mapping::~Mapping() {
+    if (addr) {
+        ::munmap(const_cast<char*>(addr), length);
+    }
+}
+
+ChunkStore::ChunkStore(const std::string& root, bool mmap_reads)
+    : root(root), mmap_reads(mmap_reads), reclaimer(root + "/.pfs_trash") {}
+
+std::string ChunkStore::path(FileHandle handle) const {
+    char name[17];
+    std::snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(handle));
+    return root + "/" + name;
+}
+
+std::shared_ptr<ChunkStore::StoredFile> ChunkStore::lookup(FileHandle handle, bool create) {
+    std::lock_guard<std::mutex> lock(files_mutex);
+    auto it = files.find(handle);
+    if (it != files.end()) {
+        return it->second;
+    }
+    struct stat st;
+    if (!create && ::stat(path(handle).c_str(), &st) != 0) {
+        return nullptr;
+    }
+    return files[handle] = std::make_shared<StoredFile>();
+}
+
+// Files written before this server started have no extent map yet; treat
+// their whole current length as written.
+void ChunkStore::load_extents(FileHandle handle, StoredFile& file) {
+    if (file.loaded) {
+        return;
+    }
+    struct stat st;
+    if (::stat(path(handle).c_str(), &st) == 0 && st.st_size > 0) {
+        file.extents.add(0, st.st_size);
+    }
+    file.loaded = true;
+}
+
+bool ChunkStore::write(FileHandle handle, int64_t local_offset,
+                       const char* data, size_t len, std::string& error) {
+    auto file = lookup(handle, true);
+    int fd;
+    {
+        // Opened under the lock, so remove() either sees the file and moves
+        // it to the trash, or this write fails; it is never created again
+        std::lock_guard<std::mutex> lock(file->mutex);
+        if (file->removed) {
+            error = "File was deleted";
+            return false;
+        }
+        load_extents(handle, *file);
+        fd = ::open(path(handle).c_str(), O_RDWR | O_CREAT, 0644);
+    }
+    if (fd < 0) {
+        error = "Failed to create file: " + std::string(std::strerror(errno));
+        return false;
+    }
+    size_t done = 0;
+    while (done < len) {
+        ssize_t put = ::pwrite(fd, data + done, len - done, local_offset + done);
+        if (put <= 0) {
+            ::close(fd);
+            error = "Failed to write data: " + std::string(std::strerror(errno));
+            return false;
+        }
+        done += put;
+    }
+    ::close(fd);
+
+    // Publish the extent only once the data is on the file
+    std::lock_guard<std::mutex> lock(file->mutex);
+    file->extents.add(local_offset, local_offset + len);
+    return true;
+}
+
+bool ChunkStore::read(FileHandle handle, int64_t local_offset,
+                      char* buf, size_t len, std::string& error) {
+    auto file = lookup(handle, false);
+    if (!file) {
+        std::memset(buf, 0, len);  // Nothing stored here yet
+        return true;
+    }
+
+    std::vector<std::pair<int64_t, int64_t>> written;
+    std::shared_ptr<Mapping> mapping;
+    {
+        std::lock_guard<std::mutex> lock(file->mutex);
+        if (file->removed) {
+            error = "File was deleted";
+            return false;
+        }
+        load_extents(handle, *file);
+        file->extents.walk(local_offset, local_offset + len,
+            [&](int64_t start, int64_t end, bool is_written) {
+                if (is_written) {
+                    written.emplace_back(start, end);
+                } else {
+                    std::memset(buf + (start - local_offset), 0, end - start);
+                }
+            });
+        if (!written.empty() && mmap_reads) {
+            mapping = map_locked(handle, *file, written.back().second, error);
+            if (!mapping) {
+                return false;
+            }
+            advise_locked(*file, local_offset, len);
+        }
+    }
+    if (written.empty()) {
+        return true;
+    }
+
+    // Copy straight out of the mapping; it stays mapped until we drop it
+    if (mapping) {
+        for (const auto& [start, end] : written) {
+            char* dst = buf + (start - local_offset);
+            int64_t mapped_end = std::max(start, std::min(end, mapping->length));
+            if (mapped_end > start) {
+                std::memcpy(dst, mapping->addr + start, mapped_end - start);
+            }
+            std::memset(dst + (mapped_end - start), 0, end - mapped_end);
+        }
+        return true;
+    }
+
+    int fd = ::open(path(handle).c_str(), O_RDONLY);
+    if (fd < 0) {
+        error = "Failed to open file for reading: " + std::string(std::strerror(errno));
+        return false;
+    }
+    for (const auto& [start, end] : written) {
+        char* dst = buf + (start - local_offset);
+        int64_t done = 0;
+        while (done < end - start) {
+            ssize_t got = ::pread(fd, dst + done, end - start - done, start + done);
+            if (got < 0) {
+                ::close(fd);
+                error = "Failed to read data: " + std::string(std::strerror(errno));
+                return false;
+            }
+            if (got == 0) {
+                std::memset(dst + done, 0, end - start - done);
+                break;
+            }
+            done += got;
+        }
+    }
+    ::close(fd);
+    return true;
+}
+
+// Return a mapping that covers [0, end) of the file, remapping it if the
+// file has grown since it was last mapped. Readers of the old mapping keep
+// it alive until they are done.
+std::shared_ptr<ChunkStore::Mapping> ChunkStore::map_locked(FileHandle handle, StoredFile& file,
+                                                            int64_t end, std::string& error) {
+    if (file.mapping && file.mapping->length >= end) {
+        return file.mapping;
+    }
+
+    int fd = ::open(path(handle).c_str(), O_RDONLY);
+    if (fd < 0) {
+        error = "Failed to open file for mapping: " + std::string(std::strerror(errno));
+        return nullptr;
+    }
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+        error = "Failed to stat file for mapping: " + std::string(std::strerror(errno));
+        ::close(fd);
+        return nullptr;
+    }
+    void* addr = nullptr;
+    if (st.st_size > 0) {
+        addr = ::mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (addr == MAP_FAILED) {
+            error = "Failed to map file: " + std::string(std::strerror(errno));
+            ::close(fd);
+            return nullptr;
+        }
+    }
+    ::close(fd);
+
+    file.mapping = std::make_shared<Mapping>(static_cast<const char*>(addr), st.st_size);
+    file.last_read_end = -1;
+    file.sequential_reads = 0;
+    return file.mapping;
+}
+
+// Readers that keep picking up where they left off get read-ahead; anything
+// else is treated as random so the kernel does not fault in pages nobody wants.
+void ChunkStore::advise_locked(StoredFile& file, int64_t local_offset, size_t len) {
+    Mapping& mapping = *file.mapping;
+    if (!mapping.addr) {
+        return;
+    }
+
+    file.sequential_reads = local_offset == file.last_read_end ? file.sequential_reads + 1 : 0;
+    file.last_read_end = local_offset + len;
+
+    int advice = file.sequential_reads >= 2 ? MADV_SEQUENTIAL : MADV_RANDOM;
+    if (advice != mapping.advice) {
+        ::madvise(const_cast<char*>(mapping.addr), mapping.length, advice);
+        mapping.advice = advice;
+    }
+
+    // Prefetch the next few requests of a sequential reader
+    if (advice == MADV_SEQUENTIAL && file.last_read_end < mapping.length) {
+        static const int64_t page = ::sysconf(_SC_PAGESIZE);
+        int64_t start = file.last_read_end / page * page;
+        int64_t end = std::min<int64_t>(mapping.length, file.last_read_end + 4 * static_cast<int64_t>(len));
+        ::madvise(const_cast<char*>(mapping.addr) + start, end - start, MADV_WILLNEED);
+    }
+}
+
+bool ChunkStore::sync(FileHandle handle, std::string& error) {
+    int fd = ::open(path(handle).c_str(), O_RDONLY);
+    if (fd < 0) {
+        if (errno == ENOENT) {
+            return true;  // Nothing stored here yet
+        }
+        error = "Failed to open file for sync: " + std::string(std::strerror(errno));
+        return false;
+    }
+    bool ok = ::fdatasync(fd) == 0;
+    if (!ok) {
+        error = "Failed to sync file: " + std::string(std::strerror(errno));
+    }
+    ::close(fd);
+    return ok;
+}
+
+bool ChunkStore::remove(FileHandle handle, std::string& error) {
+    std::shared_ptr<StoredFile> file;
+    {
+        std::lock_guard<std::mutex> lock(files_mutex);
+        auto it = files.find(handle);
+        if (it != files.end()) {
+            file = std::move(it->second);
+            files.erase(it);
+        }
+    }
+    // Reads and writes that looked the file up before us fail from now on
+    if (file) {
+        std::lock_guard<std::mutex> lock(file->mutex);
+        file->removed = true;
+    }
+    return reclaimer.discard(path(handle), error);
+}
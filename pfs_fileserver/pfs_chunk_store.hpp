@@ -0,0 +1,115 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "pfs_common/pfs_common.hpp"
+#include "pfs_storage.hpp"
+#include "pfs_reclaimer.hpp"
+
+// Extent map of a stored file: start -> end (exclusive) of every local byte
+// range that has been written. Ranges are kept disjoint and coalesced.
+class ExtentMap {
+public:
+    void add(int64_t start, int64_t end);
+    void clear() { extents.clear(); }
+    int64_t size() const { return extents.empty() ? 0 : extents.rbegin()->second; }
+
+    // Call fn(start, end, written) for consecutive pieces covering [start, end)
+    template <typename Fn>
+    void walk(int64_t start, int64_t end, Fn fn) const;
+
+private:
+    std::map<int64_t, int64_t> extents;
+};
+
+// Per-server storage for the stripe units of each file. A file's units are
+// packed back to back in ./pfs_storage/<handle in hex>, so a file striped over N
+// servers takes ~1/N of its logical size on each server with no holes.
+// Regions that were never written are served as zeros without touching disk.
+// Removed files go to <root>/.pfs_trash and are freed in the background.
+//
+// With mmap_reads set, reads are served from a shared read-only mapping of
+// each file instead of open() + pread(). Mappings are reference counted: a
+// read keeps the mapping it copies from alive, so remapping a grown file or
+// removing it never unmaps memory under a reader. The access pattern of each
+// file picks the madvise() hint (sequential with read-ahead, or random).
+class ChunkStore : public StorageBackend {
+public:
+    ChunkStore(const std::string& root, bool mmap_reads);
+
+    bool write(FileHandle handle, int64_t local_offset,
+               const char* data, size_t len, std::string& error) override;
+    bool read(FileHandle handle, int64_t local_offset,
+              char* buf, size_t len, std::string& error) override;
+    bool sync(FileHandle handle, std::string& error) override;
+    bool remove(FileHandle handle, std::string& error) override;
+
+    std::string path(FileHandle handle) const;
+
+private:
+    // A read-only view of the first length bytes of a file
+    struct Mapping {
+        const char* addr;
+        int64_t length;
+        int advice = -1;  // Last madvise() hint applied
+
+        Mapping(const char* addr, int64_t length) : addr(addr), length(length) {}
+        ~Mapping();
+    };
+
+    struct StoredFile {
+        std::mutex mutex;
+        ExtentMap extents;
+        bool loaded = false;  // Extents initialized from the file on disk
+        bool removed = false;  // Deleted; reads and writes that still hold it fail
+        std::shared_ptr<Mapping> mapping;
+        int64_t last_read_end = -1;  // Detects sequential readers
+        int sequential_reads = 0;
+    };
+
+    // The file's entry; null if it is not known and, unless create is set,
+    // not on disk either
+    std::shared_ptr<StoredFile> lookup(FileHandle handle, bool create);
+    void load_extents(FileHandle handle, StoredFile& file);
+    std::shared_ptr<Mapping> map_locked(FileHandle handle, StoredFile& file,
+                                        int64_t end, std::string& error);
+    void advise_locked(StoredFile& file, int64_t local_offset, size_t len);
+
+    std::string root;
+    bool mmap_reads;
+    std::mutex files_mutex;
+    std::unordered_map<FileHandle, std::shared_ptr<StoredFile>> files;
+    TrashReclaimer reclaimer;
+};
+
+template <typename Fn>
+void ExtentMap::walk(int64_t start, int64_t end, Fn fn) const {
+    auto it = extents.upper_bound(start);
+    if (it != extents.begin()) {
+        auto prev = std::prev(it);
+        if (prev->second > start) {
+            it = prev;
+        }
+    }
+
+    int64_t cursor = start;
+    for (; it != extents.end() && it->first < end; ++it) {
+        int64_t written_start = std::max(it->first, cursor);
+        int64_t written_end = std::min(it->second, end);
+        if (written_start > cursor) {
+            fn(cursor, written_start, false);
+        }
+        fn(written_start, written_end, true);
+        cursor = written_end;
+    }
+    if (cursor < end) {
+        fn(cursor, end, false);
+    }
+}
@@ -1,10 +1,16 @@
 #include <filesystem>
+#include <algorithm>
 #include <unordered_map>
 #include <mutex>
 #include <condition_variable>
 #include <thread>
 #include <iostream>
+#include <atomic>
+#include <vector>
 #include "pfs_fileserver.hpp"
+#include "pfs_chunk_store.hpp"
+#include "pfs_log_store.hpp"
+#include "pfs_group_commit.hpp"
 #include "pfs_proto/pfs_fileserver.pb.h"
 #include "pfs_proto/pfs_fileserver.grpc.pb.h"
 #include <grpcpp/grpcpp.h>
@@ -13,7 +19,7 @@ namespace fs = std::filesystem;
 
 class FileServerServiceImpl final : public pfsfile::FileServer::Service {
 public:
-    FileServerServiceImpl() {
+    FileServerServiceImpl(bool log_structured, bool mmap_reads) {
         std::cout << "[INFO] FileServerServiceImpl initialized." << std::endl;
 
         // Ensure the storage directory exists
@@ -21,6 +27,17 @@ public:
             std::cout << "[INFO] Creating storage directory: ./pfs_storage" << std::endl;
             fs::create_directory("./pfs_storage");
         }
+
+        if (log_structured) {
+            std::cout << "[INFO] Using log-structured storage in ./pfs_storage/log" << std::endl;
+            store = std::make_unique<LogStore>("./pfs_storage");
+        } else {
+            if (mmap_reads) {
+                std::cout << "[INFO] Serving reads from memory-mapped storage files" << std::endl;
+            }
+            store = std::make_unique<ChunkStore>("./pfs_storage", mmap_reads);
+        }
+        committer = std::make_unique<GroupCommitter>(*store);
     }
 
     virtual ~FileServerServiceImpl() {
@@ -37,30 +54,45 @@ public:
         return grpc::Status::OK;
     }
 
+    // What the metadata server needs to place new files: free space and the
+    // number of data requests being served
+    grpc::Status GetLoad(grpc::ServerContext* context,
+                         const pfsfile::LoadRequest* request,
+                         pfsfile::LoadResponse* response) override {
+        std::error_code error;
+        fs::space_info space = fs::space("./pfs_storage", error);
+        if (!error) {
+            response->set_free_bytes(space.available);
+            response->set_total_bytes(space.capacity);
+        }
+        response->set_queue_depth(in_flight.load(std::memory_order_relaxed));
+        return grpc::Status::OK;
+    }
+
     grpc::Status StreamData(
         grpc::ServerContext* context,
         grpc::ServerReaderWriter<pfsfile::StreamResponse, pfsfile::StreamRequest>* stream) override {
         
         pfsfile::StreamRequest request;
         while (stream->Read(&request)) {
-            std::string client_id = request.client_id();
-            std::string operation = request.operation();
-            std::string filename = "./pfs_storage/" + request.filename();
+            int client_id = request.client_id();
+            pfsfile::StreamOp operation = request.operation();
+            FileHandle handle = request.handle();
             int64_t offset = request.offset();
             const std::string& data = request.data();
             int64_t size = request.size();
 
             pfsfile::StreamResponse response;
             response.set_client_id(client_id);
-            response.set_filename(request.filename());
+            response.set_handle(handle);
 
-            if (operation == "READ") {
-                handle_read(filename, offset, size, response);
-            } else if (operation == "WRITE") {
-                handle_write(filename, offset, data, response);
+            if (operation == pfsfile::STREAM_OP_READ) {
+                handle_read(handle, offset, size, response);
+            } else if (operation == pfsfile::STREAM_OP_WRITE) {
+                handle_write(handle, offset, data, response);
             } else {
                 response.set_success(false);
-                response.set_error_message("Invalid operation: " + operation);
+                response.set_error_message("Invalid operation: " + std::to_string(operation));
             }
 
             stream->Write(response);
@@ -71,56 +103,41 @@ public:
     grpc::Status WriteFile(grpc::ServerContext* context,
                                               const pfsfile::WriteFileRequest* request,
                                               pfsfile::WriteFileResponse* response) {
-    std::lock_guard<std::mutex> lock(file_mutex);
-
-    const std::string& filename = "./pfs_storage/" + request->filename();
-    int64_t offset = request->offset();
+    InFlight busy(in_flight);
     const std::string& data = request->data();
-
-
-    if (!fs::exists("./pfs_storage")) {
-        fs::create_directory("./pfs_storage");
+    int64_t local_offset;
+    if (!map_to_local(*request, data.size(), &local_offset)) {
+        response->set_success(false);
+        response->set_error_message("Request crosses a stripe unit boundary");
+        return grpc::Status::OK;
     }
 
-    std::fstream file(filename, std::ios::in | std::ios::out | std::ios::binary);
-    if (!file.is_open()) {
-
-        file.open(filename, std::ios::out | std::ios::binary | std::ios_base::trunc);
-        file.close();
-
-
-        file.open(filename, std::ios::in | std::ios::out | std::ios::binary);
-        if (!file.is_open()) {
-            response->set_success(false);
-            response->set_error_message("Failed to create file");
-            return grpc::Status::OK;
-        }
+    std::string error;
+    if (!store->write(request->handle(), local_offset, data.data(), data.size(), error)) {
+        response->set_success(false);
+        response->set_error_message(error);
+        return grpc::Status::OK;
     }
 
-
-    file.seekp(0, std::ios::end);
-    int64_t file_size = file.tellp();
-    if (offset + static_cast<int64_t>(data.size()) > file_size) {
-        file.close();
-        std::ofstream resize_file(filename, std::ios::binary | std::ios_base::app);
-        resize_file.seekp(offset + static_cast<int64_t>(data.size()) - 1);
-        resize_file.put('\0');
-        resize_file.close();
-        file.open(filename, std::ios::in | std::ios::out | std::ios::binary);
+    if (request->sync()) {
+        sync_into(request->handle(), response);
+        return grpc::Status::OK;
     }
+    response->set_success(true);
+    return grpc::Status::OK;
+}
 
-    // Write the data
-    file.seekp(offset, std::ios::beg);
-    file.write(data.c_str(), data.size());
-    if (!file.good()) {
-        file.close();
+// Flush the file through the group committer
+grpc::Status SyncFile(grpc::ServerContext* context,
+                      const pfsfile::SyncFileRequest* request,
+                      pfsfile::SyncFileResponse* response) override {
+    InFlight busy(in_flight);
+    if (request->handle() == 0) {
         response->set_success(false);
-        response->set_error_message("Failed to write data");
+        response->set_error_message("Missing file handle");
         return grpc::Status::OK;
     }
-
-    file.close();
-    response->set_success(true);
+    sync_into(request->handle(), response);
     return grpc::Status::OK;
 }
 
@@ -129,173 +146,340 @@ grpc::Status ReadFile(
     grpc::ServerContext* context,
     const pfsfile::ReadFileRequest* request,
     pfsfile::ReadFileResponse* response) {
-    std::lock_guard<std::mutex> lock(file_mutex);
-
-    std::string filename = "./pfs_storage/" + request->filename();
-    int64_t offset = request->offset();
+    InFlight busy(in_flight);
     int64_t size = request->size();
-
-    // Check if the file exists
-    if (!fs::exists(filename)) {
+    int64_t local_offset;
+    if (size < 0 || !map_to_local(*request, size, &local_offset)) {
         response->set_success(false);
-        response->set_error_message("File not found");
+        response->set_error_message("Request crosses a stripe unit boundary");
         return grpc::Status::OK;
     }
 
-    // Open the file in binary mode for reading
-    std::ifstream file(filename, std::ios::binary);
-    if (!file.is_open()) {
+    // Unwritten ranges come back as zeros straight from the extent map
+    std::string* data = response->mutable_data();
+    data->resize(size);
+    std::string error;
+    if (!store->read(request->handle(), local_offset, &(*data)[0], size, error)) {
+        data->clear();
         response->set_success(false);
-        response->set_error_message("Failed to open file for reading");
+        response->set_error_message(error);
         return grpc::Status::OK;
     }
 
-    // Seek to the offset
-    file.seekg(offset, std::ios::beg);
-    if (!file.good()) {
+    response->set_success(true);
+    return grpc::Status::OK;
+}
+
+grpc::Status ReadStream(
+    grpc::ServerContext* context,
+    const pfsfile::StripedExtent* request,
+    grpc::ServerWriter<pfsfile::DataChunk>* writer) override {
+    InFlight busy(in_flight);
+    if (!valid_extent(*request)) {
+        return grpc::Status(grpc::StatusCode::INVALID_ARGUMENT, "Invalid striped extent");
+    }
+
+    // This server's units of the extent are one contiguous local range
+    int64_t local_begin, local_end;
+    stripeLocalRange(request->offset(), request->size(), request->stripe_unit(),
+                     request->server_index(), request->stripe_width(), &local_begin, &local_end);
+
+    // Only one chunk is buffered at a time; Write() blocks while the client's
+    // flow-control window is full, so memory stays bounded for any extent size.
+    pfsfile::DataChunk chunk;
+    for (int64_t cursor = local_begin; cursor < local_end;) {
+        int64_t n = std::min<int64_t>(local_end - cursor, PFS_STREAM_CHUNK_SIZE);
+        std::string* data = chunk.mutable_data();
+        data->resize(n);
+
+        std::string error;
+        if (!store->read(request->handle(), cursor, &(*data)[0], n, error)) {
+            return grpc::Status(grpc::StatusCode::INTERNAL, error);
+        }
+        if (!writer->Write(chunk)) {
+            return grpc::Status(grpc::StatusCode::CANCELLED, "Client closed the read stream");
+        }
+        cursor += n;
+    }
+    return grpc::Status::OK;
+}
+
+grpc::Status WriteStream(
+    grpc::ServerContext* context,
+    grpc::ServerReader<pfsfile::WriteChunk>* reader,
+    pfsfile::WriteFileResponse* response) override {
+    InFlight busy(in_flight);
+    pfsfile::WriteChunk chunk;
+    if (!reader->Read(&chunk) || !chunk.has_extent() || !valid_extent(chunk.extent())) {
         response->set_success(false);
-        response->set_error_message("Invalid offset");
-        file.close();
+        response->set_error_message("Missing or invalid stream header");
         return grpc::Status::OK;
     }
+    const pfsfile::StripedExtent extent = chunk.extent();
+    const bool sync = chunk.sync();
+
+    int64_t local_begin, local_end;
+    stripeLocalRange(extent.offset(), extent.size(), extent.stripe_unit(),
+                     extent.server_index(), extent.stripe_width(), &local_begin, &local_end);
+
+    // Chunks carry this server's units in order, so they land back to back
+    int64_t cursor = local_begin;
+    std::string error;
+    do {
+        const std::string& data = chunk.data();
+        if (cursor + static_cast<int64_t>(data.size()) > local_end) {
+            error = "Stream carries more data than the extent";
+            break;
+        }
+        if (!data.empty() && !store->write(extent.handle(), cursor, data.data(), data.size(), error)) {
+            break;
+        }
+        cursor += data.size();
+    } while (reader->Read(&chunk));
 
-    // Read the requested data
-    std::vector<char> buffer(size);
-    file.read(buffer.data(), size);
-    std::streamsize bytes_read = file.gcount();
-    file.close();
+    if (error.empty() && cursor != local_end) {
+        error = "Stream ended before the extent was complete";
+    }
+    if (error.empty() && sync) {
+        sync_into(extent.handle(), response);
+        return grpc::Status::OK;
+    }
+    response->set_success(error.empty());
+    response->set_error_message(error);
+    return grpc::Status::OK;
+}
 
-    if (bytes_read > 0) {
-        response->set_success(true);
-        response->set_data(buffer.data(), bytes_read);
-    } else {
+grpc::Status ReadList(
+    grpc::ServerContext* context,
+    const pfsfile::ExtentList* request,
+    grpc::ServerWriter<pfsfile::DataChunk>* writer) override {
+    InFlight busy(in_flight);
+    std::vector<std::pair<int64_t, int64_t>> ranges;
+    if (!local_ranges(*request, &ranges)) {
+        return grpc::Status(grpc::StatusCode::INVALID_ARGUMENT, "Invalid extent list");
+    }
+
+    // Small pieces share chunks, so a strided read costs few messages
+    pfsfile::DataChunk chunk;
+    std::string* data = chunk.mutable_data();
+    for (const auto& [local_begin, local_end] : ranges) {
+        for (int64_t cursor = local_begin; cursor < local_end;) {
+            size_t used = data->size();
+            int64_t n = std::min<int64_t>(local_end - cursor, PFS_STREAM_CHUNK_SIZE - used);
+            data->resize(used + n);
+
+            std::string error;
+            if (!store->read(request->handle(), cursor, &(*data)[used], n, error)) {
+                return grpc::Status(grpc::StatusCode::INTERNAL, error);
+            }
+            cursor += n;
+            if (data->size() == PFS_STREAM_CHUNK_SIZE) {
+                if (!writer->Write(chunk)) {
+                    return grpc::Status(grpc::StatusCode::CANCELLED, "Client closed the read stream");
+                }
+                data->clear();
+            }
+        }
+    }
+    if (!data->empty() && !writer->Write(chunk)) {
+        return grpc::Status(grpc::StatusCode::CANCELLED, "Client closed the read stream");
+    }
+    return grpc::Status::OK;
+}
+
+grpc::Status WriteList(
+    grpc::ServerContext* context,
+    grpc::ServerReader<pfsfile::ListChunk>* reader,
+    pfsfile::WriteFileResponse* response) override {
+    InFlight busy(in_flight);
+    pfsfile::ListChunk chunk;
+    std::vector<std::pair<int64_t, int64_t>> ranges;
+    if (!reader->Read(&chunk) || !chunk.has_extents() || !local_ranges(chunk.extents(), &ranges)) {
         response->set_success(false);
-        response->set_error_message("End of file or no data read");
+        response->set_error_message("Missing or invalid stream header");
+        return grpc::Status::OK;
+    }
+    const FileHandle handle = chunk.extents().handle();
+    const bool sync = chunk.sync();
+
+    // The data is this server's units of every extent, back to back
+    size_t range = 0;
+    int64_t cursor = ranges.empty() ? 0 : ranges[0].first;
+    std::string error;
+    do {
+        const std::string& data = chunk.data();
+        for (size_t used = 0; used < data.size();) {
+            if (range == ranges.size()) {
+                error = "Stream carries more data than the extents";
+                break;
+            }
+            int64_t n = std::min<int64_t>(ranges[range].second - cursor, data.size() - used);
+            if (!store->write(handle, cursor, data.data() + used, n, error)) {
+                break;
+            }
+            used += n;
+            cursor += n;
+            if (cursor == ranges[range].second && ++range < ranges.size()) {
+                cursor = ranges[range].first;
+            }
+        }
+        if (!error.empty()) {
+            break;
+        }
+    } while (reader->Read(&chunk));
+
+    if (error.empty() && range != ranges.size()) {
+        error = "Stream ended before the extents were complete";
+    }
+    if (error.empty() && sync) {
+        sync_into(handle, response);
+        return grpc::Status::OK;
     }
+    response->set_success(error.empty());
+    response->set_error_message(error);
     return grpc::Status::OK;
 }
 
 
 
 private:
-    std::mutex file_mutex; // Mutex to protect file access
+    // Counts a data request from arrival until its handler returns
+    struct InFlight {
+        std::atomic<int>& count;
+        explicit InFlight(std::atomic<int>& count) : count(count) { count.fetch_add(1, std::memory_order_relaxed); }
+        ~InFlight() { count.fetch_sub(1, std::memory_order_relaxed); }
+    };
+
+    std::atomic<int> in_flight{0};
+    std::unique_ptr<StorageBackend> store;
+    std::unique_ptr<GroupCommitter> committer;  // Declared after store so it stops first
+
+    template <typename Response>
+    void sync_into(FileHandle handle, Response* response) {
+        SyncResult result = committer->sync(handle);
+        response->set_success(result.success);
+        response->set_error_message(result.error);
+        response->set_batch_size(result.batch_size);
+        response->set_flush_latency_us(result.flush_latency_us);
+    }
 
-    void handle_read(const std::string& filename, int64_t offset, int64_t size, pfsfile::StreamResponse& response) {
-        std::lock_guard<std::mutex> lock(file_mutex);
+    static bool valid_extent(const pfsfile::StripedExtent& extent) {
+        return extent.handle() != 0 && extent.offset() >= 0 && extent.size() >= 0 &&
+               extent.stripe_unit() > 0 && extent.stripe_width() > 0 &&
+               extent.server_index() >= 0 && extent.server_index() < extent.stripe_width();
+    }
 
-        // Check if the file exists
-        if (!fs::exists(filename)) {
-            response.set_success(false);
-            response.set_error_message("File not found");
-            return;
+    // This server's local range of each extent, in order, with ranges that
+    // meet joined. Empty ranges are left out.
+    static bool local_ranges(const pfsfile::ExtentList& list, std::vector<std::pair<int64_t, int64_t>>* ranges) {
+        if (list.handle() == 0 || list.stripe_unit() <= 0 || list.stripe_width() <= 0 ||
+            list.server_index() < 0 || list.server_index() >= list.stripe_width() ||
+            list.offsets_size() != list.sizes_size()) {
+            return false;
         }
-
-
-        std::ifstream file(filename, std::ios::binary);
-        if (!file.is_open()) {
-            response.set_success(false);
-            response.set_error_message("Failed to open file for reading");
-            return;
+        for (int i = 0; i < list.offsets_size(); ++i) {
+            if (list.offsets(i) < 0 || list.sizes(i) < 0) {
+                return false;
+            }
+            int64_t local_begin, local_end;
+            stripeLocalRange(list.offsets(i), list.sizes(i), list.stripe_unit(),
+                             list.server_index(), list.stripe_width(), &local_begin, &local_end);
+            if (local_begin == local_end) {
+                continue;
+            }
+            if (!ranges->empty() && ranges->back().second == local_begin) {
+                ranges->back().second = local_end;
+            } else {
+                ranges->emplace_back(local_begin, local_end);
+            }
         }
+        return true;
+    }
 
+    // Map a unary request's logical offset into the compact local file. A
+    // request must stay inside one stripe unit; requests without a layout
+    // address the local file directly.
+    template <typename Request>
+    static bool map_to_local(const Request& request, int64_t size, int64_t* local_offset) {
+        int64_t stripe_unit = request.stripe_unit();
+        int stripe_width = request.stripe_width();
+        if (stripe_unit <= 0 || stripe_width <= 0) {
+            *local_offset = request.offset();
+            return request.offset() >= 0;
+        }
+        if (request.offset() < 0 ||
+            (size > 0 && request.offset() / stripe_unit != (request.offset() + size - 1) / stripe_unit)) {
+            return false;
+        }
+        *local_offset = stripeLocalOffset(request.offset(), stripe_unit, stripe_width);
+        return true;
+    }
 
-        file.seekg(offset, std::ios::beg);
-        if (!file.good()) {
+    void handle_read(FileHandle handle, int64_t offset, int64_t size, pfsfile::StreamResponse& response) {
+        if (offset < 0 || size < 0) {
             response.set_success(false);
             response.set_error_message("Invalid offset");
-            file.close();
             return;
         }
 
-
-        std::vector<char> buffer(size);
-        file.read(buffer.data(), size);
-        std::streamsize bytes_read = file.gcount();
-        file.close();
-
-        if (bytes_read > 0) {
-            response.set_success(true);
-            response.set_data(buffer.data(), bytes_read);
-        } else {
-            response.set_success(false);
-            response.set_error_message("End of file or no data read");
-        }
-    }
-
-    void handle_write(const std::string& filename, int64_t offset, 
-                                         const std::string& data, pfsfile::StreamResponse& response) {
-    std::lock_guard<std::mutex> lock(file_mutex);
-
-
-    if (!fs::exists("./pfs_storage")) {
-        fs::create_directory("./pfs_storage");
-    }
-
-    // Open file for reading and writing
-    std::fstream file(filename, std::ios::in | std::ios::out | std::ios::binary);
-    if (!file.is_open()) {
-
-        file.open(filename, std::ios::out | std::ios::binary | std::ios_base::trunc);
-        file.close();
-
-        // Reopen in read/write mode
-        file.open(filename, std::ios::in | std::ios::out | std::ios::binary);
-        if (!file.is_open()) {
+        std::string* data = response.mutable_data();
+        data->resize(size);
+        std::string error;
+        if (!store->read(handle, offset, &(*data)[0], size, error)) {
+            data->clear();
             response.set_success(false);
-            response.set_error_message("Failed to create file");
+            response.set_error_message(error);
             return;
         }
+        response.set_success(true);
     }
 
-    // Resize the file if needed
-    file.seekp(0, std::ios::end);
-    int64_t file_size = file.tellp();
-    if (offset + static_cast<int64_t>(data.size()) > file_size) {
-        file.close();
-        std::ofstream resize_file(filename, std::ios::binary | std::ios_base::app);
-        resize_file.seekp(offset + static_cast<int64_t>(data.size()) - 1);
-        resize_file.put('\0');
-        resize_file.close();
-        file.open(filename, std::ios::in | std::ios::out | std::ios::binary);
-    }
-
-    // Write the data
-    file.seekp(offset, std::ios::beg);
-    file.write(data.c_str(), data.size());
-    if (!file.good()) {
-        file.close();
+    void handle_write(FileHandle handle, int64_t offset, 
+                                         const std::string& data, pfsfile::StreamResponse& response) {
+    std::string error;
+    if (offset < 0 || !store->write(handle, offset, data.data(), data.size(), error)) {
         response.set_success(false);
-        response.set_error_message("Failed to write data");
+        response.set_error_message(offset < 0 ? "Invalid offset" : error);
         return;
     }
-
-    file.close();
     response.set_success(true);
 }
 
 grpc::Status DeleteFile(grpc::ServerContext* context,
                         const pfsfile::DeleteFileRequest* request,
                         pfsfile::DeleteFileResponse* response) override {
-    const std::string filename = "./pfs_storage/" + request->filename();
+    FileHandle handle = request->handle();
 
-    // Check if the file exists
-    if (!fs::exists(filename)) {
+    // A small file may have no stripe units on this server; that is not an error
+    std::string error;
+    if (!store->remove(handle, error)) {
         response->set_success(false);
-        response->set_message("File not found.");
+        response->set_message(error);
+        std::cerr << "[ERROR] Failed to delete file " << handle << ": " << error << std::endl;
         return grpc::Status::OK;
     }
 
-    // Attempt to delete the file
-    try {
-        fs::remove(filename);
-        response->set_success(true);
-        std::cout << "[INFO] File '" << filename << "' deleted successfully from storage." << std::endl;
-    } catch (const std::exception& e) {
-        response->set_success(false);
-        response->set_message("Failed to delete file: " + std::string(e.what()));
-        std::cerr << "[ERROR] Failed to delete file '" << filename << "': " << e.what() << std::endl;
-    }
+    response->set_success(true);
+    std::cout << "[INFO] File " << handle << " deleted successfully from storage." << std::endl;
+    return grpc::Status::OK;
+}
 
+// Every file is tried; the response reports the first failure
+grpc::Status DeleteFiles(grpc::ServerContext* context,
+                         const pfsfile::DeleteFilesRequest* request,
+                         pfsfile::DeleteFileResponse* response) override {
+    response->set_success(true);
+    for (FileHandle handle : request->handles()) {
+        std::string error;
+        if (!store->remove(handle, error)) {
+            std::cerr << "[ERROR] Failed to delete file " << handle << ": " << error << std::endl;
+            if (response->success()) {
+                response->set_success(false);
+                response->set_message(error);
+            }
+        }
+    }
+    std::cout << "[INFO] Deleted " << request->handles_size() << " files from storage." << std::endl;
     return grpc::Status::OK;
 }
 
@@ -305,6 +489,27 @@ int main(int argc, char* argv[]) {
     printf("%s:%s: PFS file server start! Hostname: %s, IP: %s\n",
            __FILE__, __func__, getMyHostname().c_str(), getMyIP().c_str());
 
+    // --storage=log appends all writes to segment files instead of updating in place;
+    // --read=mmap serves reads of in-place storage from memory-mapped files
+    bool log_structured = false;
+    bool mmap_reads = false;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg(argv[i]);
+        if (arg == "--storage=log") {
+            log_structured = true;
+        } else if (arg == "--read=mmap") {
+            mmap_reads = true;
+        } else if (arg != "--storage=chunk" && arg != "--read=pread") {
+            fprintf(stderr, "%s: usage: %s [--storage=chunk|--storage=log] [--read=pread|--read=mmap]\n",
+                    __func__, argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (log_structured && mmap_reads) {
+        fprintf(stderr, "%s: --read=mmap requires --storage=chunk\n", __func__);
+        exit(EXIT_FAILURE);
+    }
+
     // Parse pfs_list.txt
     std::ifstream pfs_list("../pfs_list.txt");
     if (!pfs_list.is_open()) {
@@ -333,7 +538,7 @@ int main(int argc, char* argv[]) {
     std::cout << "[INFO] File Server will listen at: " << server_address << std::endl;
 
     // Start the File Server
-    FileServerServiceImpl service;
+    FileServerServiceImpl service(log_structured, mmap_reads);
     grpc::ServerBuilder builder;
     builder.AddListeningPort(server_address, grpc::InsecureServerCredentials());
     builder.RegisterService(&service);
@@ -0,0 +1,96 @@
+#include "pfs_group_commit.hpp"
+
+#include <iostream>
+#include <vector>
+
+#include "pfs_common/pfs_config.hpp"
+
+GroupCommitter::GroupCommitter(StorageBackend& store)
+    : store(store), last_report(std::chrono::steady_clock::now()) {
+    flusher = std::thread(&GroupCommitter::flusher_loop, this);
+}
+
+GroupCommitter::~GroupCommitter() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    pending_cv.notify_all();
+    flusher.join();
+}
+
+SyncResult GroupCommitter::sync(FileHandle handle) {
+    std::unique_lock<std::mutex> lock(mutex);
+    if (!collecting) {
+        collecting = std::make_shared<Batch>();
+    }
+    std::shared_ptr<Batch> batch = collecting;
+    batch->files.insert(handle);
+    batch->waiters++;
+    pending_cv.notify_one();
+
+    done_cv.wait(lock, [&batch]() { return batch->done; });
+
+    SyncResult result{true, "", batch->waiters, batch->flush_latency_us};
+    auto failed = batch->errors.find(handle);
+    if (failed != batch->errors.end()) {
+        result.success = false;
+        result.error = failed->second;
+    }
+    return result;
+}
+
+void GroupCommitter::flusher_loop() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        pending_cv.wait(lock, [this]() { return stopping || collecting; });
+        if (!collecting) {
+            return;
+        }
+
+        // Close the batch; later callers start the next one
+        std::shared_ptr<Batch> batch = std::move(collecting);
+        collecting = nullptr;
+        std::vector<FileHandle> files(batch->files.begin(), batch->files.end());
+        lock.unlock();
+
+        auto start = std::chrono::steady_clock::now();
+        std::unordered_map<FileHandle, std::string> errors;
+        for (FileHandle handle : files) {
+            std::string error;
+            if (!store.sync(handle, error)) {
+                errors[handle] = error;
+            }
+        }
+        int64_t latency_us = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start).count();
+
+        lock.lock();
+        batch->errors = std::move(errors);
+        batch->flush_latency_us = latency_us;
+        batch->done = true;
+        done_cv.notify_all();
+
+        total_batches++;
+        total_syncs += batch->waiters;
+        total_flush_us += latency_us;
+        max_batch = std::max(max_batch, batch->waiters);
+        report_locked();
+    }
+}
+
+void GroupCommitter::report_locked() {
+    auto now = std::chrono::steady_clock::now();
+    if (now - last_report < std::chrono::seconds(PFS_GROUP_COMMIT_REPORT_SECS)) {
+        return;
+    }
+    std::cout << "[INFO] Group commit: " << total_syncs << " syncs in " << total_batches
+              << " flushes (avg batch " << static_cast<double>(total_syncs) / total_batches
+              << ", max batch " << max_batch << ", avg flush "
+              << total_flush_us / total_batches << " us)." << std::endl;
+    total_batches = 0;
+    total_syncs = 0;
+    total_flush_us = 0;
+    max_batch = 0;
+    last_report = now;
+}
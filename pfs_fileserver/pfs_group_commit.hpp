@@ -0,0 +1,63 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "pfs_storage.hpp"
+
+// Result of a group-committed sync
+struct SyncResult {
+    bool success;
+    std::string error;
+    int batch_size;            // Sync calls that shared the flush
+    int64_t flush_latency_us;  // Time the flush itself took
+};
+
+// Batches durability requests from concurrent writers. Callers queue the
+// file they need flushed and block; a single flusher thread takes every
+// request queued so far, flushes each distinct file once and wakes them all.
+// Requests that arrive while a flush is running form the next batch, so N
+// outstanding writers share one flush instead of paying for N.
+class GroupCommitter {
+public:
+    explicit GroupCommitter(StorageBackend& store);
+    ~GroupCommitter();
+
+    SyncResult sync(FileHandle handle);
+
+private:
+    struct Batch {
+        std::unordered_set<FileHandle> files;
+        int waiters = 0;
+        bool done = false;
+        std::unordered_map<FileHandle, std::string> errors;
+        int64_t flush_latency_us = 0;
+    };
+
+    void flusher_loop();
+    void report_locked();
+
+    StorageBackend& store;
+    std::mutex mutex;
+    std::condition_variable pending_cv;
+    std::condition_variable done_cv;
+    std::shared_ptr<Batch> collecting;
+    bool stopping = false;
+
+    // Totals reported to the log every PFS_GROUP_COMMIT_REPORT_SECS
+    uint64_t total_batches = 0;
+    uint64_t total_syncs = 0;
+    uint64_t total_flush_us = 0;
+    int max_batch = 0;
+    std::chrono::steady_clock::time_point last_report;
+
+    std::thread flusher;
+};
@@ -0,0 +1,452 @@
+#include "pfs_log_store.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+LogStore::Segment::~Segment() {
+    if (fd >= 0) {
+        ::close(fd);
+    }
+}
+
+LogStore::LogStore(const std::string& root) : log_dir(root + "/log") {
+    fs::create_directories(log_dir);
+    recover();
+
+    std::string error;
+    std::lock_guard<std::mutex> lock(log_mutex);
+    if (!roll_segment_locked(error)) {
+        std::cerr << "[ERROR] Unable to open a log segment: " << error << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    cleaner = std::thread(&LogStore::compaction_loop, this);
+}
+
+LogStore::~LogStore() {
+    stopping = true;
+    cleaner_cv.notify_all();
+    if (cleaner.joinable()) {
+        cleaner.join();
+    }
+}
+
+bool LogStore::write(FileHandle handle, int64_t local_offset,
+                     const char* data, size_t len, std::string& error) {
+    if (len == 0) {
+        return true;
+    }
+
+    std::lock_guard<std::mutex> lock(log_mutex);
+    uint64_t seq = next_seq++;
+    std::shared_ptr<Segment> segment;
+    int64_t data_position;
+    if (!append_locked(RECORD_DATA, seq, handle, local_offset, data, len, &segment, &data_position, error)) {
+        return false;
+    }
+    index_insert_locked(indexes[handle], local_offset, local_offset + len, segment, data_position, seq);
+    return true;
+}
+
+bool LogStore::read(FileHandle handle, int64_t local_offset,
+                    char* buf, size_t len, std::string& error) {
+    struct Piece {
+        std::shared_ptr<Segment> segment;
+        int64_t position;
+        char* dst;
+        int64_t len;
+    };
+    std::vector<Piece> pieces;
+    int64_t end = local_offset + len;
+
+    // Resolve locations under the lock; the segment references keep their
+    // files readable even if the cleaner retires them before we get to them.
+    {
+        std::lock_guard<std::mutex> lock(log_mutex);
+        std::memset(buf, 0, len);
+        auto found = indexes.find(handle);
+        if (found == indexes.end()) {
+            return true;
+        }
+        const FileIndex& index = found->second;
+        auto it = index.upper_bound(local_offset);
+        if (it != index.begin() && std::prev(it)->second.end > local_offset) {
+            --it;
+        }
+        for (; it != index.end() && it->first < end; ++it) {
+            int64_t start = std::max(it->first, local_offset);
+            int64_t stop = std::min(it->second.end, end);
+            pieces.push_back({it->second.segment, it->second.position + (start - it->first),
+                              buf + (start - local_offset), stop - start});
+        }
+    }
+
+    for (const auto& piece : pieces) {
+        int64_t done = 0;
+        while (done < piece.len) {
+            ssize_t got = ::pread(piece.segment->fd, piece.dst + done, piece.len - done, piece.position + done);
+            if (got <= 0) {
+                error = "Failed to read from log segment " + piece.segment->path;
+                return false;
+            }
+            done += got;
+        }
+    }
+    return true;
+}
+
+bool LogStore::remove(FileHandle handle, std::string& error) {
+    std::lock_guard<std::mutex> lock(log_mutex);
+    if (indexes.find(handle) == indexes.end()) {
+        return true;
+    }
+
+    // The tombstone keeps older records of the file from coming back on restart
+    if (!append_locked(RECORD_DELETE, next_seq++, handle, 0, nullptr, 0, nullptr, nullptr, error)) {
+        return false;
+    }
+    index_drop_locked(handle);
+    return true;
+}
+
+// The log is shared by all files, so syncing one file flushes every segment
+// appended to since the last sync. Concurrent syncs of different files
+// queue behind one flush and then mostly find nothing left to do.
+bool LogStore::sync(FileHandle /*handle*/, std::string& error) {
+    return flush(false, error);
+}
+
+// fdatasync every dirty segment, then the log directory if segments were
+// created since its last sync or always_sync_dir is set
+bool LogStore::flush(bool always_sync_dir, std::string& error) {
+    std::lock_guard<std::mutex> flushing(flush_mutex);
+    std::vector<std::shared_ptr<Segment>> dirty;
+    bool sync_dir;
+    {
+        std::lock_guard<std::mutex> lock(log_mutex);
+        for (const auto& [id, segment] : segments) {
+            if (segment->dirty) {
+                segment->dirty = false;
+                dirty.push_back(segment);
+            }
+        }
+        sync_dir = dir_dirty || always_sync_dir;
+        dir_dirty = false;
+    }
+
+    bool ok = true;
+    for (const auto& segment : dirty) {
+        if (::fdatasync(segment->fd) != 0) {
+            error = "Failed to sync log segment: " + std::string(std::strerror(errno));
+            ok = false;
+            std::lock_guard<std::mutex> lock(log_mutex);
+            segment->dirty = true;
+        }
+    }
+    if (sync_dir && !sync_log_dir(error)) {
+        ok = false;
+        std::lock_guard<std::mutex> lock(log_mutex);
+        dir_dirty = true;
+    }
+    return ok;
+}
+
+bool LogStore::sync_log_dir(std::string& error) {
+    int dir_fd = ::open(log_dir.c_str(), O_RDONLY | O_DIRECTORY);
+    bool ok = dir_fd >= 0 && ::fsync(dir_fd) == 0;
+    if (!ok) {
+        error = "Failed to sync log directory: " + std::string(std::strerror(errno));
+    }
+    if (dir_fd >= 0) {
+        ::close(dir_fd);
+    }
+    return ok;
+}
+
+bool LogStore::append_locked(uint32_t type, uint64_t seq, FileHandle handle, int64_t local_offset,
+                             const char* data, size_t len, std::shared_ptr<Segment>* segment,
+                             int64_t* data_position, std::string& error) {
+    int64_t record_size = sizeof(RecordHeader) + len;
+    if (active->tail > 0 && active->tail + record_size > PFS_LOG_SEGMENT_SIZE) {
+        if (!roll_segment_locked(error)) {
+            return false;
+        }
+    }
+
+    RecordHeader header{RECORD_MAGIC, type, seq, local_offset, handle, static_cast<uint32_t>(len), 0};
+    struct iovec iov[2] = {
+        {&header, sizeof(header)},
+        {const_cast<char*>(data), len},
+    };
+    ssize_t put = ::pwritev(active->fd, iov, len > 0 ? 2 : 1, active->tail);
+    if (put != record_size) {
+        error = "Failed to append to log segment: " + std::string(std::strerror(errno));
+        return false;
+    }
+
+    if (segment) {
+        *segment = active;
+        *data_position = active->tail + sizeof(RecordHeader);
+    }
+    active->tail += record_size;
+    active->dirty = true;
+    return true;
+}
+
+bool LogStore::roll_segment_locked(std::string& error) {
+    uint32_t id = segments.empty() ? 1 : segments.rbegin()->first + 1;
+    char name[32];
+    std::snprintf(name, sizeof(name), "segment-%08u.log", id);
+    std::string path = log_dir + "/" + name;
+
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        error = "Failed to create log segment: " + std::string(std::strerror(errno));
+        return false;
+    }
+    if (active) {
+        active->sealed = true;
+    }
+    active = std::make_shared<Segment>(id, fd, path);
+    segments[id] = active;
+    dir_dirty = true;
+    return true;
+}
+
+// Point [start, end) of the file at a new location, trimming whatever it
+// overlapped and charging the overwritten bytes to their old segments.
+void LogStore::index_insert_locked(FileIndex& index, int64_t start, int64_t end,
+                                   const std::shared_ptr<Segment>& segment, int64_t position, uint64_t seq) {
+    auto it = index.upper_bound(start);
+    if (it != index.begin() && std::prev(it)->second.end > start) {
+        --it;
+    }
+    while (it != index.end() && it->first < end) {
+        int64_t old_start = it->first;
+        LogExtent old = it->second;
+        it = index.erase(it);
+
+        old.segment->live_bytes -= std::min(old.end, end) - std::max(old_start, start);
+        if (old_start < start) {
+            index.emplace(old_start, LogExtent{start, old.segment, old.position, old.seq});
+        }
+        if (old.end > end) {
+            index.emplace(end, LogExtent{old.end, old.segment, old.position + (end - old_start), old.seq});
+            break;
+        }
+    }
+    index.emplace(start, LogExtent{end, segment, position, seq});
+    segment->live_bytes += end - start;
+}
+
+void LogStore::index_drop_locked(FileHandle handle) {
+    auto found = indexes.find(handle);
+    if (found == indexes.end()) {
+        return;
+    }
+    for (const auto& [start, extent] : found->second) {
+        extent.segment->live_bytes -= extent.end - start;
+    }
+    indexes.erase(found);
+}
+
+// Read the record headers of a sealed segment, stopping at a torn tail
+std::vector<LogStore::ScannedRecord> LogStore::scan_segment(const std::shared_ptr<Segment>& segment) {
+    std::vector<ScannedRecord> records;
+    int64_t position = 0;
+    while (position + static_cast<int64_t>(sizeof(RecordHeader)) <= segment->tail) {
+        ScannedRecord record;
+        if (::pread(segment->fd, &record.header, sizeof(RecordHeader), position) != sizeof(RecordHeader) ||
+            record.header.magic != RECORD_MAGIC) {
+            break;
+        }
+        int64_t data_position = position + sizeof(RecordHeader);
+        int64_t record_end = data_position + record.header.data_len;
+        if (record_end > segment->tail) {
+            break;
+        }
+        record.segment = segment;
+        record.data_position = data_position;
+        records.push_back(std::move(record));
+        position = record_end;
+    }
+    return records;
+}
+
+void LogStore::recover() {
+    std::vector<ScannedRecord> records;
+    for (const auto& entry : fs::directory_iterator(log_dir)) {
+        unsigned id;
+        if (std::sscanf(entry.path().filename().c_str(), "segment-%08u.log", &id) != 1) {
+            continue;
+        }
+        int fd = ::open(entry.path().c_str(), O_RDWR);
+        if (fd < 0) {
+            continue;
+        }
+        auto segment = std::make_shared<Segment>(id, fd, entry.path().string());
+        segment->tail = fs::file_size(entry.path());
+        segment->sealed = true;
+        segments[id] = segment;
+
+        auto scanned = scan_segment(segment);
+        std::move(scanned.begin(), scanned.end(), std::back_inserter(records));
+    }
+
+    std::sort(records.begin(), records.end(), [](const ScannedRecord& a, const ScannedRecord& b) {
+        return a.header.seq < b.header.seq;
+    });
+    for (const auto& record : records) {
+        if (record.header.type == RECORD_DATA) {
+            index_insert_locked(indexes[record.header.handle], record.header.local_offset,
+                                record.header.local_offset + record.header.data_len,
+                                record.segment, record.data_position, record.header.seq);
+        } else {
+            index_drop_locked(record.header.handle);
+        }
+        next_seq = std::max(next_seq, record.header.seq + 1);
+    }
+
+    if (!segments.empty()) {
+        std::cout << "[INFO] Log store recovered " << records.size() << " records from "
+                  << segments.size() << " segments." << std::endl;
+    }
+}
+
+void LogStore::compaction_loop() {
+    while (!stopping) {
+        {
+            std::unique_lock<std::mutex> lock(cleaner_mutex);
+            cleaner_cv.wait_for(lock, std::chrono::seconds(1), [this]() { return stopping.load(); });
+        }
+        if (stopping) {
+            break;
+        }
+
+        // Pick the sealed segment with the smallest live fraction
+        std::shared_ptr<Segment> victim;
+        {
+            std::lock_guard<std::mutex> lock(log_mutex);
+            for (const auto& [id, segment] : segments) {
+                if (!segment->sealed ||
+                    (segment->tail > 0 && segment->live_bytes * 100 >= segment->tail * PFS_LOG_COMPACT_THRESHOLD)) {
+                    continue;
+                }
+                if (!victim || segment->live_bytes * victim->tail < victim->live_bytes * segment->tail) {
+                    victim = segment;
+                }
+            }
+        }
+        if (victim) {
+            compact_segment(victim);
+        }
+    }
+}
+
+// Re-append the live parts of every record in the victim and retire it
+void LogStore::compact_segment(const std::shared_ptr<Segment>& victim) {
+    int64_t copied = 0;
+    for (const auto& record : scan_segment(victim)) {
+        if (stopping) {
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(log_mutex);
+        std::string error;
+        if (record.header.type == RECORD_DELETE) {
+            // Only needed while an older segment may still hold the file's data
+            if (segments.begin()->first < victim->id &&
+                !append_locked(RECORD_DELETE, record.header.seq, record.header.handle, 0, nullptr, 0,
+                               nullptr, nullptr, error)) {
+                std::cerr << "[ERROR] Log compaction failed: " << error << std::endl;
+                return;
+            }
+            continue;
+        }
+
+        auto found = indexes.find(record.header.handle);
+        if (found == indexes.end()) {
+            continue;
+        }
+
+        // Collect the pieces of this record the index still points at
+        FileIndex& index = found->second;
+        int64_t record_start = record.header.local_offset;
+        int64_t record_end = record_start + record.header.data_len;
+        std::vector<std::pair<int64_t, int64_t>> live;
+        auto it = index.upper_bound(record_start);
+        if (it != index.begin() && std::prev(it)->second.end > record_start) {
+            --it;
+        }
+        for (; it != index.end() && it->first < record_end; ++it) {
+            if (it->second.segment == victim &&
+                it->second.position == record.data_position + (it->first - record_start)) {
+                live.emplace_back(it->first, it->second.end);
+            }
+        }
+
+        for (const auto& [start, end] : live) {
+            std::string data(end - start, '\0');
+            if (::pread(victim->fd, &data[0], data.size(), record.data_position + (start - record_start)) !=
+                static_cast<ssize_t>(data.size())) {
+                std::cerr << "[ERROR] Log compaction could not read " << victim->path << std::endl;
+                return;
+            }
+            std::shared_ptr<Segment> segment;
+            int64_t data_position;
+            if (!append_locked(RECORD_DATA, record.header.seq, record.header.handle, start, data.data(), data.size(),
+                               &segment, &data_position, error)) {
+                std::cerr << "[ERROR] Log compaction failed: " << error << std::endl;
+                return;
+            }
+            index_insert_locked(index, start, end, segment, data_position, record.header.seq);
+            copied += data.size();
+        }
+        if (!live.empty()) {
+            throttle(record_end - record_start);
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(log_mutex);
+        if (victim->live_bytes != 0) {
+            return;
+        }
+    }
+
+    // The victim may hold data that was already acknowledged as durable, so
+    // its copies, and the names of any segments created for them, must be
+    // on disk before it goes
+    std::string error;
+    if (!flush(true, error)) {
+        std::cerr << "[ERROR] Log compaction kept " << victim->path << ": " << error << std::endl;
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(log_mutex);
+        segments.erase(victim->id);
+    }
+    if (::unlink(victim->path.c_str()) != 0 || !sync_log_dir(error)) {
+        std::cerr << "[ERROR] Log compaction could not retire " << victim->path << ": "
+                  << (error.empty() ? std::strerror(errno) : error) << std::endl;
+        return;
+    }
+    std::cout << "[INFO] Log compaction retired " << victim->path << " after copying "
+              << copied << " live bytes." << std::endl;
+}
+
+// Keep the cleaner's copy bandwidth at or below PFS_LOG_COMPACT_RATE
+void LogStore::throttle(int64_t bytes) {
+    std::unique_lock<std::mutex> lock(cleaner_mutex);
+    cleaner_cv.wait_for(lock, std::chrono::microseconds(bytes * 1000000 / PFS_LOG_COMPACT_RATE),
+                        [this]() { return stopping.load(); });
+}
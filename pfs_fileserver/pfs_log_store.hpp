@@ -0,0 +1,113 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "pfs_common/pfs_common.hpp"
+#include "pfs_storage.hpp"
+
+// Log-structured storage: every write is appended to the active segment
+// file under <root>/log, so small random overwrites become sequential I/O.
+// A per-file index maps local byte ranges to their latest copy in the log.
+// A background cleaner copies live data out of mostly-dead segments and
+// deletes them, limited to PFS_LOG_COMPACT_RATE bytes per second.
+//
+// Each record carries a global sequence number. On restart the segments are
+// scanned and records are replayed in sequence order to rebuild the index,
+// so compaction can move records between segments without reordering them.
+class LogStore : public StorageBackend {
+public:
+    explicit LogStore(const std::string& root);
+    ~LogStore() override;
+
+    bool write(FileHandle handle, int64_t local_offset,
+               const char* data, size_t len, std::string& error) override;
+    bool read(FileHandle handle, int64_t local_offset,
+              char* buf, size_t len, std::string& error) override;
+    bool sync(FileHandle handle, std::string& error) override;
+    bool remove(FileHandle handle, std::string& error) override;
+
+private:
+    // On-disk record header, followed by the data
+    struct RecordHeader {
+        uint32_t magic;
+        uint32_t type;        // RECORD_DATA or RECORD_DELETE
+        uint64_t seq;         // Global order of the record
+        int64_t local_offset;
+        FileHandle handle;
+        uint32_t data_len;
+        uint32_t reserved;
+    };
+    static constexpr uint32_t RECORD_MAGIC = 0x50465348; // "PFSH"
+    static constexpr uint32_t RECORD_DATA = 1;
+    static constexpr uint32_t RECORD_DELETE = 2;
+
+    struct Segment {
+        uint32_t id;
+        int fd;
+        std::string path;
+        int64_t tail = 0;        // Append position
+        int64_t live_bytes = 0;  // Data bytes still referenced by the index
+        bool sealed = false;
+        bool dirty = false;      // Appended to since its last fdatasync
+
+        Segment(uint32_t id, int fd, const std::string& path) : id(id), fd(fd), path(path) {}
+        ~Segment();
+    };
+
+    // Where the bytes [start, end) of a file currently live in the log
+    struct LogExtent {
+        int64_t end;
+        std::shared_ptr<Segment> segment;
+        int64_t position;  // Segment offset of the byte at the extent's start
+        uint64_t seq;
+    };
+    using FileIndex = std::map<int64_t, LogExtent>;
+
+    // A record found while scanning a segment
+    struct ScannedRecord {
+        RecordHeader header;
+        std::shared_ptr<Segment> segment;
+        int64_t data_position;
+    };
+
+    bool append_locked(uint32_t type, uint64_t seq, FileHandle handle, int64_t local_offset,
+                       const char* data, size_t len, std::shared_ptr<Segment>* segment,
+                       int64_t* data_position, std::string& error);
+    bool roll_segment_locked(std::string& error);
+    bool flush(bool always_sync_dir, std::string& error);
+    bool sync_log_dir(std::string& error);
+    void index_insert_locked(FileIndex& index, int64_t start, int64_t end,
+                             const std::shared_ptr<Segment>& segment, int64_t position, uint64_t seq);
+    void index_drop_locked(FileHandle handle);
+    std::vector<ScannedRecord> scan_segment(const std::shared_ptr<Segment>& segment);
+    void recover();
+
+    void compaction_loop();
+    void compact_segment(const std::shared_ptr<Segment>& victim);
+    void throttle(int64_t bytes);
+
+    std::string log_dir;
+    std::mutex log_mutex;  // Guards segments, indexes and the append position
+    std::map<uint32_t, std::shared_ptr<Segment>> segments;
+    std::shared_ptr<Segment> active;
+    std::unordered_map<FileHandle, FileIndex> indexes;
+    uint64_t next_seq = 1;
+    bool dir_dirty = false;  // Segments created since the log directory was last synced
+    // Held across a whole flush, so a flush that finds nothing dirty also
+    // waits out one whose fdatasync of the same segments is still running
+    std::mutex flush_mutex;
+
+    std::atomic<bool> stopping{false};
+    std::mutex cleaner_mutex;
+    std::condition_variable cleaner_cv;
+    std::thread cleaner;
+};
@@ -0,0 +1,117 @@
+#include "pfs_reclaimer.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <ctime>
+#include <filesystem>
+#include <iostream>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "pfs_common/pfs_config.hpp"
+
+namespace fs = std::filesystem;
+
+TrashReclaimer::TrashReclaimer(const std::string& trash_dir) : trash_dir(trash_dir) {
+    std::error_code ec;
+    fs::create_directories(trash_dir, ec);
+    for (const auto& entry : fs::directory_iterator(trash_dir, ec)) {
+        pending.push_back(entry.path().string());
+    }
+    if (!pending.empty()) {
+        std::cout << "[INFO] Reclaiming " << pending.size() << " deleted files left in "
+                  << trash_dir << std::endl;
+    }
+    reclaimer = std::thread(&TrashReclaimer::reclaim_loop, this);
+}
+
+TrashReclaimer::~TrashReclaimer() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    cv.notify_all();
+    reclaimer.join();
+}
+
+bool TrashReclaimer::discard(const std::string& path, std::string& error) {
+    std::string target;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        target = trash_dir + "/" + std::to_string(std::time(nullptr)) + "-" +
+                 std::to_string(::getpid()) + "-" + std::to_string(next_id++);
+    }
+    if (::rename(path.c_str(), target.c_str()) != 0) {
+        if (errno == ENOENT) {
+            return true;  // Nothing stored here
+        }
+        error = "Failed to move file to trash: " + std::string(std::strerror(errno));
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    pending.push_back(target);
+    cv.notify_one();
+    return true;
+}
+
+void TrashReclaimer::reclaim_loop() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        cv.wait(lock, [this]() { return stopping || !pending.empty(); });
+        if (stopping) {
+            return;
+        }
+        std::string path = std::move(pending.front());
+        pending.pop_front();
+        lock.unlock();
+        reclaim(path);
+        lock.lock();
+    }
+}
+
+// Free the file's blocks a step at a time, from the end, then unlink what
+// is left. Holes are punched rather than the file truncated: a reader may
+// still be copying out of a mapping of the file, and a hole reads back as
+// zeros where a truncated page would fault. The size therefore stays, so
+// after a restart the steps already punched are punched again; they free
+// nothing, and the throttle only counts blocks that were actually freed.
+void TrashReclaimer::reclaim(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDWR);
+    struct stat st;
+    if (fd >= 0 && ::fstat(fd, &st) == 0) {
+        int64_t end = st.st_size;
+        int64_t blocks = st.st_blocks;
+        while (end > 0) {
+            int64_t start = std::max<int64_t>(0, end - PFS_RECLAIM_STEP);
+            if (::fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, start, end - start) != 0 ||
+                ::fstat(fd, &st) != 0) {
+                break;  // No hole punching on this filesystem; just unlink
+            }
+            int64_t freed = (blocks - st.st_blocks) * 512;  // st_blocks counts 512-byte units
+            blocks = st.st_blocks;
+            if (freed > 0 && !throttle(freed)) {
+                ::close(fd);
+                return;  // Shutting down; finish on the next start
+            }
+            end = start;
+        }
+    }
+    if (fd >= 0) {
+        ::close(fd);
+    }
+    if (::unlink(path.c_str()) != 0 && errno != ENOENT) {
+        std::cerr << "[ERROR] Failed to reclaim " << path << ": " << std::strerror(errno) << std::endl;
+    }
+}
+
+// Wait long enough that freeing bytes stays under PFS_RECLAIM_RATE; returns
+// false if the reclaimer is stopping.
+bool TrashReclaimer::throttle(int64_t bytes) {
+    auto pause = std::chrono::microseconds(bytes * 1000000 / PFS_RECLAIM_RATE);
+    std::unique_lock<std::mutex> lock(mutex);
+    return !cv.wait_for(lock, pause, [this]() { return stopping; });
+}
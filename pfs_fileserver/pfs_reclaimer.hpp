@@ -0,0 +1,39 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+
+// Frees the space of deleted files in the background. Deletion only renames
+// a file into the trash directory; this thread then punches holes into it
+// PFS_RECLAIM_STEP bytes at a time, limited to PFS_RECLAIM_RATE bytes per
+// second, and unlinks it once empty. Unlinking a large file in one go can
+// stall the disk for everything else, which is what the throttle prevents.
+//
+// Trash left behind by a crash or shutdown is picked up on the next start.
+class TrashReclaimer {
+public:
+    explicit TrashReclaimer(const std::string& trash_dir);
+    ~TrashReclaimer();
+
+    // Move path into the trash and queue it for reclamation
+    bool discard(const std::string& path, std::string& error);
+
+private:
+    void reclaim_loop();
+    void reclaim(const std::string& path);
+    bool throttle(int64_t bytes);
+
+    std::string trash_dir;
+    uint64_t next_id = 0;
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<std::string> pending;
+    bool stopping = false;
+
+    std::thread reclaimer;
+};
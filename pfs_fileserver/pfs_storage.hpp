@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "pfs_common/pfs_common.hpp"
+
+// Where a file server keeps the stripe units it owns. Offsets are local to
+// the server's compact copy of each file (see stripeLocalOffset()).
+class StorageBackend {
+public:
+    virtual ~StorageBackend() = default;
+
+    // Write len bytes at local_offset of the file, creating it if needed
+    virtual bool write(FileHandle handle, int64_t local_offset,
+                       const char* data, size_t len, std::string& error) = 0;
+
+    // Read len bytes at local_offset; unwritten bytes are returned as zeros
+    virtual bool read(FileHandle handle, int64_t local_offset,
+                      char* buf, size_t len, std::string& error) = 0;
+
+    // Make every completed write to the file durable
+    virtual bool sync(FileHandle handle, std::string& error) = 0;
+
+    // Drop the file; succeeds if this server never stored it
+    virtual bool remove(FileHandle handle, std::string& error) = 0;
+};
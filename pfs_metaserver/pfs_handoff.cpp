@@ -0,0 +1,133 @@
+#include "pfs_handoff.hpp"
+
+#include <chrono>
+#include <iostream>
+#include <map>
+
+#include <grpcpp/grpcpp.h>
+
+ShardHandoff::ShardHandoff(int shard_id, const ShardMap& shard_map,
+                           const std::vector<std::unique_ptr<pfsmeta::MetadataServer::Stub>>& peers,
+                           MetadataTable& table, MetadataJournal& journal, TokenManager& token_manager)
+    : shard_id(shard_id), shard_map(shard_map), table(table), journal(journal), token_manager(token_manager),
+      peers(peers) {
+    thread = std::thread(&ShardHandoff::handoff_loop, this);
+}
+
+ShardHandoff::~ShardHandoff() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    cv.notify_one();
+    thread.join();
+}
+
+void ShardHandoff::handoff_loop() {
+    uint64_t moved = 0;
+    std::unique_lock<std::mutex> lock(mutex);
+    while (!stopping) {
+        lock.unlock();
+        std::map<int, std::vector<pfsmeta::FileMetadata>> outgoing;
+        table.for_each([&](const pfsmeta::FileMetadata& metadata) {
+            int owner = shard_map.owner(metadata.filename());
+            if (owner != shard_id && conflicted.count(metadata.filename()) == 0) {
+                outgoing[owner].push_back(metadata);
+            }
+        });
+
+        bool pending = false;
+        for (auto& [shard, files] : outgoing) {
+            std::vector<pfsmeta::FileMetadata> batch;
+            for (size_t i = 0; i < files.size(); ++i) {
+                if (token_manager.has_tokens(files[i].handle())) {
+                    pending = true;
+                } else {
+                    batch.push_back(std::move(files[i]));
+                }
+                if (batch.size() == PFS_HANDOFF_BATCH || (i + 1 == files.size() && !batch.empty())) {
+                    size_t refused = conflicted.size();
+                    if (!move_files(shard, batch)) {
+                        pending = true;
+                        break;
+                    }
+                    moved += batch.size() - (conflicted.size() - refused);
+                    batch.clear();
+                }
+            }
+        }
+        lock.lock();
+
+        if (outgoing.empty()) {
+            break;
+        }
+        if (pending) {
+            cv.wait_for(lock, std::chrono::milliseconds(PFS_HANDOFF_RETRY_MS), [this]() { return stopping; });
+        }
+    }
+    if (moved > 0) {
+        std::cout << "[INFO] Handed " << moved << " files over to the metadata shards that own them." << std::endl;
+    }
+}
+
+bool ShardHandoff::import(int shard, const std::vector<pfsmeta::FileMetadata>& files,
+                          std::set<std::string>* conflicts) {
+    pfsmeta::ImportFilesRequest request;
+    pfsmeta::ImportFilesResponse response;
+    request.set_from_shard(shard_id);
+    for (const auto& metadata : files) {
+        *request.add_files() = metadata;
+    }
+
+    grpc::ClientContext context;
+    context.set_deadline(std::chrono::system_clock::now() + std::chrono::milliseconds(PFS_HANDOFF_RETRY_MS * 10));
+    grpc::Status status = peers[shard]->ImportFiles(&context, request, &response);
+    if (!status.ok() || !response.success()) {
+        std::cerr << "[ERROR] Hand-off to metadata shard " << shard << " failed: "
+                  << (status.ok() ? response.message() : status.error_message()) << std::endl;
+        return false;
+    }
+    if (conflicts) {
+        conflicts->insert(response.conflicts().begin(), response.conflicts().end());
+    }
+    return true;
+}
+
+bool ShardHandoff::move_files(int shard, const std::vector<pfsmeta::FileMetadata>& files) {
+    std::set<std::string> refused;
+    if (!import(shard, files, &refused)) {
+        return false;
+    }
+    for (const auto& filename : refused) {
+        std::cerr << "[ERROR] Metadata shard " << shard << " has another file named '" << filename
+                  << "'; keeping this one here." << std::endl;
+        conflicted.insert(filename);
+    }
+
+    std::vector<pfsmeta::FileMetadata> changed;
+    uint64_t ticket = 0;
+    for (const auto& sent : files) {
+        if (refused.count(sent.filename()) != 0) {
+            continue;
+        }
+        pfsmeta::FileMetadata removed;
+        bool dropped = table.remove(sent.filename(), [&]() {
+            pfsmeta::FileMetadata record;
+            record.set_filename(sent.filename());
+            ticket = journal.append(MetadataJournal::RECORD_DELETE, record);
+        }, &removed);
+        if (dropped && (removed.filesize() != sent.filesize() || removed.mtime() != sent.mtime())) {
+            changed.push_back(removed);
+        }
+    }
+    if (ticket != 0 && !journal.wait_durable(ticket)) {
+        std::cerr << "[ERROR] Failed to persist the hand-off to metadata shard " << shard << "." << std::endl;
+    }
+
+    // Updated while the batch was in flight; the owner keeps the larger size
+    if (!changed.empty() && !import(shard, changed)) {
+        std::cerr << "[ERROR] Metadata shard " << shard << " missed late updates to " << changed.size()
+                  << " files." << std::endl;
+    }
+    return true;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "pfs_common/pfs_common.hpp"
+#include "pfs_metadata_journal.hpp"
+#include "pfs_metadata_table.hpp"
+#include "pfs_token_manager.hpp"
+#include "pfs_proto/pfs_metaserver.grpc.pb.h"
+
+// Moves files this metadata shard holds but no longer owns to the shard
+// that does, as happens after a shard was added to pfs_list.txt. A thread
+// started with the server sends them in ImportFiles batches of
+// PFS_HANDOFF_BATCH and drops each one locally once its owner has it,
+// retrying every PFS_HANDOFF_RETRY_MS while an owner is unreachable. It
+// exits once nothing is left to move.
+//
+// Files with tokens outstanding stay until those are released, and updates
+// that land between the import and the local delete are sent again. A file
+// whose name the owner has meanwhile given to a different file stays here,
+// untouched, and is reported rather than merged into the other one.
+class ShardHandoff {
+public:
+    // peers holds a stub for every shard, in shard order
+    ShardHandoff(int shard_id, const ShardMap& shard_map,
+                 const std::vector<std::unique_ptr<pfsmeta::MetadataServer::Stub>>& peers,
+                 MetadataTable& table, MetadataJournal& journal, TokenManager& token_manager);
+    ~ShardHandoff();
+
+private:
+    void handoff_loop();
+
+    // Move one batch to shard; false if the shard could not take it
+    bool move_files(int shard, const std::vector<pfsmeta::FileMetadata>& files);
+    // conflicts, if given, receives the names the owner refused
+    bool import(int shard, const std::vector<pfsmeta::FileMetadata>& files,
+                std::set<std::string>* conflicts = nullptr);
+
+    int shard_id;
+    const ShardMap& shard_map;
+    MetadataTable& table;
+    MetadataJournal& journal;
+    TokenManager& token_manager;
+    const std::vector<std::unique_ptr<pfsmeta::MetadataServer::Stub>>& peers;
+
+    std::set<std::string> conflicted;  // Refused by their owner; never sent again
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool stopping = false;
+    std::thread thread;
+};
@@ -0,0 +1,395 @@
+#include "pfs_metadata_journal.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "pfs_common/pfs_common.hpp"
+#include "pfs_common/pfs_config.hpp"
+
+namespace fs = std::filesystem;
+
+static bool write_all(int fd, const char* data, size_t len) {
+    while (len > 0) {
+        ssize_t put = ::write(fd, data, len);
+        if (put < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += put;
+        len -= put;
+    }
+    return true;
+}
+
+// A read-only mapping of a whole file, unmapped when it goes out of scope
+struct MappedFile {
+    const char* data = nullptr;
+    size_t size = 0;
+
+    explicit MappedFile(const std::string& path) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return;
+        }
+        struct stat st;
+        if (::fstat(fd, &st) == 0 && st.st_size > 0) {
+            void* addr = ::mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (addr != MAP_FAILED) {
+                ::madvise(addr, st.st_size, MADV_SEQUENTIAL);
+                data = static_cast<const char*>(addr);
+                size = st.st_size;
+            }
+        }
+        ::close(fd);
+    }
+    ~MappedFile() {
+        if (data) {
+            ::munmap(const_cast<char*>(data), size);
+        }
+    }
+};
+
+MetadataJournal::MetadataJournal(const std::string& dir, MetadataTable& table, int shard)
+    : dir(dir), table(table), shard(shard), last_snapshot(std::chrono::steady_clock::now()) {
+    recover();
+    flusher = std::thread(&MetadataJournal::flusher_loop, this);
+    snapshotter = std::thread(&MetadataJournal::snapshot_loop, this);
+}
+
+MetadataJournal::~MetadataJournal() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    flush_cv.notify_all();
+    snapshot_cv.notify_all();
+    snapshotter.join();
+    flusher.join();
+    if (log_fd >= 0) {
+        ::close(log_fd);
+    }
+}
+
+uint32_t MetadataJournal::checksum(const char* data, size_t len) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; ++i) {
+        hash = (hash ^ static_cast<uint8_t>(data[i])) * 16777619u;
+    }
+    return hash;
+}
+
+std::string MetadataJournal::path_of(const char* kind, uint64_t gen) const {
+    char name[64];
+    std::snprintf(name, sizeof(name), "%s-%08llu.%s", kind, static_cast<unsigned long long>(gen),
+                  std::strcmp(kind, "wal") == 0 ? "log" : "snap");
+    return dir + "/" + name;
+}
+
+uint64_t MetadataJournal::append(RecordType type, const pfsmeta::FileMetadata& record) {
+    std::string payload = record.SerializeAsString();
+    RecordHeader header{RECORD_MAGIC, type, static_cast<uint32_t>(payload.size()),
+                        checksum(payload.data(), payload.size())};
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (type == RECORD_CREATE) {
+        note_handle(record);
+    }
+    pending.append(reinterpret_cast<const char*>(&header), sizeof(header));
+    pending.append(payload);
+    uint64_t ticket = ++queued;
+    flush_cv.notify_one();
+    return ticket;
+}
+
+bool MetadataJournal::wait_durable(uint64_t ticket) {
+    std::unique_lock<std::mutex> lock(mutex);
+    durable_cv.wait(lock, [this, ticket]() { return durable >= ticket; });
+    return !failed;
+}
+
+uint64_t MetadataJournal::handle_mark() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return max_handle;
+}
+
+// Directories and other shards' files do not count
+void MetadataJournal::note_handle(const pfsmeta::FileMetadata& record) {
+    if (record.handle() != 0 && handleShard(record.handle()) == shard) {
+        max_handle = std::max(max_handle, handleSequence(record.handle()));
+    }
+}
+
+void MetadataJournal::flusher_loop() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        flush_cv.wait(lock, [this]() { return stopping || !pending.empty() || rollover_requested; });
+
+        // Write everything queued so far as one batch with one flush
+        if (!pending.empty()) {
+            std::string batch;
+            batch.swap(pending);
+            uint64_t batch_end = queued;
+            int fd = log_fd;
+            lock.unlock();
+
+            bool ok = write_all(fd, batch.data(), batch.size()) && ::fdatasync(fd) == 0;
+            if (!ok) {
+                std::cerr << "[ERROR] Failed to write metadata log: " << std::strerror(errno) << std::endl;
+            }
+            log_bytes += batch.size();
+
+            lock.lock();
+            failed = failed || !ok;
+            durable = batch_end;
+            durable_cv.notify_all();
+            continue;
+        }
+
+        // Start a new generation once the old one has nothing pending
+        if (rollover_requested) {
+            if (!open_log(log_gen + 1)) {
+                failed = true;
+            }
+            rollover_requested = false;
+            snapshot_cv.notify_all();
+            continue;
+        }
+
+        if (stopping) {
+            return;
+        }
+    }
+}
+
+void MetadataJournal::snapshot_loop() {
+    while (true) {
+        uint64_t gen, mark;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            snapshot_cv.wait_for(lock, std::chrono::seconds(1), [this]() { return stopping; });
+            if (stopping) {
+                return;
+            }
+            bool due = log_bytes >= PFS_METADATA_SNAPSHOT_BYTES ||
+                       (log_bytes > 0 && std::chrono::steady_clock::now() - last_snapshot >=
+                                             std::chrono::seconds(PFS_METADATA_SNAPSHOT_SECS));
+            if (!due) {
+                continue;
+            }
+
+            // Everything logged before the rollover is already in the table,
+            // so the snapshot covers it and only newer logs need replaying
+            rollover_requested = true;
+            flush_cv.notify_one();
+            snapshot_cv.wait(lock, [this]() { return !rollover_requested || stopping; });
+            if (stopping) {
+                return;
+            }
+            gen = log_gen;
+            // Covers every create in the logs the snapshot replaces
+            mark = max_handle;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        if (write_snapshot(gen, mark)) {
+            std::error_code ec;
+            for (const auto& entry : fs::directory_iterator(dir, ec)) {
+                unsigned long long old_gen;
+                char kind[16];
+                std::string name = entry.path().filename().string();
+                if (std::sscanf(name.c_str(), "%15[a-z]-%llu", kind, &old_gen) == 2 && old_gen < gen) {
+                    fs::remove(entry.path(), ec);
+                }
+            }
+            std::cout << "[INFO] Metadata snapshot " << gen << " written with " << table.size() << " files in "
+                      << std::chrono::duration_cast<std::chrono::milliseconds>(
+                             std::chrono::steady_clock::now() - start).count()
+                      << " ms." << std::endl;
+        }
+        last_snapshot = std::chrono::steady_clock::now();
+    }
+}
+
+bool MetadataJournal::write_snapshot(uint64_t gen, uint64_t mark) {
+    std::string path = path_of("snapshot", gen);
+    std::string tmp_path = path + ".tmp";
+    int fd = ::open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        std::cerr << "[ERROR] Failed to create metadata snapshot: " << std::strerror(errno) << std::endl;
+        return false;
+    }
+
+    SnapshotHeader header{SNAPSHOT_MAGIC, 2, 0, mark};
+    std::string buffer(reinterpret_cast<const char*>(&header), sizeof(header));
+    bool ok = true;
+    table.for_each([&](const pfsmeta::FileMetadata& metadata) {
+        uint32_t length = metadata.ByteSizeLong();
+        buffer.append(reinterpret_cast<const char*>(&length), sizeof(length));
+        metadata.AppendToString(&buffer);
+        header.num_files++;
+        if (buffer.size() >= (4 << 20)) {
+            ok = ok && write_all(fd, buffer.data(), buffer.size());
+            buffer.clear();
+        }
+    });
+    ok = ok && write_all(fd, buffer.data(), buffer.size()) &&
+         ::pwrite(fd, &header, sizeof(header), 0) == sizeof(header) && ::fsync(fd) == 0;
+    ::close(fd);
+
+    if (!ok || ::rename(tmp_path.c_str(), path.c_str()) != 0) {
+        std::cerr << "[ERROR] Failed to write metadata snapshot: " << std::strerror(errno) << std::endl;
+        ::unlink(tmp_path.c_str());
+        return false;
+    }
+    sync_dir();
+    return true;
+}
+
+void MetadataJournal::sync_dir() {
+    int dir_fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+    if (dir_fd >= 0) {
+        ::fsync(dir_fd);
+        ::close(dir_fd);
+    }
+}
+
+bool MetadataJournal::open_log(uint64_t gen) {
+    std::string path = path_of("wal", gen);
+    int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd < 0) {
+        std::cerr << "[ERROR] Failed to open metadata log " << path << ": " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    sync_dir();
+    if (log_fd >= 0) {
+        ::close(log_fd);
+    }
+    log_fd = fd;
+    log_gen = gen;
+    log_bytes = 0;
+    return true;
+}
+
+void MetadataJournal::recover() {
+    auto start = std::chrono::steady_clock::now();
+    std::error_code ec;
+    fs::create_directories(dir, ec);
+
+    std::vector<uint64_t> snapshots, logs;
+    for (const auto& entry : fs::directory_iterator(dir, ec)) {
+        unsigned long long gen;
+        std::string name = entry.path().filename().string();
+        if (std::sscanf(name.c_str(), "wal-%llu.log", &gen) == 1 && name.size() == 16) {
+            logs.push_back(gen);
+        } else if (std::sscanf(name.c_str(), "snapshot-%llu.snap", &gen) == 1 && name.size() == 22) {
+            snapshots.push_back(gen);
+        }
+    }
+    std::sort(snapshots.rbegin(), snapshots.rend());
+    std::sort(logs.begin(), logs.end());
+
+    // The newest readable snapshot, then every log written since it
+    uint64_t base = 0;
+    for (uint64_t gen : snapshots) {
+        if (load_snapshot(gen)) {
+            base = gen;
+            break;
+        }
+    }
+    for (uint64_t gen : logs) {
+        if (gen >= base) {
+            replay_log(gen);
+        }
+    }
+
+    uint64_t next_gen = std::max(base, logs.empty() ? 0 : logs.back()) + 1;
+    if (!open_log(next_gen)) {
+        failed = true;
+    }
+    if (base > 0 || !logs.empty()) {
+        std::cout << "[INFO] Recovered " << table.size() << " files from " << dir << " in "
+                  << std::chrono::duration_cast<std::chrono::milliseconds>(
+                         std::chrono::steady_clock::now() - start).count()
+                  << " ms." << std::endl;
+    }
+}
+
+bool MetadataJournal::load_snapshot(uint64_t gen) {
+    MappedFile file(path_of("snapshot", gen));
+    // Version 1 headers end before handle_mark
+    SnapshotHeader header{};
+    size_t v1_size = offsetof(SnapshotHeader, handle_mark);
+    if (!file.data || file.size < v1_size) {
+        return false;
+    }
+    std::memcpy(&header, file.data, v1_size);
+    size_t pos = header.version == 1 ? v1_size : sizeof(header);
+    if (header.magic != SNAPSHOT_MAGIC || (header.version != 1 && header.version != 2) || file.size < pos) {
+        return false;
+    }
+    std::memcpy(&header, file.data, pos);
+
+    pfsmeta::FileMetadata metadata;
+    for (uint64_t i = 0; i < header.num_files; ++i) {
+        uint32_t length;
+        if (pos + sizeof(length) > file.size) {
+            return false;
+        }
+        std::memcpy(&length, file.data + pos, sizeof(length));
+        pos += sizeof(length);
+        if (pos + length > file.size || !metadata.ParseFromArray(file.data + pos, length)) {
+            return false;
+        }
+        pos += length;
+        table.load(metadata);
+        note_handle(metadata);
+    }
+    max_handle = std::max(max_handle, header.handle_mark);
+    return true;
+}
+
+// Apply the log's records in order, stopping at a torn or corrupt tail
+void MetadataJournal::replay_log(uint64_t gen) {
+    MappedFile file(path_of("wal", gen));
+    size_t pos = 0;
+    pfsmeta::FileMetadata record;
+    while (file.data && pos + sizeof(RecordHeader) <= file.size) {
+        RecordHeader header;
+        std::memcpy(&header, file.data + pos, sizeof(header));
+        const char* payload = file.data + pos + sizeof(header);
+        if (header.magic != RECORD_MAGIC || pos + sizeof(header) + header.length > file.size ||
+            checksum(payload, header.length) != header.checksum ||
+            !record.ParseFromArray(payload, header.length)) {
+            std::cout << "[INFO] Metadata log " << gen << " ends with an incomplete record at offset "
+                      << pos << "; ignoring the rest of it." << std::endl;
+            break;
+        }
+        pos += sizeof(header) + header.length;
+
+        int64_t filesize, mtime;
+        switch (header.type) {
+        case RECORD_CREATE:
+            table.load(record);
+            note_handle(record);
+            break;
+        case RECORD_UPDATE:
+            // Logged in any order; update() keeps the larger size and mtime
+            table.update(record.filename(), record.filesize(), record.mtime(), &filesize, &mtime);
+            break;
+        case RECORD_DELETE:
+            table.remove(record.filename());
+            break;
+        }
+    }
+}
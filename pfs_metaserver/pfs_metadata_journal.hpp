@@ -0,0 +1,112 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "pfs_metadata_table.hpp"
+#include "pfs_proto/pfs_metaserver.pb.h"
+
+// Makes the metadata table survive restarts. Every namespace change is
+// appended to a write-ahead log before its RPC returns. A flusher thread
+// writes and fdatasyncs whatever has been queued so far as one batch, so
+// concurrent changes share a single disk flush.
+//
+// The snapshot thread rolls the log over to a new generation once it grows
+// past PFS_METADATA_SNAPSHOT_BYTES, or every PFS_METADATA_SNAPSHOT_SECS.
+// It then writes the whole table to snapshot-<gen> and deletes the older
+// logs and snapshots. At startup the newest snapshot is mapped and loaded,
+// and the logs from its generation on are replayed.
+//
+// Handles of deleted files must never be handed out again, so the journal
+// also remembers the largest handle sequence of its shard that was ever
+// created: from the create records of the logs, and across snapshots in
+// the snapshot header.
+//
+// Files under dir:
+//   wal-<gen>.log       records: RecordHeader + serialized FileMetadata
+//   snapshot-<gen>.snap SnapshotHeader + (uint32 length, FileMetadata)*
+class MetadataJournal {
+public:
+    enum RecordType : uint32_t {
+        RECORD_CREATE = 1,  // Full metadata of a new file
+        RECORD_UPDATE = 2,  // filename, filesize and mtime after an update
+        RECORD_DELETE = 3,  // filename
+    };
+
+    // Recover dir into table, then start logging. shard is the metadata
+    // shard whose handles handle_mark() tracks.
+    MetadataJournal(const std::string& dir, MetadataTable& table, int shard);
+    ~MetadataJournal();
+
+    // Queue a record; returns the ticket to wait on. Call it from the table's
+    // on_applied hook so a file's create and delete are queued in applied
+    // order around its updates.
+    uint64_t append(RecordType type, const pfsmeta::FileMetadata& record);
+
+    // Block until every record up to ticket is on disk; false if the log
+    // could not be written
+    bool wait_durable(uint64_t ticket);
+
+    // Largest handle sequence of the shard ever logged as created, including
+    // files deleted since; 0 if none
+    uint64_t handle_mark();
+
+private:
+    struct RecordHeader {
+        uint32_t magic;
+        uint32_t type;
+        uint32_t length;    // Payload bytes
+        uint32_t checksum;  // FNV-1a of the payload
+    };
+    struct SnapshotHeader {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t num_files;
+        uint64_t handle_mark;  // Since version 2
+    };
+    static constexpr uint32_t RECORD_MAGIC = 0x50464d57;    // "PFMW"
+    static constexpr uint32_t SNAPSHOT_MAGIC = 0x50464d53;  // "PFMS"
+
+    static uint32_t checksum(const char* data, size_t len);
+    std::string path_of(const char* kind, uint64_t gen) const;
+
+    void note_handle(const pfsmeta::FileMetadata& record);
+    void recover();
+    bool load_snapshot(uint64_t gen);
+    void replay_log(uint64_t gen);
+    bool open_log(uint64_t gen);
+
+    void flusher_loop();
+    void snapshot_loop();
+    bool write_snapshot(uint64_t gen, uint64_t mark);
+    void sync_dir();
+
+    std::string dir;
+    MetadataTable& table;
+    const int shard;
+
+    std::mutex mutex;
+    std::condition_variable flush_cv;    // Wakes the flusher
+    std::condition_variable durable_cv;  // Wakes waiters when a batch is done
+    std::string pending;                 // Records queued for the next batch
+    uint64_t queued = 0;                 // Ticket of the last queued record
+    uint64_t durable = 0;                // Ticket of the last record on disk
+    bool failed = false;                 // The log could not be written
+    uint64_t max_handle = 0;             // What handle_mark() reports
+    bool rollover_requested = false;
+    bool stopping = false;
+
+    int log_fd = -1;
+    uint64_t log_gen = 0;
+    std::atomic<int64_t> log_bytes{0};
+    std::chrono::steady_clock::time_point last_snapshot;
+
+    std::condition_variable snapshot_cv;
+    std::thread flusher;
+    std::thread snapshotter;
+};
@@ -0,0 +1,301 @@
+#include "pfs_metadata_table.hpp"
+
+#include <algorithm>
+#include <functional>
+#include <mutex>
+
+#include "pfs_common/pfs_common.hpp"
+
+MetadataTable::MetadataTable(size_t num_stripes) {
+    for (size_t i = 0; i < num_stripes; ++i) {
+        stripes.push_back(std::make_unique<Stripe>());
+    }
+}
+
+MetadataTable::Entry::Entry(const pfsmeta::FileMetadata& metadata, const pfsmeta::FileMetadata* layout) {
+    assign(metadata, layout);
+}
+
+void MetadataTable::Entry::assign(const pfsmeta::FileMetadata& metadata, const pfsmeta::FileMetadata* layout) {
+    handle = metadata.handle();
+    ctime = metadata.ctime();
+    filesize.store(metadata.filesize(), std::memory_order_relaxed);
+    mtime.store(metadata.mtime(), std::memory_order_relaxed);
+    this->layout = layout;
+    durability = metadata.durability();
+    directory = metadata.directory();
+}
+
+void MetadataTable::Entry::export_to(const std::string& filename, pfsmeta::FileMetadata* out) const {
+    out->CopyFrom(*layout);
+    out->set_filename(filename);
+    out->set_handle(handle);
+    out->set_ctime(ctime);
+    out->set_filesize(filesize.load(std::memory_order_acquire));
+    out->set_mtime(mtime.load(std::memory_order_acquire));
+    out->set_durability(durability);
+    out->set_directory(directory);
+}
+
+const pfsmeta::FileMetadata* MetadataTable::intern_layout(const pfsmeta::FileMetadata& metadata) {
+    pfsmeta::FileMetadata layout;
+    layout.set_stripe_width(metadata.stripe_width());
+    layout.set_stripe_unit(metadata.stripe_unit());
+    layout.set_stripe_blocks(metadata.stripe_blocks());
+    layout.set_start_server(metadata.start_server());
+    layout.set_server_count(metadata.server_count());
+    *layout.mutable_servers() = metadata.servers();
+    *layout.mutable_recipes() = metadata.recipes();
+
+    std::string key = layout.SerializeAsString();
+    std::lock_guard<std::mutex> lock(layout_mutex);
+    auto& shared = layouts[key];
+    if (!shared) {
+        shared = std::make_unique<pfsmeta::FileMetadata>(std::move(layout));
+    }
+    return shared.get();
+}
+
+size_t MetadataTable::stripe_index(const std::string& filename) const {
+    return std::hash<std::string>{}(filename) % stripes.size();
+}
+
+MetadataTable::Stripe& MetadataTable::stripe_for(const std::string& filename) const {
+    return *stripes[stripe_index(filename)];
+}
+
+std::vector<std::vector<size_t>> MetadataTable::group_by_stripe(
+    size_t count, const std::function<const std::string&(size_t)>& name_of) const {
+    std::vector<std::vector<size_t>> groups(stripes.size());
+    for (size_t i = 0; i < count; ++i) {
+        groups[stripe_index(name_of(i))].push_back(i);
+    }
+    return groups;
+}
+
+bool MetadataTable::create(const pfsmeta::FileMetadata& metadata, const Hook& on_applied) {
+    Stripe& stripe = stripe_for(metadata.filename());
+    const pfsmeta::FileMetadata* layout = intern_layout(metadata);
+
+    std::unique_lock<std::shared_mutex> lock(stripe.mutex);
+    if (!stripe.files.try_emplace(metadata.filename(), metadata, layout).second) {
+        return false;
+    }
+    num_files.fetch_add(1, std::memory_order_relaxed);
+    index_add(metadata.filename());
+    if (on_applied) {
+        on_applied();
+    }
+    return true;
+}
+
+void MetadataTable::load(const pfsmeta::FileMetadata& metadata) {
+    Stripe& stripe = stripe_for(metadata.filename());
+    const pfsmeta::FileMetadata* layout = intern_layout(metadata);
+
+    std::unique_lock<std::shared_mutex> lock(stripe.mutex);
+    auto [it, added] = stripe.files.try_emplace(metadata.filename(), metadata, layout);
+    if (added) {
+        num_files.fetch_add(1, std::memory_order_relaxed);
+        index_add(metadata.filename());
+    } else {
+        it->second.assign(metadata, layout);
+    }
+}
+
+bool MetadataTable::contains(const std::string& filename) const {
+    Stripe& stripe = stripe_for(filename);
+    std::shared_lock<std::shared_mutex> lock(stripe.mutex);
+    return stripe.files.count(filename) != 0;
+}
+
+bool MetadataTable::fetch(const std::string& filename, pfsmeta::FileMetadata* out) const {
+    Stripe& stripe = stripe_for(filename);
+    std::shared_lock<std::shared_mutex> lock(stripe.mutex);
+    auto it = stripe.files.find(filename);
+    if (it == stripe.files.end()) {
+        return false;
+    }
+    it->second.export_to(filename, out);
+    return true;
+}
+
+bool MetadataTable::update(const std::string& filename, int64_t filesize, int64_t mtime,
+                           int64_t* new_filesize, int64_t* new_mtime, const Hook& on_applied) {
+    Stripe& stripe = stripe_for(filename);
+    std::shared_lock<std::shared_mutex> lock(stripe.mutex);
+    auto it = stripe.files.find(filename);
+    if (it == stripe.files.end()) {
+        return false;
+    }
+    Entry& entry = it->second;
+
+    int64_t current = entry.filesize.load(std::memory_order_relaxed);
+    while (current < filesize &&
+           !entry.filesize.compare_exchange_weak(current, filesize, std::memory_order_acq_rel)) {
+    }
+    int64_t current_mtime = entry.mtime.load(std::memory_order_relaxed);
+    while (current_mtime < mtime &&
+           !entry.mtime.compare_exchange_weak(current_mtime, mtime, std::memory_order_acq_rel)) {
+    }
+
+    *new_filesize = std::max(current, filesize);
+    *new_mtime = std::max(current_mtime, mtime);
+    if (on_applied) {
+        on_applied();
+    }
+    return true;
+}
+
+bool MetadataTable::remove(const std::string& filename, const Hook& on_applied,
+                           pfsmeta::FileMetadata* removed) {
+    Stripe& stripe = stripe_for(filename);
+    std::unique_lock<std::shared_mutex> lock(stripe.mutex);
+    auto it = stripe.files.find(filename);
+    if (it == stripe.files.end()) {
+        return false;
+    }
+    if (removed) {
+        it->second.export_to(filename, removed);
+    }
+    stripe.files.erase(it);
+    num_files.fetch_sub(1, std::memory_order_relaxed);
+    index_remove(filename);
+    if (on_applied) {
+        on_applied();
+    }
+    return true;
+}
+
+void MetadataTable::create_batch(const std::vector<pfsmeta::FileMetadata>& files, std::vector<char>* ok,
+                                 const BatchHook& on_applied) {
+    ok->assign(files.size(), 0);
+    auto groups = group_by_stripe(files.size(), [&](size_t i) -> const std::string& { return files[i].filename(); });
+    for (size_t s = 0; s < groups.size(); ++s) {
+        if (groups[s].empty()) {
+            continue;
+        }
+        std::vector<const pfsmeta::FileMetadata*> entry_layouts;
+        for (size_t i : groups[s]) {
+            entry_layouts.push_back(intern_layout(files[i]));
+        }
+
+        std::unique_lock<std::shared_mutex> lock(stripes[s]->mutex);
+        for (size_t k = 0; k < groups[s].size(); ++k) {
+            size_t i = groups[s][k];
+            if (!stripes[s]->files.try_emplace(files[i].filename(), files[i], entry_layouts[k]).second) {
+                continue;
+            }
+            num_files.fetch_add(1, std::memory_order_relaxed);
+            index_add(files[i].filename());
+            (*ok)[i] = 1;
+            if (on_applied) {
+                on_applied(i);
+            }
+        }
+    }
+}
+
+void MetadataTable::fetch_batch(const std::vector<std::string>& filenames, std::vector<pfsmeta::FileMetadata>* out,
+                                std::vector<char>* ok) const {
+    out->resize(filenames.size());
+    ok->assign(filenames.size(), 0);
+    auto groups = group_by_stripe(filenames.size(), [&](size_t i) -> const std::string& { return filenames[i]; });
+    for (size_t s = 0; s < groups.size(); ++s) {
+        if (groups[s].empty()) {
+            continue;
+        }
+        std::shared_lock<std::shared_mutex> lock(stripes[s]->mutex);
+        for (size_t i : groups[s]) {
+            auto it = stripes[s]->files.find(filenames[i]);
+            if (it == stripes[s]->files.end()) {
+                continue;
+            }
+            it->second.export_to(filenames[i], &(*out)[i]);
+            (*ok)[i] = 1;
+        }
+    }
+}
+
+void MetadataTable::remove_batch(const std::vector<std::string>& filenames, std::vector<char>* ok,
+                                 const BatchHook& on_applied) {
+    ok->assign(filenames.size(), 0);
+    auto groups = group_by_stripe(filenames.size(), [&](size_t i) -> const std::string& { return filenames[i]; });
+    for (size_t s = 0; s < groups.size(); ++s) {
+        if (groups[s].empty()) {
+            continue;
+        }
+        std::unique_lock<std::shared_mutex> lock(stripes[s]->mutex);
+        for (size_t i : groups[s]) {
+            if (stripes[s]->files.erase(filenames[i]) == 0) {
+                continue;
+            }
+            num_files.fetch_sub(1, std::memory_order_relaxed);
+            index_remove(filenames[i]);
+            (*ok)[i] = 1;
+            if (on_applied) {
+                on_applied(i);
+            }
+        }
+    }
+}
+
+void MetadataTable::for_each(const std::function<void(const pfsmeta::FileMetadata&)>& fn) const {
+    pfsmeta::FileMetadata metadata;
+    for (const auto& stripe : stripes) {
+        std::shared_lock<std::shared_mutex> lock(stripe->mutex);
+        for (const auto& [filename, entry] : stripe->files) {
+            entry.export_to(filename, &metadata);
+            fn(metadata);
+        }
+    }
+}
+
+void MetadataTable::index_add(const std::string& filename) {
+    std::unique_lock<std::shared_mutex> lock(index_mutex);
+    children[parentPath(filename)].insert(baseName(filename));
+}
+
+void MetadataTable::index_remove(const std::string& filename) {
+    std::unique_lock<std::shared_mutex> lock(index_mutex);
+    auto it = children.find(parentPath(filename));
+    if (it == children.end()) {
+        return;
+    }
+    it->second.erase(baseName(filename));
+    if (it->second.empty()) {
+        children.erase(it);
+    }
+}
+
+bool MetadataTable::has_children(const std::string& path) const {
+    std::shared_lock<std::shared_mutex> lock(index_mutex);
+    return children.count(path) != 0;
+}
+
+bool MetadataTable::list(const std::string& path, std::string* cursor, size_t max,
+                         const std::function<void(const pfsmeta::FileMetadata&)>& fn) const {
+    std::vector<std::string> names;
+    {
+        std::shared_lock<std::shared_mutex> lock(index_mutex);
+        auto dir = children.find(path);
+        if (dir == children.end()) {
+            return false;
+        }
+        for (auto it = dir->second.upper_bound(*cursor); it != dir->second.end() && names.size() < max; ++it) {
+            names.push_back(*it);
+        }
+    }
+
+    // Entries dropped since the index was read are skipped
+    pfsmeta::FileMetadata metadata;
+    for (const auto& name : names) {
+        if (fetch(path.empty() ? name : path + "/" + name, &metadata)) {
+            fn(metadata);
+        }
+    }
+    if (!names.empty()) {
+        *cursor = names.back();
+    }
+    return names.size() == max;
+}
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "pfs_proto/pfs_metaserver.pb.h"
+
+// The metadata server's file table, split into lock stripes by filename
+// hash. Creating or deleting a file takes one stripe's lock exclusively;
+// everything else takes it shared, so lookups never wait for each other and
+// only contend with namespace changes that hash to the same stripe.
+//
+// Each file is a small fixed-size record keyed by its name. The size and
+// mtime change on every client write; they are atomics, so UpdateMetadata
+// applies them under the shared lock with a fetch-max each. Layouts
+// are interned: all files striped the same way point at one copy, which
+// lives as long as the table.
+//
+// Mutations take an optional on_applied callback that runs under the stripe
+// lock right after the change, so a journal records each change before any
+// that depends on it. Updates run under the shared lock and may reach the
+// journal out of order; since both fields only ever grow, replaying them
+// in any order ends at the same size and mtime.
+//
+// Every directory with entries in the table has an ordered index of their
+// names, so a listing is a walk over a sorted set rather than a scan of the
+// table. The index has its own lock, taken after a stripe's when a file is
+// added or dropped and never held while a stripe lock is taken.
+class MetadataTable {
+public:
+    using Hook = std::function<void()>;
+
+    explicit MetadataTable(size_t num_stripes);
+
+    // Add the file; false if it already exists
+    bool create(const pfsmeta::FileMetadata& metadata, const Hook& on_applied = nullptr);
+
+    // Add or replace the file; used when rebuilding the table at startup
+    void load(const pfsmeta::FileMetadata& metadata);
+
+    bool contains(const std::string& filename) const;
+
+    // Copy the file's current metadata into out; false if it does not exist
+    bool fetch(const std::string& filename, pfsmeta::FileMetadata* out) const;
+
+    // Grow the size to at least filesize and the mtime to at least mtime.
+    // Reports the resulting values; false if the file does not exist.
+    bool update(const std::string& filename, int64_t filesize, int64_t mtime,
+                int64_t* new_filesize, int64_t* new_mtime, const Hook& on_applied = nullptr);
+
+    // Drop the file, copying its last metadata into removed if given; false
+    // if it does not exist
+    bool remove(const std::string& filename, const Hook& on_applied = nullptr,
+                pfsmeta::FileMetadata* removed = nullptr);
+
+    // Batched forms of create, fetch and remove. Entries are grouped by
+    // stripe and each stripe's lock is taken once for all of its entries.
+    // (*ok)[i] reports entry i, and on_applied(i) runs under the lock right
+    // after entry i was applied.
+    using BatchHook = std::function<void(size_t)>;
+    void create_batch(const std::vector<pfsmeta::FileMetadata>& files, std::vector<char>* ok,
+                      const BatchHook& on_applied = nullptr);
+    void fetch_batch(const std::vector<std::string>& filenames, std::vector<pfsmeta::FileMetadata>* out,
+                     std::vector<char>* ok) const;
+    void remove_batch(const std::vector<std::string>& filenames, std::vector<char>* ok,
+                      const BatchHook& on_applied = nullptr);
+
+    // Whether the table holds anything below directory path
+    bool has_children(const std::string& path) const;
+
+    // Call fn with the metadata of the next max entries of directory path
+    // whose names sort after *cursor, in name order, and move *cursor past
+    // them. False once the directory has no entries left after the cursor.
+    bool list(const std::string& path, std::string* cursor, size_t max,
+              const std::function<void(const pfsmeta::FileMetadata&)>& fn) const;
+
+    // Call fn with a consistent copy of each file's metadata, one stripe at a
+    // time; changes to other stripes may land while it runs
+    void for_each(const std::function<void(const pfsmeta::FileMetadata&)>& fn) const;
+
+    size_t size() const { return num_files.load(std::memory_order_relaxed); }
+
+private:
+    struct Entry {
+        uint64_t handle;
+        int64_t ctime;
+        std::atomic<int64_t> filesize;
+        std::atomic<int64_t> mtime;
+        const pfsmeta::FileMetadata* layout;  // Interned; only the layout fields are set
+        int32_t durability;
+        bool directory;
+
+        Entry(const pfsmeta::FileMetadata& metadata, const pfsmeta::FileMetadata* layout);
+        void assign(const pfsmeta::FileMetadata& metadata, const pfsmeta::FileMetadata* layout);
+        void export_to(const std::string& filename, pfsmeta::FileMetadata* out) const;
+    };
+
+    struct Stripe {
+        mutable std::shared_mutex mutex;
+        std::unordered_map<std::string, Entry> files;
+    };
+
+    // The shared copy of metadata's layout
+    const pfsmeta::FileMetadata* intern_layout(const pfsmeta::FileMetadata& metadata);
+
+    Stripe& stripe_for(const std::string& filename) const;
+    size_t stripe_index(const std::string& filename) const;
+    std::vector<std::vector<size_t>> group_by_stripe(size_t count,
+                                                     const std::function<const std::string&(size_t)>& name_of) const;
+    void index_add(const std::string& filename);
+    void index_remove(const std::string& filename);
+
+    std::vector<std::unique_ptr<Stripe>> stripes;
+    mutable std::shared_mutex index_mutex;
+    std::unordered_map<std::string, std::set<std::string>> children;  // Directory path -> entry names
+    std::atomic<size_t> num_files{0};
+    std::mutex layout_mutex;
+    std::unordered_map<std::string, std::unique_ptr<pfsmeta::FileMetadata>> layouts;  // Keyed by serialized layout
+};
@@ -1,26 +1,74 @@
 #include "pfs_metaserver.hpp"
+#include "pfs_token_manager.hpp"
+#include "pfs_metadata_table.hpp"
+#include "pfs_metadata_journal.hpp"
+#include "pfs_revocation.hpp"
+#include "pfs_sessions.hpp"
+#include "pfs_handoff.hpp"
+#include "pfs_placement.hpp"
+#include "pfs_rendezvous.hpp"
 #include "pfs_proto/pfs_metaserver.pb.h"
 #include "pfs_proto/pfs_metaserver.grpc.pb.h"
 #include <grpcpp/grpcpp.h>
 #include <iostream>
+#include <algorithm>
 #include <unordered_map>
+#include <atomic>
+#include <chrono>
 #include <mutex>
+#include <set>
 #include <fstream>
 #include <shared_mutex>
 
 
+// One shard of the namespace: the files whose names hash to shard_id on the
+// ShardMap of all metadata servers, with their tokens and the sessions of
+// the clients using them
 class MetadataServerServiceImpl final : public pfsmeta::MetadataServer::Service {
 public:
-    std::shared_mutex metadata_mutex;  
-    std::unordered_map<std::string, pfsmeta::FileMetadata> file_metadata_map; 
-    std::shared_mutex token_table_mutex; 
-    std::unordered_map<std::string, std::vector<Token>> token_table; 
-    std::mutex revoke_mutex; 
-    std::vector<Token> revoke_tokens; 
+    const int shard_id;
+    const ShardMap shard_map;
+    MetadataTable metadata_table{PFS_METADATA_STRIPES};
+    MetadataJournal journal;  // Recovers metadata_table
+    TokenManager token_manager{PFS_TOKEN_SHARDS};
+    RevocationEngine revocation{token_manager};
+    SessionTable sessions{[this](int client_id) { revocation.drop_client(client_id); }};
+    std::atomic<uint64_t> next_sequence{1};
+    std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+    std::vector<std::unique_ptr<pfsmeta::MetadataServer::Stub>> peers;  // Every shard, this one included
+    std::unique_ptr<ShardHandoff> handoff;
+    StripePlacer placer;  // Picks the file servers of new files
+    GroupRendezvous rendezvous;  // Collective I/O groups waiting for their members
+    // Directories of this shard whose delete is under way. A delete marks
+    // the directory here before checking that it is empty, and a create
+    // checks its parent again once its own entry is in, so one of the two
+    // always sees the other and nothing is left under a deleted directory.
+    std::mutex deleting_mutex;
+    std::set<std::string> deleting;
     //std::unordered_map<int, FileDescriptor> open_files;  
 
-    MetadataServerServiceImpl() {
-        std::cout << "[INFO] MetadataServerServiceImpl initialized." << std::endl;
+    MetadataServerServiceImpl(const std::vector<std::string>& metaservers, int shard,
+                              const std::vector<std::string>& file_servers)
+        : shard_id(shard), shard_map(static_cast<int>(metaservers.size())),
+          journal(shard == 0 ? "./pfs_metadata" : "./pfs_metadata-" + std::to_string(shard), metadata_table,
+                  shard),
+          placer(file_servers) {
+        // Handles are never reused, so continue after the largest one this
+        // shard ever created, deleted files included
+        next_sequence = journal.handle_mark() + 1;
+        metadata_table.for_each([this](const pfsmeta::FileMetadata& metadata) {
+            if (handleShard(metadata.handle()) == shard_id && handleSequence(metadata.handle()) >= next_sequence) {
+                next_sequence = handleSequence(metadata.handle()) + 1;
+            }
+        });
+        for (const auto& address : metaservers) {
+            peers.push_back(pfsmeta::MetadataServer::NewStub(
+                grpc::CreateChannel(address, grpc::InsecureChannelCredentials())));
+        }
+        handoff = std::make_unique<ShardHandoff>(shard_id, shard_map, peers, metadata_table, journal,
+                                                 token_manager);
+        std::cout << "[INFO] MetadataServerServiceImpl initialized as shard " << shard_id << " of "
+                  << shard_map.size() << "." << std::endl;
     }
 
     virtual ~MetadataServerServiceImpl() {
@@ -32,8 +80,8 @@ public:
                             pfsmeta::InitializeResponse* response) override {
         std::cout << "[DEBUG] Received Initialize request from: " << context->peer() << std::endl;
 
-        static int client_id_counter = 1;
-        response->set_client_id(client_id_counter++);
+        response->set_client_id(sessions.open());
+        response->set_lease_ms(PFS_LEASE_MS);
 
         std::cout << "[DEBUG] Assigned Client ID: " << response->client_id()
                   << " to client at " << context->peer() << std::endl;
@@ -52,44 +100,204 @@ public:
         return grpc::Status::OK;
     }
 
+    // Check a create request and fill in the metadata of the new file; false
+    // with *error set if it cannot be created. parents caches directory
+    // lookups across the entries of a batch.
+    bool prepare_create(const pfsmeta::CreateFileRequest& request, pfsmeta::FileMetadata* metadata,
+                        std::string* error, std::unordered_map<std::string, bool>* parents) {
+        const std::string& filename = request.filename();
+        int stripe_width = request.stripe_width();
+        int durability = request.durability();
+        bool directory = request.directory();
+        int64_t stripe_unit = request.stripe_unit() != 0 ? request.stripe_unit() : PFS_STRIPE_UNIT;
+        int stripe_blocks = request.stripe_blocks() != 0 ? request.stripe_blocks() : STRIPE_BLOCKS;
+
+        if (!validPath(filename) || (!directory && (stripe_width <= 0 || stripe_width > NUM_FILE_SERVERS ||
+                                           stripe_width > placer.size()))) {
+            *error = "Invalid filename or stripe width.";
+            return false;
+        }
+        if (!directory && (durability < PFS_DURABILITY_NONE || durability > PFS_DURABILITY_EVERY_WRITE)) {
+            *error = "Invalid durability policy.";
+            return false;
+        }
+        if (!directory && (stripe_unit < PFS_BLOCK_SIZE || stripe_unit > PFS_MAX_STRIPE_UNIT ||
+                           stripe_blocks < 1 || stripe_blocks > PFS_MAX_STRIPE_BLOCKS)) {
+            *error = "Invalid stripe unit.";
+            return false;
+        }
+        if (shard_map.owner(filename) != shard_id) {
+            *error = "File belongs to metadata shard " + std::to_string(shard_map.owner(filename)) + ".";
+            return false;
+        }
+        std::string parent = parentPath(filename);
+        auto cached = parents->find(parent);
+        if (cached == parents->end()) {
+            cached = parents->emplace(parent, is_directory(parent)).first;
+        }
+        if (!cached->second) {
+            *error = "No such directory: " + parent;
+            return false;
+        }
+
+        metadata->set_filename(filename);
+        metadata->set_filesize(0); // File size is 0 at creation
+        metadata->set_ctime(std::time(nullptr));
+        metadata->set_mtime(0); // Not closed yet
+        if (directory) {
+            // Directories have no data, so no handle or recipe either
+            metadata->set_directory(true);
+        } else {
+            metadata->set_stripe_width(stripe_width);
+            metadata->set_durability(durability);
+            metadata->set_stripe_unit(stripe_unit);
+            metadata->set_stripe_blocks(stripe_blocks);
+            metadata->set_handle(makeFileHandle(shard_id, next_sequence++));
+            populate_file_layout(*metadata, stripe_width);
+        }
+        return true;
+    }
+
     grpc::Status CreateFile(grpc::ServerContext* context,
                             const pfsmeta::CreateFileRequest* request,
                             pfsmeta::CreateFileResponse* response) override {
         const std::string& filename = request->filename();
         int stripe_width = request->stripe_width();
 
-
-        std::unique_lock<std::shared_mutex> lock(metadata_mutex);
-
-        if (filename.empty() || stripe_width <= 0 || stripe_width > NUM_FILE_SERVERS) {
+        pfsmeta::FileMetadata metadata;
+        std::string error;
+        std::unordered_map<std::string, bool> parents;
+        if (!prepare_create(*request, &metadata, &error, &parents)) {
             response->set_success(false);
-            response->set_message("Invalid filename or stripe width.");
+            response->set_message(error);
             return grpc::Status::OK;
         }
 
-        if (file_metadata_map.find(filename) != file_metadata_map.end()) {
+        uint64_t ticket = 0;
+        if (!metadata_table.create(metadata, [&]() {
+                ticket = journal.append(MetadataJournal::RECORD_CREATE, metadata);
+            })) {
             response->set_success(false);
             response->set_message("File already exists.");
             return grpc::Status::OK;
         }
+        // The parent may have been deleted since prepare_create() looked
+        std::string parent = parentPath(filename);
+        if (!is_directory(parent)) {
+            metadata_table.remove(filename, [&]() {
+                pfsmeta::FileMetadata record;
+                record.set_filename(filename);
+                ticket = journal.append(MetadataJournal::RECORD_DELETE, record);
+            });
+            journal.wait_durable(ticket);
+            response->set_success(false);
+            response->set_message("No such directory: " + parent);
+            return grpc::Status::OK;
+        }
+        if (!journal.wait_durable(ticket)) {
+            response->set_success(false);
+            response->set_message("Failed to persist file metadata.");
+            return grpc::Status::OK;
+        }
 
+        response->set_success(true);
+        response->set_message("File created successfully.");
+        response->set_handle(metadata.handle());
+        std::cout << "[INFO] File '" << filename << "' created with stripe width " << stripe_width << "." << std::endl;
 
-        pfsmeta::FileMetadata metadata;
-        metadata.set_filename(filename);
-        metadata.set_filesize(0); // File size is 0 at creation
-        metadata.set_ctime(std::time(nullptr));
-        metadata.set_mtime(0); // Not closed yet
-        metadata.set_stripe_width(stripe_width);
+        return grpc::Status::OK;
+    }
 
-  
-        populate_file_recipes(metadata, stripe_width);
+    // Mark path as being deleted; false if another delete of it is under way
+    bool mark_deleting(const std::string& path) {
+        std::lock_guard<std::mutex> lock(deleting_mutex);
+        return deleting.insert(path).second;
+    }
 
-        file_metadata_map[filename] = metadata;
+    void unmark_deleting(const std::string& path) {
+        std::lock_guard<std::mutex> lock(deleting_mutex);
+        deleting.erase(path);
+    }
 
-        response->set_success(true);
-        response->set_message("File created successfully.");
-        std::cout << "[INFO] File '" << filename << "' created with stripe width " << stripe_width << "." << std::endl;
+    bool is_deleting(const std::string& path) {
+        std::lock_guard<std::mutex> lock(deleting_mutex);
+        return deleting.count(path) != 0;
+    }
+
+    // Whether path names a directory that is not being deleted, asking the
+    // shard that holds it if that is not this one
+    bool is_directory(const std::string& path) {
+        if (path.empty()) {
+            return true;  // The root
+        }
+        int owner = shard_map.owner(path);
+        if (owner == shard_id) {
+            pfsmeta::FileMetadata metadata;
+            return !is_deleting(path) && metadata_table.fetch(path, &metadata) && metadata.directory();
+        }
+
+        pfsmeta::FetchMetadataRequest request;
+        pfsmeta::FetchMetadataResponse response;
+        request.set_filename(path);
+        grpc::ClientContext context;
+        grpc::Status status = peers[owner]->FetchMetadata(&context, request, &response);
+        return status.ok() && response.success() && response.metadata().directory();
+    }
+
+    // Entries of a directory may live on any shard, so all are asked
+    bool directory_empty(const std::string& path, std::string* error) {
+        if (metadata_table.has_children(path)) {
+            return false;
+        }
+        for (int shard = 0; shard < shard_map.size(); ++shard) {
+            if (shard == shard_id) {
+                continue;
+            }
+            pfsmeta::ReadDirRequest request;
+            request.set_path(path);
+            request.set_limit(1);
+            grpc::ClientContext context;
+            auto reader = peers[shard]->ReadDirPlus(&context, request);
+            pfsmeta::DirPage page;
+            bool found = false;
+            while (reader->Read(&page)) {
+                found = found || page.entries_size() > 0;
+            }
+            grpc::Status status = reader->Finish();
+            if (!status.ok()) {
+                *error = "Cannot reach metadata shard " + std::to_string(shard) + ".";
+                return false;
+            }
+            if (found) {
+                return false;
+            }
+        }
+        return true;
+    }
 
+    grpc::Status ReadDirPlus(grpc::ServerContext* context,
+                             const pfsmeta::ReadDirRequest* request,
+                             grpc::ServerWriter<pfsmeta::DirPage>* writer) override {
+        std::string cursor = request->start_after();
+        uint64_t remaining = request->limit() > 0 ? request->limit() : UINT64_MAX;
+        bool more = true;
+        while (more && remaining > 0 && !context->IsCancelled()) {
+            pfsmeta::DirPage page;
+            more = metadata_table.list(request->path(), &cursor, std::min<uint64_t>(PFS_READDIR_PAGE, remaining),
+                                       [&](const pfsmeta::FileMetadata& metadata) {
+                auto* entry = page.add_entries();
+                entry->set_name(baseName(metadata.filename()));
+                entry->set_directory(metadata.directory());
+                entry->set_filesize(metadata.filesize());
+                entry->set_ctime(metadata.ctime());
+                entry->set_mtime(metadata.mtime());
+                entry->set_handle(metadata.handle());
+            });
+            remaining -= page.entries_size();
+            if (page.entries_size() > 0 && !writer->Write(page)) {
+                break;
+            }
+        }
         return grpc::Status::OK;
     }
 
@@ -98,17 +306,19 @@ public:
                                pfsmeta::FetchMetadataResponse* response) override {
         const std::string& filename = request->filename();
 
-        std::shared_lock<std::shared_mutex> lock(metadata_mutex);
-
-        auto it = file_metadata_map.find(filename);
-        if (it == file_metadata_map.end()) {
+        if (is_deleting(filename)) {
+            response->set_success(false);
+            response->set_message("Directory is being deleted.");
+            return grpc::Status::OK;
+        }
+        if (!metadata_table.fetch(filename, response->mutable_metadata())) {
+            response->clear_metadata();
             response->set_success(false);
             response->set_message("File not found.");
             return grpc::Status::OK;
         }
 
         response->set_success(true);
-        response->mutable_metadata()->CopyFrom(it->second);
         std::cout << "[INFO] Metadata fetched for file: " << filename << std::endl;
 
         return grpc::Status::OK;
@@ -119,52 +329,117 @@ public:
         pfsmeta::TokenRequest request;
         while (stream->Read(&request)) {
             int client_id = request.client_id();
+            bool live = sessions.renew(client_id);
             int fd = request.fd();
-            std::string filename = request.filename();
+            FileHandle handle = request.handle();
             int64_t start_byte = request.start_byte();
             int64_t end_byte = request.end_byte();
-            int token_type = (request.token_type() == "READ") ? 1 : 2;
-
-            std::string token_close = request.token_type();
+            int token_type = (request.token_type() == pfsmeta::TOKEN_OP_READ) ? TOKEN_READ : TOKEN_WRITE;
 
-        if (token_close == "CLOSE") {
+        if (request.token_type() == pfsmeta::TOKEN_OP_CLOSE) {
 
-            std::cout << "[INFO] Client " << client_id << " requested to close file: " << filename << std::endl;
+            std::cout << "[INFO] Client " << client_id << " requested to close file: " << handle << std::endl;
 
 
-            release_tokens(client_id, filename);
+            release_tokens(client_id, handle);
             pfsmeta::TokenResponse response;
             response.set_client_id(client_id);
-            response.set_filename(filename);
-            response.set_token_action("ACK");
+            response.set_handle(handle);
+            response.set_token_action(pfsmeta::TOKEN_ACTION_ACK);
             stream->Write(response);
 
-            std::cout << "[INFO] File: " << filename << " successfully closed for client_id: " << client_id << std::endl;
+            std::cout << "[INFO] File: " << handle << " successfully closed for client_id: " << client_id << std::endl;
             continue; 
         }
 
-            Token requested_token{client_id, -1, filename, token_type, start_byte, end_byte};
-            std::vector<Token> granted_tokens, conflicting_tokens;
+            // Closing needs no session; everything else does
+            if (!live) {
+                return grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, "Session expired");
+            }
 
-            {
-                std::unique_lock<std::shared_mutex> lock(token_table_mutex);
-                auto& tokens = token_table[filename];
+            // The conflicting ranges are already out of the table; grant
+            // once their holders have let go of them
+            TokenDecision decision = token_manager.request(handle, client_id, token_type, start_byte, end_byte);
+            revocation.revoke(decision.revoked);
+            if (!still_alive(client_id)) {
+                return grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, "Session expired");
+            }
+            grant_tokens(stream, {decision.granted});
+        }
+        return grpc::Status::OK;
+    }
+
+    grpc::Status RequestTokens(grpc::ServerContext* context,
+                               const pfsmeta::TokenBatchRequest* request,
+                               pfsmeta::TokenBatchResponse* response) override {
+        if (!sessions.renew(request->client_id())) {
+            response->set_success(false);
+            response->set_error_message("Session expired.");
+            return grpc::Status::OK;
+        }
 
-                split_tokens(tokens, requested_token, conflicting_tokens);
-                consolidate_token_ranges(tokens, requested_token, granted_tokens);
+        std::vector<Token> wants;
+        for (const auto& range : request->ranges()) {
+            if (range.handle() == 0 || range.start_byte() < 0 || range.end_byte() < range.start_byte() ||
+                (range.token_type() != pfsmeta::TOKEN_OP_READ && range.token_type() != pfsmeta::TOKEN_OP_WRITE)) {
+                response->set_success(false);
+                response->set_error_message("Invalid token range for file: " + std::to_string(range.handle()));
+                return grpc::Status::OK;
             }
+            int token_type = (range.token_type() == pfsmeta::TOKEN_OP_READ) ? TOKEN_READ : TOKEN_WRITE;
+            wants.emplace_back(request->client_id(), -1, range.handle(), token_type,
+                               range.start_byte(), range.end_byte());
+            wants.back().exact = range.exact();
+        }
 
-            grant_tokens(stream, granted_tokens);
-            revoke_tokens_and_wait_for_ack(stream, conflicting_tokens);
+        // One revocation round for the whole batch
+        std::vector<TokenDecision> decisions = token_manager.request_batch(wants);
+        std::vector<Token> revoked;
+        for (const auto& decision : decisions) {
+            revoked.insert(revoked.end(), decision.revoked.begin(), decision.revoked.end());
         }
+        revocation.revoke(revoked);
+        if (!still_alive(request->client_id())) {
+            response->set_success(false);
+            response->set_error_message("Session expired.");
+            return grpc::Status::OK;
+        }
+
+        for (const auto& decision : decisions) {
+            auto* granted = response->add_granted();
+            granted->set_handle(decision.granted.handle);
+            granted->set_start_byte(decision.granted.start_byte);
+            granted->set_end_byte(decision.granted.end_byte);
+            granted->set_token_type(decision.granted.token_type == TOKEN_READ ? pfsmeta::TOKEN_OP_READ
+                                                                              : pfsmeta::TOKEN_OP_WRITE);
+        }
+        response->set_success(true);
         return grpc::Status::OK;
     }
-    void release_tokens(int client_id, const std::string& filename) {
-        std::unique_lock<std::shared_mutex> lock(token_table_mutex);
-        auto& tokens = token_table[filename];
-        tokens.erase(std::remove_if(tokens.begin(), tokens.end(),
-                                    [client_id](const Token& token) { return token.client_id == client_id; }),
-                     tokens.end());
+
+    grpc::Status Callbacks(grpc::ServerContext* context, CallbackStream* stream) override {
+        pfsmeta::TokenRequest request;
+        if (!stream->Read(&request) || request.token_type() != pfsmeta::TOKEN_OP_REGISTER) {
+            return grpc::Status(grpc::StatusCode::INVALID_ARGUMENT, "Callback stream must start with REGISTER");
+        }
+        if (!sessions.renew(request.client_id())) {
+            return grpc::Status(grpc::StatusCode::FAILED_PRECONDITION, "Session expired");
+        }
+        revocation.serve(request.client_id(), context, stream);
+        return grpc::Status::OK;
+    }
+    void release_tokens(int client_id, FileHandle handle) {
+        token_manager.release(handle, client_id);
+    }
+
+    // Tokens granted after the reaper let go of an expired session's
+    // tokens would be held by nobody; give them back
+    bool still_alive(int client_id) {
+        if (sessions.alive(client_id)) {
+            return true;
+        }
+        token_manager.release_client(client_id);
+        return false;
     }
 
     grpc::Status UpdateMetadata(grpc::ServerContext* context,
@@ -174,129 +449,64 @@ public:
     int64_t new_filesize = request->filesize();
     int64_t new_mtime = request->mtime(); 
 
-
-    std::unique_lock<std::shared_mutex> lock(metadata_mutex);
-
-    auto it = file_metadata_map.find(filename);
-    if (it == file_metadata_map.end()) {
+    int64_t filesize, mtime;
+    uint64_t ticket = 0;
+    if (!metadata_table.update(filename, new_filesize, new_mtime, &filesize, &mtime, [&]() {
+            pfsmeta::FileMetadata record;
+            record.set_filename(filename);
+            record.set_filesize(filesize);
+            record.set_mtime(mtime);
+            ticket = journal.append(MetadataJournal::RECORD_UPDATE, record);
+        })) {
         response->set_success(false);
         response->set_message("File not found.");
         return grpc::Status::OK;
     }
-    auto& metadata = it->second;
-    metadata.set_filesize(std::max(metadata.filesize(), new_filesize));
-    if (new_mtime > 0) {
-        metadata.set_mtime(new_mtime);
+    if (!journal.wait_durable(ticket)) {
+        response->set_success(false);
+        response->set_message("Failed to persist file metadata.");
+        return grpc::Status::OK;
     }
 
     response->set_success(true);
     response->set_message("Metadata updated successfully.");
     std::cout << "[INFO] Metadata updated for file: " << filename
-              << ". New filesize: " << metadata.filesize()
-              << ", mtime: " << metadata.mtime() << "." << std::endl;
+              << ". New filesize: " << filesize
+              << ", mtime: " << mtime << "." << std::endl;
 
     return grpc::Status::OK;
 }
 
 
-    void populate_file_recipes(pfsmeta::FileMetadata& metadata, int stripe_width) {
-        int64_t range_start = 0;
-        int64_t stripe_size = PFS_BLOCK_SIZE; // Assume block size for each stripe
-
-        for (int i = 0; i < stripe_width; ++i) {
-            auto* recipe = metadata.add_recipes();
-            recipe->set_file_server_address("FileServer-" + std::to_string(i));
-            recipe->set_range_start(range_start);
-            recipe->set_range_end(range_start + stripe_size - 1);
-            range_start += stripe_size;
-        }
-    }
-    bool conflicts_with_existing_token(const Token& existing, const Token& requested) {
-        return existing.filename == requested.filename &&
-               existing.end_byte >= requested.start_byte &&
-               existing.start_byte <= requested.end_byte &&
-               (existing.token_type == 2 || requested.token_type == 2); // WRITE conflicts with READ/WRITE
-    }
-    void split_tokens(std::vector<Token>& tokens, const Token& requested, std::vector<Token>& conflicting_tokens) {
-        for (auto it = tokens.begin(); it != tokens.end();) {
-            Token& existing = *it;
-            if (conflicts_with_existing_token(existing, requested)) {
-                conflicting_tokens.push_back(existing);
-
-                it = tokens.erase(it);
-
-                if (existing.start_byte < requested.start_byte) {
-                    tokens.push_back({existing.client_id, existing.fd, existing.filename, existing.token_type,
-                                      existing.start_byte, requested.start_byte - 1});
-                }
-                if (existing.end_byte > requested.end_byte) {
-                    tokens.push_back({existing.client_id, existing.fd, existing.filename, existing.token_type,
-                                      requested.end_byte + 1, existing.end_byte});
+    // Describe the servers placement chose as a formula, or list them when
+    // placement skipped some
+    void populate_file_layout(pfsmeta::FileMetadata& metadata, int stripe_width) {
+        std::vector<int> servers = placer.place(stripe_width);
+        metadata.set_start_server(servers[0]);
+        metadata.set_server_count(placer.size());
+        for (int k = 0; k < stripe_width; ++k) {
+            if (servers[k] != (servers[0] + k) % placer.size()) {
+                for (int server : servers) {
+                    metadata.add_servers(server);
                 }
-            } else {
-                ++it;
-            }
-        }
-    }
-    void consolidate_token_ranges(std::vector<Token>& tokens, const Token& new_token,
-                                   std::vector<Token>& granted_tokens) {
-        for (auto& token : tokens) {
-            if (token.token_type == new_token.token_type && token.filename == new_token.filename &&
-                token.end_byte >= new_token.start_byte && token.start_byte <= new_token.end_byte) {
-                token.start_byte = std::min(token.start_byte, new_token.start_byte);
-                token.end_byte = std::max(token.end_byte, new_token.end_byte);
-                granted_tokens.push_back(token);
-                return;
+                break;
             }
         }
-        tokens.push_back(new_token);
-        granted_tokens.push_back(new_token);
     }
     void grant_tokens(grpc::ServerReaderWriter<pfsmeta::TokenResponse, pfsmeta::TokenRequest>* stream,
                       const std::vector<Token>& granted_tokens) {
         for (const auto& token : granted_tokens) {
             pfsmeta::TokenResponse response;
             response.set_client_id(token.client_id);
-            response.set_filename(token.filename);
+            response.set_handle(token.handle);
             response.set_start_byte(token.start_byte);
             response.set_end_byte(token.end_byte);
-            response.set_token_action("GRANT");
+            response.set_token_action(pfsmeta::TOKEN_ACTION_GRANT);
 
             stream->Write(response);
         }
     }
 
-    void revoke_tokens_and_wait_for_ack(
-        grpc::ServerReaderWriter<pfsmeta::TokenResponse, pfsmeta::TokenRequest>* stream,
-        const std::vector<Token>& conflicting_tokens) {
-        for (const auto& token : conflicting_tokens) {
-            pfsmeta::TokenResponse revoke_msg;
-            revoke_msg.set_client_id(token.client_id);
-            revoke_msg.set_filename(token.filename);
-            revoke_msg.set_start_byte(token.start_byte);
-            revoke_msg.set_end_byte(token.end_byte);
-            revoke_msg.set_token_action("REVOKE");
-
-            stream->Write(revoke_msg);
-        }
-
-        while (!conflicting_tokens.empty()) {
-            pfsmeta::TokenRequest ack_request;
-            if (stream->Read(&ack_request) && ack_request.token_type() == "ACK") {
-                int64_t ack_start = ack_request.start_byte();
-                int64_t ack_end = ack_request.end_byte();
-
-                std::lock_guard<std::mutex> lock(revoke_mutex);
-                revoke_tokens.erase(std::remove_if(revoke_tokens.begin(), revoke_tokens.end(),
-                                                   [&](const Token& token) {
-                                                       return token.start_byte == ack_start &&
-                                                              token.end_byte == ack_end;
-                                                   }),
-                                    revoke_tokens.end());
-            }
-        }
-    }
-
 
 
 grpc::Status DeleteFile(grpc::ServerContext* context,
@@ -304,31 +514,234 @@ grpc::Status DeleteFile(grpc::ServerContext* context,
                         pfsmeta::DeleteFileResponse* response) override {
     const std::string& filename = request->filename();
 
-    std::unique_lock<std::shared_mutex> lock(metadata_mutex);
-    auto it = file_metadata_map.find(filename);
-    if (it == file_metadata_map.end()) {
+    pfsmeta::FileMetadata metadata;
+    if (!metadata_table.fetch(filename, &metadata)) {
         response->set_success(false);
         response->set_message("File not found.");
         return grpc::Status::OK;
     }
 
-    {
-        std::unique_lock<std::shared_mutex> token_lock(token_table_mutex);
-        if (!token_table[filename].empty()) {
-            response->set_success(false);
-            response->set_message("File is locked by active tokens.");
-            return grpc::Status::OK;
-        }
+    // Marked first, so no create slips in after the emptiness check
+    if (metadata.directory() && !mark_deleting(filename)) {
+        response->set_success(false);
+        response->set_message("Directory is being deleted.");
+        return grpc::Status::OK;
+    }
+    std::string error = "Directory not empty.";
+    if (metadata.directory() && !directory_empty(filename, &error)) {
+        unmark_deleting(filename);
+        response->set_success(false);
+        response->set_message(error);
+        return grpc::Status::OK;
+    }
+    if (!metadata.directory() && token_manager.has_tokens(metadata.handle())) {
+        response->set_success(false);
+        response->set_message("File is locked by active tokens.");
+        return grpc::Status::OK;
     }
 
-    file_metadata_map.erase(it);
+    uint64_t ticket = 0;
+    bool removed = metadata_table.remove(filename, [&]() {
+        pfsmeta::FileMetadata record;
+        record.set_filename(filename);
+        ticket = journal.append(MetadataJournal::RECORD_DELETE, record);
+    });
+    if (metadata.directory()) {
+        unmark_deleting(filename);
+    }
+    if (!removed) {
+        response->set_success(false);
+        response->set_message("File not found.");
+        return grpc::Status::OK;
+    }
+    if (!journal.wait_durable(ticket)) {
+        response->set_success(false);
+        response->set_message("Failed to persist file metadata.");
+        return grpc::Status::OK;
+    }
 
     response->set_success(true);
     response->set_message("File metadata deleted successfully.");
+    response->set_handle(metadata.handle());
     std::cout << "[INFO] Metadata for file '" << filename << "' deleted successfully." << std::endl;
     return grpc::Status::OK;
 }
 
+// The batched RPCs take each lock stripe once per batch and wait for a
+// single journal flush
+grpc::Status CreateFiles(grpc::ServerContext* context,
+                         const pfsmeta::CreateFilesRequest* request,
+                         pfsmeta::CreateFilesResponse* response) override {
+    if (request->files_size() > PFS_METADATA_BATCH) {
+        response->set_success(false);
+        response->set_message("More than " + std::to_string(PFS_METADATA_BATCH) + " entries in one batch.");
+        return grpc::Status::OK;
+    }
+
+    std::vector<pfsmeta::FileMetadata> files;
+    std::vector<int> slots;  // Request entry of each of files
+    std::unordered_map<std::string, bool> parents;
+    for (int i = 0; i < request->files_size(); ++i) {
+        auto* result = response->add_results();
+        pfsmeta::FileMetadata metadata;
+        std::string error;
+        if (!prepare_create(request->files(i), &metadata, &error, &parents)) {
+            result->set_message(error);
+            continue;
+        }
+        files.push_back(std::move(metadata));
+        slots.push_back(i);
+    }
+
+    std::vector<char> created;
+    uint64_t ticket = 0;
+    metadata_table.create_batch(files, &created, [&](size_t k) {
+        ticket = journal.append(MetadataJournal::RECORD_CREATE, files[k]);
+    });
+
+    // Entries whose parent was deleted since prepare_create() looked go again
+    std::unordered_map<std::string, bool> still_there;
+    std::vector<std::string> orphans;
+    std::vector<char> orphaned(files.size());
+    for (size_t k = 0; k < files.size(); ++k) {
+        if (!created[k]) {
+            continue;
+        }
+        std::string parent = parentPath(files[k].filename());
+        auto it = still_there.find(parent);
+        if (it == still_there.end()) {
+            it = still_there.emplace(parent, is_directory(parent)).first;
+        }
+        if (!it->second) {
+            orphans.push_back(files[k].filename());
+            orphaned[k] = 1;
+            created[k] = 0;
+        }
+    }
+    if (!orphans.empty()) {
+        std::vector<char> dropped;
+        metadata_table.remove_batch(orphans, &dropped, [&](size_t k) {
+            pfsmeta::FileMetadata record;
+            record.set_filename(orphans[k]);
+            ticket = journal.append(MetadataJournal::RECORD_DELETE, record);
+        });
+    }
+    bool durable = ticket == 0 || journal.wait_durable(ticket);
+
+    for (size_t k = 0; k < files.size(); ++k) {
+        auto* result = response->mutable_results(slots[k]);
+        if (orphaned[k]) {
+            result->set_message("No such directory: " + parentPath(files[k].filename()));
+        } else if (!created[k]) {
+            result->set_message("File already exists.");
+        } else if (!durable) {
+            result->set_message("Failed to persist file metadata.");
+        } else {
+            result->set_success(true);
+            result->set_handle(files[k].handle());
+        }
+    }
+    response->set_success(true);
+    std::cout << "[INFO] Created " << std::count(created.begin(), created.end(), 1) << " of "
+              << request->files_size() << " files in one batch." << std::endl;
+    return grpc::Status::OK;
+}
+
+grpc::Status StatFiles(grpc::ServerContext* context,
+                       const pfsmeta::StatFilesRequest* request,
+                       pfsmeta::StatFilesResponse* response) override {
+    if (request->filenames_size() > PFS_METADATA_BATCH) {
+        response->set_success(false);
+        response->set_message("More than " + std::to_string(PFS_METADATA_BATCH) + " entries in one batch.");
+        return grpc::Status::OK;
+    }
+
+    std::vector<std::string> filenames(request->filenames().begin(), request->filenames().end());
+    std::vector<pfsmeta::FileMetadata> files;
+    std::vector<char> found;
+    metadata_table.fetch_batch(filenames, &files, &found);
+    for (size_t i = 0; i < filenames.size(); ++i) {
+        auto* result = response->add_results();
+        if (found[i]) {
+            result->set_success(true);
+            result->set_handle(files[i].handle());
+            response->add_files()->Swap(&files[i]);
+        } else {
+            result->set_message("File not found.");
+            response->add_files();
+        }
+    }
+    response->set_success(true);
+    return grpc::Status::OK;
+}
+
+grpc::Status DeleteFiles(grpc::ServerContext* context,
+                         const pfsmeta::DeleteFilesRequest* request,
+                         pfsmeta::DeleteFilesResponse* response) override {
+    if (request->filenames_size() > PFS_METADATA_BATCH) {
+        response->set_success(false);
+        response->set_message("More than " + std::to_string(PFS_METADATA_BATCH) + " entries in one batch.");
+        return grpc::Status::OK;
+    }
+
+    std::vector<std::string> filenames(request->filenames().begin(), request->filenames().end());
+    std::vector<pfsmeta::FileMetadata> files;
+    std::vector<char> found;
+    metadata_table.fetch_batch(filenames, &files, &found);
+
+    std::vector<std::string> doomed;
+    std::vector<int> slots;  // Request entry of each of doomed
+    std::vector<std::string> marked;  // Directories, marked before their emptiness check
+    for (size_t i = 0; i < filenames.size(); ++i) {
+        auto* result = response->add_results();
+        std::string error = "Directory not empty.";
+        if (!found[i]) {
+            result->set_message("File not found.");
+        } else if (files[i].directory() && !mark_deleting(filenames[i])) {
+            result->set_message("Directory is being deleted.");
+        } else if (files[i].directory() && !directory_empty(filenames[i], &error)) {
+            unmark_deleting(filenames[i]);
+            result->set_message(error);
+        } else if (!files[i].directory() && token_manager.has_tokens(files[i].handle())) {
+            result->set_message("File is locked by active tokens.");
+        } else {
+            if (files[i].directory()) {
+                marked.push_back(filenames[i]);
+            }
+            doomed.push_back(filenames[i]);
+            slots.push_back(i);
+        }
+    }
+
+    std::vector<char> removed;
+    uint64_t ticket = 0;
+    metadata_table.remove_batch(doomed, &removed, [&](size_t k) {
+        pfsmeta::FileMetadata record;
+        record.set_filename(doomed[k]);
+        ticket = journal.append(MetadataJournal::RECORD_DELETE, record);
+    });
+    for (const auto& path : marked) {
+        unmark_deleting(path);
+    }
+    bool durable = ticket == 0 || journal.wait_durable(ticket);
+
+    for (size_t k = 0; k < doomed.size(); ++k) {
+        auto* result = response->mutable_results(slots[k]);
+        if (!removed[k]) {
+            result->set_message("File not found.");
+        } else if (!durable) {
+            result->set_message("Failed to persist file metadata.");
+        } else {
+            result->set_success(true);
+            result->set_handle(files[slots[k]].handle());
+        }
+    }
+    response->set_success(true);
+    std::cout << "[INFO] Deleted " << std::count(removed.begin(), removed.end(), 1) << " of "
+              << request->filenames_size() << " files in one batch." << std::endl;
+    return grpc::Status::OK;
+}
+
 grpc::Status ClientShutdown(
     grpc::ServerContext* context,
     const pfsmeta::ClientShutdownRequest* request,
@@ -337,12 +750,115 @@ grpc::Status ClientShutdown(
     int client_id = request->client_id();
     std::cout << "[INFO] Received shutdown request from Client ID: " << client_id << std::endl;
 
+    sessions.close(client_id);
+    revocation.drop_client(client_id);
+
     response->set_success(true);
     response->set_message("Client shutdown acknowledged.");
     std::cout << "[INFO] Client ID: " << client_id << " successfully shut down." << std::endl;
 
     return grpc::Status::OK;
 }
+
+// Files handed over by another shard. A file already here with the same
+// handle came from an earlier attempt, so it only takes the larger size and
+// later mtime. One with another handle was created under the same name
+// while the hand-off was on its way; the two are reported as a conflict
+// rather than merged.
+grpc::Status ImportFiles(grpc::ServerContext* context,
+                         const pfsmeta::ImportFilesRequest* request,
+                         pfsmeta::ImportFilesResponse* response) override {
+    uint64_t ticket = 0;
+    for (const auto& metadata : request->files()) {
+        if (shard_map.owner(metadata.filename()) != shard_id) {
+            response->set_success(false);
+            response->set_message("File '" + metadata.filename() + "' does not belong to metadata shard " +
+                                  std::to_string(shard_id) + ".");
+            return grpc::Status::OK;
+        }
+        if (metadata_table.create(metadata, [&]() {
+                ticket = journal.append(MetadataJournal::RECORD_CREATE, metadata);
+            })) {
+            continue;
+        }
+        pfsmeta::FileMetadata current;
+        if (metadata_table.fetch(metadata.filename(), &current) && current.handle() != metadata.handle()) {
+            response->add_conflicts(metadata.filename());
+            continue;
+        }
+        int64_t filesize, mtime;
+        metadata_table.update(metadata.filename(), metadata.filesize(), metadata.mtime(), &filesize, &mtime, [&]() {
+            pfsmeta::FileMetadata record;
+            record.set_filename(metadata.filename());
+            record.set_filesize(filesize);
+            record.set_mtime(mtime);
+            ticket = journal.append(MetadataJournal::RECORD_UPDATE, record);
+        });
+    }
+    if (ticket != 0 && !journal.wait_durable(ticket)) {
+        response->set_success(false);
+        response->set_message("Failed to persist file metadata.");
+        return grpc::Status::OK;
+    }
+
+    response->set_success(true);
+    if (response->conflicts_size() > 0) {
+        std::cerr << "[ERROR] " << response->conflicts_size() << " files from metadata shard "
+                  << request->from_shard() << " clash with other files of the same name." << std::endl;
+    }
+    std::cout << "[INFO] Imported " << request->files_size() - response->conflicts_size()
+              << " files from metadata shard " << request->from_shard() << "." << std::endl;
+    return grpc::Status::OK;
+}
+
+// Served from counters and snapshots, so it never waits for token requests
+grpc::Status GetStats(grpc::ServerContext* context,
+                      const pfsmeta::StatsRequest* request,
+                      pfsmeta::StatsResponse* response) override {
+    response->set_uptime_secs(std::chrono::duration_cast<std::chrono::seconds>(
+        std::chrono::steady_clock::now() - started).count());
+    response->set_files(metadata_table.size());
+    token_manager.stats(response);
+    revocation.stats(response);
+    response->set_sessions(sessions.size());
+    response->set_sessions_expired(sessions.expired());
+    response->set_shard(shard_id);
+    response->set_success(true);
+    return grpc::Status::OK;
+}
+
+// Answers right away; members poll until the whole group is in
+grpc::Status JoinGroup(grpc::ServerContext* context,
+                       const pfsmeta::JoinGroupRequest* request,
+                       pfsmeta::JoinGroupResponse* response) override {
+    if (request->name().empty() || request->size() <= 0 || request->rank() < 0 ||
+        request->rank() >= request->size()) {
+        response->set_success(false);
+        response->set_message("Invalid group name, size or rank.");
+        return grpc::Status::OK;
+    }
+
+    bool complete = false;
+    std::vector<std::string> addresses;
+    std::string error;
+    if (!rendezvous.join(request->name(), request->size(), request->rank(), request->address(), request->poll(),
+                         complete, addresses, error)) {
+        std::cerr << "[ERROR] " << error << "." << std::endl;
+        response->set_success(false);
+        response->set_message(error);
+        return grpc::Status::OK;
+    }
+    for (const auto& address : addresses) {
+        response->add_addresses(address);
+    }
+    response->set_complete(complete);
+    response->set_success(true);
+    if (complete && request->rank() == 0) {
+        std::cout << "[INFO] Group '" << request->name() << "' of " << request->size() << " members is complete."
+                  << std::endl;
+    }
+    return grpc::Status::OK;
+}
 };
 
 
@@ -357,19 +873,58 @@ int main(int argc, char* argv[]) {
 
     std::string line;
     std::getline(pfs_list, line);
+    std::vector<std::string> file_servers;
+    std::string file_server;
+    while (std::getline(pfs_list, file_server)) {
+        if (!file_server.empty()) {
+            file_servers.push_back(file_server);
+        }
+    }
     pfs_list.close();
 
-    if (line.substr(0, line.find(':')) != getMyHostname()) {
+    // The first line lists every metadata server, comma-separated; each one
+    // serves the shard of its position in the list
+    std::vector<std::string> metaservers = splitServerList(line);
+    int shard = -1;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg(argv[i]);
+        if (arg.rfind("--shard=", 0) == 0) {
+            shard = std::atoi(arg.c_str() + 8);
+        } else {
+            std::cerr << "[ERROR] Usage: " << argv[0] << " [--shard=N]" << std::endl;
+            return -1;
+        }
+    }
+    if (shard < 0) {
+        for (int i = 0; i < static_cast<int>(metaservers.size()); ++i) {
+            if (metaservers[i].substr(0, metaservers[i].find(':')) != getMyHostname()) {
+                continue;
+            }
+            if (shard >= 0) {
+                std::cerr << "[ERROR] Hostname is on the first line of pfs_list.txt more than once; pass --shard=N."
+                          << std::endl;
+                return -1;
+            }
+            shard = i;
+        }
+    }
+    if (shard < 0 || shard >= static_cast<int>(metaservers.size())) {
         std::cerr << "[ERROR] Hostname not on the first line of pfs_list.txt." << std::endl;
         return -1;
     }
+    if (metaservers.size() > (size_t(1) << PFS_HANDLE_SHARD_BITS)) {
+        std::cerr << "[ERROR] More metadata servers than file handles can tell apart." << std::endl;
+        return -1;
+    }
 
-    std::string listen_port = line.substr(line.find(':') + 1);
+    const std::string& entry = metaservers[shard];
+    std::string listen_port = entry.substr(entry.find(':') + 1);
     std::string server_address = "0.0.0.0:" + listen_port;
 
-    std::cout << "[INFO] Metadata Server will listen at: " << server_address << std::endl;
+    std::cout << "[INFO] Metadata Server for shard " << shard << " of " << metaservers.size()
+              << " will listen at: " << server_address << std::endl;
 
-    MetadataServerServiceImpl service;
+    MetadataServerServiceImpl service(metaservers, shard, file_servers);
     grpc::ServerBuilder builder;
     builder.AddListeningPort(server_address, grpc::InsecureServerCredentials());
 
@@ -383,26 +938,6 @@ int main(int argc, char* argv[]) {
 
     std::cout << "[INFO] Metadata Server is running at: " << server_address << std::endl;
 
-    std::thread log_tokens([&service]() {
-        while (true) {
-            {
-                std::shared_lock<std::shared_mutex> lock(service.token_table_mutex);
-                std::cout << "[DEBUG] Current Active Tokens:\n";
-                for (const auto& [filename, tokens] : service.token_table) {
-                    std::cout << "  File: " << filename << "\n";
-                    for (const auto& token : tokens) {
-                        std::cout << "    [" << token.start_byte << ", " << token.end_byte
-                                  << "] (" << (token.token_type == 1 ? "READ" : "WRITE") << "), Client: " << token.client_id << "\n";
-                    }
-                }
-            }
-            std::this_thread::sleep_for(std::chrono::seconds(10)); 
-        }
-    }
-    
-    );
-
-
     server->Wait();
     std::cout << "[INFO] Metadata Server shutting down..." << std::endl;
     return 0;
@@ -0,0 +1,79 @@
+#include "pfs_placement.hpp"
+
+#include <chrono>
+#include <climits>
+
+#include <grpcpp/grpcpp.h>
+
+#include "pfs_common/pfs_config.hpp"
+
+StripePlacer::StripePlacer(const std::vector<std::string>& file_servers)
+    : addresses(file_servers), loads(std::make_unique<Load[]>(file_servers.size())) {
+    for (const auto& address : addresses) {
+        stubs.push_back(pfsfile::FileServer::NewStub(grpc::CreateChannel(address, grpc::InsecureChannelCredentials())));
+    }
+    poller = std::thread(&StripePlacer::poll_loop, this);
+}
+
+StripePlacer::~StripePlacer() {
+    {
+        std::lock_guard<std::mutex> lock(poll_mutex);
+        stopping = true;
+    }
+    poll_cv.notify_one();
+    poller.join();
+}
+
+void StripePlacer::poll_loop() {
+    std::unique_lock<std::mutex> lock(poll_mutex);
+    while (!stopping) {
+        lock.unlock();
+        for (size_t i = 0; i < stubs.size(); ++i) {
+            pfsfile::LoadRequest request;
+            pfsfile::LoadResponse response;
+            grpc::ClientContext context;
+            context.set_deadline(std::chrono::system_clock::now() + std::chrono::milliseconds(PFS_LOAD_POLL_MS / 2));
+            grpc::Status status = stubs[i]->GetLoad(&context, request, &response);
+
+            Load& load = loads[i];
+            load.usable = status.ok() && response.free_bytes() >= PFS_PLACEMENT_MIN_FREE;
+            load.queue_depth = status.ok() ? static_cast<int>(response.queue_depth()) : 0;
+            load.placed = 0;
+        }
+        lock.lock();
+        poll_cv.wait_for(lock, std::chrono::milliseconds(PFS_LOAD_POLL_MS), [this]() { return stopping; });
+    }
+}
+
+std::vector<int> StripePlacer::place(int stripe_width) {
+    const int n = size();
+    std::lock_guard<std::mutex> lock(place_mutex);
+
+    // Least loaded usable server, scanning from the one after the last start
+    int start = next_start;
+    int best_score = INT_MAX;
+    for (int k = 0; k < n; ++k) {
+        int i = (next_start + k) % n;
+        int score = loads[i].queue_depth.load() + loads[i].placed.load();
+        if (loads[i].usable && score < best_score) {
+            best_score = score;
+            start = i;
+        }
+    }
+    next_start = (start + 1) % n;
+
+    // The next stripe_width servers from there, unusable ones last
+    std::vector<int> servers;
+    for (int pass = 0; pass < 2 && static_cast<int>(servers.size()) < stripe_width; ++pass) {
+        for (int k = 0; k < n && static_cast<int>(servers.size()) < stripe_width; ++k) {
+            int i = (start + k) % n;
+            if (loads[i].usable == (pass == 0)) {
+                servers.push_back(i);
+            }
+        }
+    }
+    for (int i : servers) {
+        loads[i].placed.fetch_add(1, std::memory_order_relaxed);
+    }
+    return servers;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "pfs_proto/pfs_fileserver.grpc.pb.h"
+
+// Chooses the file servers that hold a new file's stripe units. A thread
+// polls every file server's GetLoad each PFS_LOAD_POLL_MS. A file of width
+// w goes to w consecutive servers, in pfs_list.txt order, starting at the
+// least loaded one: the fewest requests queued, plus the stripe units placed
+// on it since the last poll, so a burst of creates does not pile onto one
+// server. Ties go to the first server after the previous start, so equal
+// servers take turns. Servers that are unreachable or have less than
+// PFS_PLACEMENT_MIN_FREE bytes free are only used when there is no other
+// choice.
+class StripePlacer {
+public:
+    explicit StripePlacer(const std::vector<std::string>& file_servers);
+    ~StripePlacer();
+
+    int size() const { return static_cast<int>(addresses.size()); }
+    const std::string& address(int server) const { return addresses[server]; }
+
+    // Servers for a new file, as indices into the file server list;
+    // stripe_width must not exceed size()
+    std::vector<int> place(int stripe_width);
+
+private:
+    struct Load {
+        std::atomic<bool> usable{true};  // Reachable with enough free space
+        std::atomic<int> queue_depth{0};
+        std::atomic<int> placed{0};      // Stripe units placed since the last poll
+    };
+
+    void poll_loop();
+
+    std::vector<std::string> addresses;
+    std::vector<std::unique_ptr<pfsfile::FileServer::Stub>> stubs;
+    std::unique_ptr<Load[]> loads;
+
+    std::mutex place_mutex;
+    int next_start = 0;
+
+    std::mutex poll_mutex;
+    std::condition_variable poll_cv;
+    bool stopping = false;
+    std::thread poller;
+};
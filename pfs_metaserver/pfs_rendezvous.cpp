@@ -0,0 +1,82 @@
+#include "pfs_rendezvous.hpp"
+
+#include "pfs_common/pfs_config.hpp"
+
+// Members poll far more often than this
+static const auto stale_after = std::chrono::milliseconds(50 * PFS_COLLECTIVE_POLL_MS);
+
+bool GroupRendezvous::join(const std::string& name, int size, int rank, const std::string& address, bool poll,
+                           bool& complete, std::vector<std::string>& addresses, std::string& error) {
+    auto now = Clock::now();
+    std::lock_guard<std::mutex> lock(mutex);
+    expire(now);
+
+    Gathering& gathering = gatherings[name];
+    if (gathering.size == 0) {
+        gathering.size = size;
+        gathering.addresses.resize(size);
+        gathering.present.resize(size);
+        gathering.seen.resize(size);
+    }
+    if (gathering.size != size) {
+        error = "Members of group '" + name + "' disagree on its size";
+        return false;
+    }
+
+    complete = false;
+    if (gathering.joined < size) {
+        if (gathering.present[rank] && !poll) {
+            error = "Rank " + std::to_string(rank) + " already joined group '" + name + "'";
+            return false;
+        }
+        // A member forgotten for not polling simply joins again
+        if (!gathering.present[rank]) {
+            gathering.present[rank] = 1;
+            gathering.addresses[rank] = address;
+            if (++gathering.joined == size) {
+                gathering.completed = now;
+            }
+        }
+        gathering.seen[rank] = now;
+        if (gathering.joined < size) {
+            return true;
+        }
+    }
+
+    // Complete. A rank that already left belongs to the next group under
+    // this name, which has to wait until this one is gone.
+    if (!gathering.present[rank]) {
+        return true;
+    }
+    gathering.present[rank] = 0;
+    addresses = gathering.addresses;
+    complete = true;
+    if (++gathering.left == size) {
+        gatherings.erase(name);
+    }
+    return true;
+}
+
+void GroupRendezvous::expire(Clock::time_point now) {
+    for (auto it = gatherings.begin(); it != gatherings.end();) {
+        Gathering& gathering = it->second;
+        if (gathering.joined == gathering.size) {
+            if (now - gathering.completed > std::chrono::milliseconds(PFS_COLLECTIVE_TIMEOUT_MS)) {
+                it = gatherings.erase(it);
+                continue;
+            }
+        } else {
+            for (int rank = 0; rank < gathering.size; ++rank) {
+                if (gathering.present[rank] && now - gathering.seen[rank] > stale_after) {
+                    gathering.present[rank] = 0;
+                    gathering.joined--;
+                }
+            }
+            if (gathering.joined == 0) {
+                it = gatherings.erase(it);
+                continue;
+            }
+        }
+        ++it;
+    }
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Meeting point of collective I/O groups. Each of a group's size members
+// joins under the group name with its rank and the address its aggregator
+// listens on, if it is one, and then polls every PFS_COLLECTIVE_POLL_MS
+// until all of them are in; no server thread waits for the others. Every
+// member then leaves with the full address list, in rank order, and the
+// name can be reused once they have.
+//
+// A member that stops polling is forgotten after a while, as is a complete
+// group whose members do not all come for their addresses.
+class GroupRendezvous {
+public:
+    // Join, or with poll set ask again. complete says whether every member
+    // is in; if so addresses holds their addresses. False, with error set,
+    // if the request does not fit the group.
+    bool join(const std::string& name, int size, int rank, const std::string& address, bool poll,
+              bool& complete, std::vector<std::string>& addresses, std::string& error);
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Gathering {
+        int size = 0;
+        int joined = 0;
+        int left = 0;
+        Clock::time_point completed;
+        std::vector<std::string> addresses;
+        std::vector<char> present;            // Joined and not yet left, by rank
+        std::vector<Clock::time_point> seen;  // Last poll, by rank
+    };
+
+    // Forget members that stopped polling and complete groups nobody came for
+    void expire(Clock::time_point now);
+
+    std::mutex mutex;
+    std::map<std::string, Gathering> gatherings;
+};
@@ -0,0 +1,193 @@
+#include "pfs_revocation.hpp"
+
+#include <chrono>
+#include <iostream>
+#include <thread>
+
+#include "pfs_common/pfs_config.hpp"
+
+RevocationEngine::RevocationEngine(TokenManager& tokens) : tokens(tokens) {}
+
+void RevocationEngine::serve(int client_id, grpc::ServerContext* context, CallbackStream* stream) {
+    auto channel = std::make_shared<Channel>(client_id, context, stream);
+    std::shared_ptr<Channel> replaced;
+    {
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        replaced = channels[client_id];
+        channels[client_id] = channel;
+    }
+    if (replaced) {
+        disconnect(replaced);
+    }
+    std::cout << "[INFO] Callback stream registered for client " << client_id << "." << std::endl;
+
+    pfsmeta::TokenRequest message;
+    while (stream->Read(&message)) {
+        if (message.token_type() == pfsmeta::TOKEN_OP_ACK) {
+            acknowledge(message.revoke_id());
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        auto it = channels.find(client_id);
+        if (it != channels.end() && it->second == channel) {
+            channels.erase(it);
+        }
+    }
+    // No writer may touch the stream once this handler returns
+    std::lock_guard<std::mutex> lock(channel->write_mutex);
+    channel->alive = false;
+}
+
+std::shared_ptr<RevocationEngine::Channel> RevocationEngine::channel_of(int client_id) {
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    auto it = channels.find(client_id);
+    return it == channels.end() ? nullptr : it->second;
+}
+
+bool RevocationEngine::send(Channel& channel, const std::vector<pfsmeta::TokenResponse>& messages) {
+    std::lock_guard<std::mutex> lock(channel.write_mutex);
+    if (!channel.alive) {
+        return false;
+    }
+    for (const auto& message : messages) {
+        if (!channel.stream->Write(message)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void RevocationEngine::acknowledge(uint64_t revoke_id) {
+    std::lock_guard<std::mutex> lock(rounds_mutex);
+    auto it = pending.find(revoke_id);
+    if (it == pending.end()) {
+        return;  // Late ACK from a round that already gave up
+    }
+    auto [round, holder] = it->second;
+    pending.erase(it);
+    if (--round->outstanding[holder] == 0) {
+        round->outstanding.erase(holder);
+        round->cv.notify_all();
+    }
+}
+
+void RevocationEngine::disconnect(const std::shared_ptr<Channel>& channel) {
+    std::lock_guard<std::mutex> lock(channel->write_mutex);
+    if (channel->alive) {
+        channel->alive = false;
+        channel->context->TryCancel();
+    }
+}
+
+void RevocationEngine::revoke(const std::vector<Token>& revoked) {
+    if (revoked.empty()) {
+        return;
+    }
+    auto started = std::chrono::steady_clock::now();
+
+    // Build one batch of REVOKE messages per holder that can be told
+    auto round = std::make_shared<Round>();
+    std::unordered_map<int, std::pair<std::shared_ptr<Channel>, std::vector<pfsmeta::TokenResponse>>> holders;
+    {
+        std::lock_guard<std::mutex> lock(rounds_mutex);
+        for (const auto& token : revoked) {
+            auto& holder = holders[token.client_id];
+            if (!holder.first) {
+                holder.first = channel_of(token.client_id);
+            }
+            if (!holder.first) {
+                continue;
+            }
+            uint64_t revoke_id = next_revoke_id++;
+            pfsmeta::TokenResponse message;
+            message.set_client_id(token.client_id);
+            message.set_handle(token.handle);
+            message.set_start_byte(token.start_byte);
+            message.set_end_byte(token.end_byte);
+            message.set_token_action(pfsmeta::TOKEN_ACTION_REVOKE);
+            message.set_revoke_id(revoke_id);
+            holder.second.push_back(std::move(message));
+
+            pending[revoke_id] = {round, token.client_id};
+            round->outstanding[token.client_id]++;
+        }
+    }
+
+    // Send to all holders in parallel; one slow stream must not delay the rest
+    std::vector<std::thread> senders;
+    std::vector<int> unreachable;
+    std::mutex unreachable_mutex;
+    for (auto& entry : holders) {
+        if (!entry.second.first) {
+            continue;
+        }
+        senders.emplace_back([&entry, &unreachable, &unreachable_mutex]() {
+            if (!send(*entry.second.first, entry.second.second)) {
+                std::lock_guard<std::mutex> lock(unreachable_mutex);
+                unreachable.push_back(entry.first);
+            }
+        });
+    }
+    for (auto& sender : senders) {
+        sender.join();
+    }
+
+    // Wait for the ACKs, but not for holders we could not reach
+    std::vector<int> unresponsive;
+    {
+        std::unique_lock<std::mutex> lock(rounds_mutex);
+        for (int client_id : unreachable) {
+            round->outstanding.erase(client_id);
+        }
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(PFS_REVOKE_TIMEOUT_MS);
+        round->cv.wait_until(lock, deadline, [&round]() { return round->outstanding.empty(); });
+
+        for (const auto& [client_id, count] : round->outstanding) {
+            unresponsive.push_back(client_id);
+        }
+        for (auto it = pending.begin(); it != pending.end();) {
+            it = it->second.first == round ? pending.erase(it) : std::next(it);
+        }
+    }
+    rounds.fetch_add(1, std::memory_order_relaxed);
+    timeouts.fetch_add(unresponsive.size(), std::memory_order_relaxed);
+    round_us.record(std::chrono::steady_clock::now() - started);
+
+    // Whoever did not answer loses everything it holds
+    for (int client_id : unresponsive) {
+        std::cerr << "[ERROR] Client " << client_id << " did not acknowledge a revocation within "
+                  << PFS_REVOKE_TIMEOUT_MS << " ms; reclaiming all of its tokens." << std::endl;
+        drop_client(client_id);
+    }
+    for (int client_id : unreachable) {
+        drop_client(client_id);
+    }
+}
+
+void RevocationEngine::drop_client(int client_id) {
+    std::shared_ptr<Channel> channel;
+    {
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        auto it = channels.find(client_id);
+        if (it != channels.end()) {
+            channel = it->second;
+            channels.erase(it);
+        }
+    }
+    if (channel) {
+        disconnect(channel);
+    }
+    tokens.release_client(client_id);
+}
+
+void RevocationEngine::stats(pfsmeta::StatsResponse* out) {
+    {
+        std::lock_guard<std::mutex> lock(registry_mutex);
+        out->set_callback_clients(channels.size());
+    }
+    out->set_revoke_rounds(rounds.load(std::memory_order_relaxed));
+    out->set_revoke_timeouts(timeouts.load(std::memory_order_relaxed));
+    round_us.add_to(out->mutable_revoke_us());
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include <grpcpp/grpcpp.h>
+
+#include "pfs_token_manager.hpp"
+#include "pfs_stats.hpp"
+#include "pfs_proto/pfs_metaserver.pb.h"
+#include "pfs_proto/pfs_metaserver.grpc.pb.h"
+
+using CallbackStream = grpc::ServerReaderWriter<pfsmeta::TokenResponse, pfsmeta::TokenRequest>;
+
+// Takes tokens back from their holders. Each client keeps one Callbacks
+// stream open; the registry maps client IDs to those streams. A revocation
+// round sends REVOKE to every affected holder at once and waits until each
+// has answered with ACK, which a client sends once it has stopped using
+// the range.
+//
+// A holder that has not answered within PFS_REVOKE_TIMEOUT_MS is treated
+// as dead. All of its tokens are reclaimed and its stream is cancelled, so
+// one stuck client cannot hold up the others. Holders without a callback
+// stream cannot be told about the revocation and are not waited for.
+class RevocationEngine {
+public:
+    explicit RevocationEngine(TokenManager& tokens);
+
+    // Serve a client's Callbacks stream until it closes
+    void serve(int client_id, grpc::ServerContext* context, CallbackStream* stream);
+
+    // Notify the holders of the revoked ranges (already removed from the
+    // token table) and wait until they have let go
+    void revoke(const std::vector<Token>& revoked);
+
+    // Forget a client that is shutting down
+    void drop_client(int client_id);
+
+    // Add the callback and revocation statistics to out
+    void stats(pfsmeta::StatsResponse* out);
+
+private:
+    struct Channel {
+        int client_id;
+        grpc::ServerContext* context;
+        CallbackStream* stream;
+        std::mutex write_mutex;  // Serializes writers and guards alive
+        bool alive = true;
+
+        Channel(int client_id, grpc::ServerContext* context, CallbackStream* stream)
+            : client_id(client_id), context(context), stream(stream) {}
+    };
+
+    // One revocation round: how many ACKs each holder still owes
+    struct Round {
+        std::unordered_map<int, int> outstanding;
+        std::condition_variable cv;
+    };
+
+    std::shared_ptr<Channel> channel_of(int client_id);
+    static bool send(Channel& channel, const std::vector<pfsmeta::TokenResponse>& messages);
+    void acknowledge(uint64_t revoke_id);
+    void disconnect(const std::shared_ptr<Channel>& channel);
+
+    TokenManager& tokens;
+
+    std::mutex registry_mutex;
+    std::unordered_map<int, std::shared_ptr<Channel>> channels;
+
+    std::mutex rounds_mutex;  // Guards every Round and the pending map
+    std::unordered_map<uint64_t, std::pair<std::shared_ptr<Round>, int>> pending;  // revoke_id -> (round, holder)
+    std::atomic<uint64_t> next_revoke_id{1};
+
+    std::atomic<uint64_t> rounds{0};
+    std::atomic<uint64_t> timeouts{0};
+    LatencyHistogram round_us;
+};
@@ -0,0 +1,89 @@
+#include "pfs_sessions.hpp"
+
+#include <iostream>
+#include <vector>
+
+#include "pfs_common/pfs_config.hpp"
+
+SessionTable::SessionTable(std::function<void(int)> on_expire)
+    : on_expire(std::move(on_expire)), reaper(&SessionTable::reaper_loop, this) {}
+
+SessionTable::~SessionTable() {
+    {
+        std::lock_guard<std::mutex> lock(reaper_mutex);
+        stopping = true;
+    }
+    reaper_cv.notify_one();
+    reaper.join();
+}
+
+int64_t SessionTable::now_ms() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now().time_since_epoch()).count();
+}
+
+int SessionTable::open() {
+    int client_id = next_client_id.fetch_add(1);
+    std::unique_lock<std::shared_mutex> lock(table_mutex);
+    deadlines[client_id].store(now_ms() + PFS_LEASE_MS);
+    return client_id;
+}
+
+bool SessionTable::renew(int client_id) {
+    std::shared_lock<std::shared_mutex> lock(table_mutex);
+    auto it = deadlines.find(client_id);
+    if (it == deadlines.end()) {
+        return false;
+    }
+    int64_t now = now_ms();
+    int64_t deadline = it->second.load(std::memory_order_relaxed);
+    // Once past its deadline a session stays dead, even before it is reaped
+    while (deadline >= now && deadline < now + PFS_LEASE_MS) {
+        if (it->second.compare_exchange_weak(deadline, now + PFS_LEASE_MS, std::memory_order_relaxed)) {
+            return true;
+        }
+    }
+    return deadline >= now;
+}
+
+bool SessionTable::alive(int client_id) {
+    std::shared_lock<std::shared_mutex> lock(table_mutex);
+    auto it = deadlines.find(client_id);
+    return it != deadlines.end() && it->second.load(std::memory_order_relaxed) >= now_ms();
+}
+
+void SessionTable::close(int client_id) {
+    std::unique_lock<std::shared_mutex> lock(table_mutex);
+    deadlines.erase(client_id);
+}
+
+size_t SessionTable::size() {
+    std::shared_lock<std::shared_mutex> lock(table_mutex);
+    return deadlines.size();
+}
+
+void SessionTable::reaper_loop() {
+    std::unique_lock<std::mutex> lock(reaper_mutex);
+    while (!reaper_cv.wait_for(lock, std::chrono::milliseconds(PFS_LEASE_MS / 4), [this]() { return stopping; })) {
+        std::vector<int> expired_ids;
+        {
+            std::unique_lock<std::shared_mutex> table_lock(table_mutex);
+            int64_t now = now_ms();
+            for (auto it = deadlines.begin(); it != deadlines.end();) {
+                if (it->second.load(std::memory_order_relaxed) < now) {
+                    expired_ids.push_back(it->first);
+                    it = deadlines.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+        }
+
+        lock.unlock();
+        for (int client_id : expired_ids) {
+            std::cerr << "[ERROR] Session of client " << client_id << " expired; reclaiming its tokens." << std::endl;
+            num_expired.fetch_add(1, std::memory_order_relaxed);
+            on_expire(client_id);
+        }
+        lock.lock();
+    }
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include <unordered_map>
+
+// Client sessions held by leases. Initialize opens a session and hands out
+// its client ID; every token request renews the lease, and idle clients
+// renew it with an empty request. A session whose lease has run out for
+// PFS_LEASE_MS is dead: renewing it fails, and the reaper thread removes
+// it and calls on_expire so its tokens and streams can be reclaimed.
+//
+// Renewing only takes the table lock shared, so it costs no more than an
+// atomic store on the request path.
+class SessionTable {
+public:
+    explicit SessionTable(std::function<void(int)> on_expire);
+    ~SessionTable();
+
+    // Start a session and return its client ID
+    int open();
+
+    // Extend client_id's lease; false if it has expired or never existed
+    bool renew(int client_id);
+
+    // Whether the lease of client_id is still running
+    bool alive(int client_id);
+
+    // End a session on the client's own request
+    void close(int client_id);
+
+    size_t size();
+    uint64_t expired() const { return num_expired.load(std::memory_order_relaxed); }
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    static int64_t now_ms();
+    void reaper_loop();
+
+    std::function<void(int)> on_expire;
+    std::atomic<int> next_client_id{1};
+
+    std::shared_mutex table_mutex;
+    std::unordered_map<int, std::atomic<int64_t>> deadlines;  // client_id -> lease end, ms
+
+    std::mutex reaper_mutex;
+    std::condition_variable reaper_cv;
+    bool stopping = false;
+    std::atomic<uint64_t> num_expired{0};
+    std::thread reaper;
+};
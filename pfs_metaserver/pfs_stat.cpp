@@ -0,0 +1,135 @@
+// Print the statistics of running metadata servers.
+//
+//   pfs_stat [host:port] [--shards]
+//
+// Without an address every metadata server on the first line of
+// ../pfs_list.txt is asked.
+
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+
+#include <grpcpp/grpcpp.h>
+
+#include "pfs_common/pfs_common.hpp"
+#include "pfs_common/pfs_config.hpp"
+#include "pfs_proto/pfs_metaserver.pb.h"
+#include "pfs_proto/pfs_metaserver.grpc.pb.h"
+
+// Upper bound in microseconds of the bucket holding the given quantile
+static uint64_t percentile(const pfsmeta::Histogram& histogram, double quantile) {
+    uint64_t total = 0;
+    for (uint64_t count : histogram.counts()) {
+        total += count;
+    }
+    if (total == 0) {
+        return 0;
+    }
+    uint64_t seen = 0;
+    for (int i = 0; i < histogram.counts_size(); ++i) {
+        seen += histogram.counts(i);
+        if (seen >= quantile * total) {
+            return uint64_t(1) << i;
+        }
+    }
+    return uint64_t(1) << (histogram.counts_size() - 1);
+}
+
+static void print_latency(const char* name, const pfsmeta::Histogram& histogram) {
+    if (percentile(histogram, 1.0) == 0) {
+        printf("  %-12s no samples\n", name);
+        return;
+    }
+    printf("  %-12s p50 < %llu us, p99 < %llu us, max < %llu us\n", name,
+           (unsigned long long)percentile(histogram, 0.5),
+           (unsigned long long)percentile(histogram, 0.99),
+           (unsigned long long)percentile(histogram, 1.0));
+}
+
+static bool print_stats(const std::string& address, bool per_shard) {
+    auto stub = pfsmeta::MetadataServer::NewStub(
+        grpc::CreateChannel(address, grpc::InsecureChannelCredentials()));
+    pfsmeta::StatsRequest request;
+    pfsmeta::StatsResponse response;
+    grpc::ClientContext context;
+    grpc::Status status = stub->GetStats(&context, request, &response);
+    if (!status.ok() || !response.success()) {
+        fprintf(stderr, "%s: GetStats on %s failed: %s\n", __func__, address.c_str(),
+                status.ok() ? response.message().c_str() : status.error_message().c_str());
+        return false;
+    }
+
+    uint64_t token_files = 0;
+    uint64_t segments = 0;
+    for (const auto& shard : response.shards()) {
+        token_files += shard.files();
+        segments += shard.segments();
+    }
+
+    printf("Metadata server %s (shard %d), up %lld s\n", address.c_str(), response.shard(),
+           (long long)response.uptime_secs());
+    printf("  files        %llu in the namespace, %llu with tokens in %llu segments\n",
+           (unsigned long long)response.files(), (unsigned long long)token_files,
+           (unsigned long long)segments);
+    printf("  clients      %llu with a session, %llu with a callback stream, %llu sessions expired\n",
+           (unsigned long long)response.sessions(), (unsigned long long)response.callback_clients(),
+           (unsigned long long)response.sessions_expired());
+    printf("  grants       %llu (%.1f/s)\n", (unsigned long long)response.grants(), response.grants_per_sec());
+    printf("  revokes      %llu (%.1f/s) in %llu rounds, %llu clients timed out\n",
+           (unsigned long long)response.revokes(), response.revokes_per_sec(),
+           (unsigned long long)response.revoke_rounds(), (unsigned long long)response.revoke_timeouts());
+    print_latency("shard wait", response.wait_us());
+    print_latency("shard hold", response.hold_us());
+    print_latency("revoke round", response.revoke_us());
+
+    if (response.hot_files_size() > 0) {
+        printf("Busiest files (token requests in the last %d ms)\n", PFS_STATS_PUBLISH_MS);
+        for (const auto& hot_file : response.hot_files()) {
+            printf("  handle %-10llu %llu\n", (unsigned long long)hot_file.handle(),
+                   (unsigned long long)hot_file.requests());
+        }
+    }
+
+    if (per_shard) {
+        for (int i = 0; i < response.shards_size(); ++i) {
+            const auto& shard = response.shards(i);
+            printf("Token shard %d: %llu files, %llu segments, %llu requests, %.1f grants/s, %.1f revokes/s\n", i,
+                   (unsigned long long)shard.files(), (unsigned long long)shard.segments(),
+                   (unsigned long long)shard.tasks(), shard.grants_per_sec(), shard.revokes_per_sec());
+            print_latency("wait", shard.wait_us());
+            print_latency("hold", shard.hold_us());
+        }
+    }
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    std::vector<std::string> addresses;
+    bool per_shard = false;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg(argv[i]);
+        if (arg == "--shards") {
+            per_shard = true;
+        } else if (arg[0] != '-' && addresses.empty()) {
+            addresses.push_back(arg);
+        } else {
+            fprintf(stderr, "%s: usage: %s [host:port] [--shards]\n", __func__, argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (addresses.empty()) {
+        std::ifstream pfs_list("../pfs_list.txt");
+        std::string line;
+        if (!pfs_list.is_open() || !std::getline(pfs_list, line) || (addresses = splitServerList(line)).empty()) {
+            fprintf(stderr, "%s: can't read the metadata servers from pfs_list.txt.\n", __func__);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    bool ok = true;
+    for (const auto& address : addresses) {
+        ok = print_stats(address, per_shard) && ok;
+    }
+    return ok ? 0 : EXIT_FAILURE;
+}
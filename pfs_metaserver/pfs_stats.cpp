@@ -0,0 +1,20 @@
+#include "pfs_stats.hpp"
+
+void LatencyHistogram::record(std::chrono::steady_clock::duration elapsed) {
+    auto us = std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+    int bucket = 0;
+    while (us > 0 && bucket < PFS_STATS_BUCKETS - 1) {
+        us >>= 1;
+        ++bucket;
+    }
+    counts[bucket].fetch_add(1, std::memory_order_relaxed);
+}
+
+void LatencyHistogram::add_to(pfsmeta::Histogram* out) const {
+    while (out->counts_size() < PFS_STATS_BUCKETS) {
+        out->add_counts(0);
+    }
+    for (int i = 0; i < PFS_STATS_BUCKETS; ++i) {
+        out->set_counts(i, out->counts(i) + counts[i].load(std::memory_order_relaxed));
+    }
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+#include "pfs_common/pfs_config.hpp"
+#include "pfs_proto/pfs_metaserver.pb.h"
+
+// Latency histogram with PFS_STATS_BUCKETS power-of-two buckets of
+// microseconds: bucket 0 counts samples under 1 us, bucket i those in
+// [2^(i-1), 2^i) us and the last one everything longer. Recording is a
+// relaxed increment, so any thread may record and GetStats may read at any
+// time without stopping the recorders.
+class LatencyHistogram {
+public:
+    void record(std::chrono::steady_clock::duration elapsed);
+
+    // Add this histogram's counts to out, sizing it if needed
+    void add_to(pfsmeta::Histogram* out) const;
+
+private:
+    std::atomic<uint64_t> counts[PFS_STATS_BUCKETS] = {};
+};
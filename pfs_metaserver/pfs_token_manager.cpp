@@ -0,0 +1,287 @@
+#include "pfs_token_manager.hpp"
+
+#include <algorithm>
+#include <map>
+#include <iostream>
+
+TokenManager::Shard::Shard()
+    : window_start(std::chrono::steady_clock::now()), snapshot(std::make_shared<ShardSnapshot>()) {
+    head = new Task();
+    tail.store(head);
+}
+
+TokenManager::Shard::~Shard() {
+    delete head;
+}
+
+TokenManager::TokenManager(unsigned num_shards) {
+    if (num_shards == 0) {
+        num_shards = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (unsigned i = 0; i < num_shards; ++i) {
+        shards.push_back(std::make_unique<Shard>());
+    }
+    for (auto& shard : shards) {
+        shard->worker = std::thread(&TokenManager::shard_loop, this, std::ref(*shard));
+    }
+    std::cout << "[INFO] Token manager started with " << num_shards << " shards." << std::endl;
+}
+
+TokenManager::~TokenManager() {
+    stopping = true;
+    for (auto& shard : shards) {
+        {
+            std::lock_guard<std::mutex> lock(shard->park_mutex);
+            shard->sleeping = false;
+        }
+        shard->park_cv.notify_one();
+        shard->worker.join();
+    }
+}
+
+size_t TokenManager::shard_index(FileHandle handle) const {
+    return handle % shards.size();
+}
+
+TokenManager::Shard& TokenManager::shard_for(FileHandle handle) {
+    return *shards[shard_index(handle)];
+}
+
+void TokenManager::push(Shard& shard, Task* task) {
+    task->queued = std::chrono::steady_clock::now();
+    Task* prev = shard.tail.exchange(task, std::memory_order_acq_rel);
+    prev->next.store(task, std::memory_order_release);
+}
+
+// Only called by the shard thread. Returns nullptr when the queue is empty
+// or the next producer has not finished linking its task yet; that
+// producer will wake the shard once it has.
+TokenManager::Task* TokenManager::pop(Shard& shard) {
+    Task* next = shard.head->next.load(std::memory_order_acquire);
+    if (!next) {
+        return nullptr;
+    }
+    delete shard.head;
+    shard.head = next;  // next becomes the new stub once its work is taken
+    return next;
+}
+
+void TokenManager::run_on(Shard& shard, std::function<void(TokenTable&)> fn) {
+    Task* task = new Task();
+    task->fn = std::move(fn);
+    std::future<void> done = task->done.get_future();
+    push(shard, task);
+    wake(shard);
+    done.wait();
+}
+
+void TokenManager::wake(Shard& shard) {
+    if (shard.sleeping.exchange(false)) {
+        std::lock_guard<std::mutex> lock(shard.park_mutex);
+        shard.park_cv.notify_one();
+    }
+}
+
+void TokenManager::shard_loop(Shard& shard) {
+    while (true) {
+        while (Task* task = pop(shard)) {
+            auto started = std::chrono::steady_clock::now();
+            shard.wait_us.record(started - task->queued);
+            task->fn(shard.table);
+            task->fn = nullptr;
+            auto finished = std::chrono::steady_clock::now();
+            shard.hold_us.record(finished - started);
+            shard.tasks.fetch_add(1, std::memory_order_relaxed);
+            task->done.set_value();
+            publish_if_due(shard, finished);
+        }
+        if (stopping) {
+            return;
+        }
+        publish_if_due(shard, std::chrono::steady_clock::now());
+
+        // Announce that we are going to sleep, then look once more so a
+        // task pushed in between is not missed
+        shard.sleeping = true;
+        if (shard.head->next.load(std::memory_order_acquire)) {
+            shard.sleeping = false;
+            continue;
+        }
+        // Wake up now and then anyway to keep the published stats fresh
+        std::unique_lock<std::mutex> lock(shard.park_mutex);
+        shard.park_cv.wait_for(lock, std::chrono::milliseconds(PFS_STATS_PUBLISH_MS),
+                               [this, &shard]() { return !shard.sleeping || stopping; });
+    }
+}
+
+TokenDecision TokenManager::decide(Shard& shard, const Token& want) {
+    TokenTable& table = shard.table;
+    TokenDecision decision{want, {}};
+    decision.revoked = table.conflicts(want.handle, want.client_id, want.token_type, want.start_byte, want.end_byte);
+    for (const auto& token : decision.revoked) {
+        table.revoke(want.handle, token.client_id, token.start_byte, token.end_byte);
+    }
+    // Hand out everything nobody else wants, so a lone reader or writer
+    // needs a single request per open
+    auto [grant_start, grant_end] = want.exact ? std::make_pair(want.start_byte, want.end_byte)
+                                               : table.free_range(want.handle, want.client_id, want.token_type,
+                                                                  want.start_byte, want.end_byte);
+    decision.granted = table.grant(want.handle, want.client_id, want.token_type, grant_start, grant_end);
+
+    shard.grants.fetch_add(1, std::memory_order_relaxed);
+    shard.revokes.fetch_add(decision.revoked.size(), std::memory_order_relaxed);
+    ++shard.window_grants;
+    shard.window_revokes += decision.revoked.size();
+    ++shard.window_requests[want.handle];
+    return decision;
+}
+
+TokenDecision TokenManager::request(FileHandle handle, int client_id, int token_type,
+                                    int64_t start, int64_t end) {
+    Token want(client_id, -1, handle, token_type, start, end);
+    TokenDecision decision{want, {}};
+    Shard& shard = shard_for(handle);
+    run_on(shard, [&](TokenTable&) { decision = decide(shard, want); });
+    return decision;
+}
+
+std::vector<TokenDecision> TokenManager::request_batch(const std::vector<Token>& wants) {
+    std::vector<TokenDecision> decisions;
+    for (const auto& want : wants) {
+        decisions.push_back({want, {}});
+    }
+
+    // Wants grouped by shard, shards in ascending order
+    std::map<size_t, std::vector<size_t>> by_shard;
+    for (size_t i = 0; i < wants.size(); ++i) {
+        by_shard[shard_index(wants[i].handle)].push_back(i);
+    }
+    if (by_shard.size() <= 1) {
+        for (const auto& [index, members] : by_shard) {
+            Shard& shard = *shards[index];
+            run_on(shard, [&](TokenTable&) {
+                for (size_t i : members) {
+                    decisions[i] = decide(shard, wants[i]);
+                }
+            });
+        }
+        return decisions;
+    }
+
+    // Park every shard involved on a task of ours, taking them one at a
+    // time in ascending order so two batches can never wait on each other.
+    // Once all are parked their tables are ours until we let go.
+    std::mutex hold_mutex;
+    std::condition_variable hold_cv;
+    bool released = false;
+    std::vector<std::promise<void>> entered(by_shard.size());
+    std::vector<std::future<void>> done;
+    for (const auto& [index, members] : by_shard) {
+        Shard& shard = *shards[index];
+        std::promise<void>* parked = &entered[done.size()];
+
+        Task* task = new Task();
+        task->fn = [&hold_mutex, &hold_cv, &released, parked](TokenTable&) {
+            parked->set_value();
+            std::unique_lock<std::mutex> lock(hold_mutex);
+            hold_cv.wait(lock, [&released]() { return released; });
+        };
+        done.push_back(task->done.get_future());
+        push(shard, task);
+        wake(shard);
+        parked->get_future().wait();
+    }
+
+    for (const auto& [index, members] : by_shard) {
+        for (size_t i : members) {
+            decisions[i] = decide(*shards[index], wants[i]);
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(hold_mutex);
+        released = true;
+    }
+    hold_cv.notify_all();
+    for (auto& shard_done : done) {
+        shard_done.wait();
+    }
+    return decisions;
+}
+
+void TokenManager::release(FileHandle handle, int client_id) {
+    run_on(shard_for(handle), [&](TokenTable& table) { table.release(handle, client_id); });
+}
+
+void TokenManager::release_client(int client_id) {
+    for (auto& shard : shards) {
+        run_on(*shard, [client_id](TokenTable& table) { table.release_client(client_id); });
+    }
+}
+
+bool TokenManager::has_tokens(FileHandle handle) {
+    bool found = false;
+    run_on(shard_for(handle), [&](TokenTable& table) { found = table.has_tokens(handle); });
+    return found;
+}
+
+// Only called by the shard thread
+void TokenManager::publish_if_due(Shard& shard, std::chrono::steady_clock::time_point now) {
+    auto window = now - shard.window_start;
+    if (window < std::chrono::milliseconds(PFS_STATS_PUBLISH_MS)) {
+        return;
+    }
+    double secs = std::chrono::duration<double>(window).count();
+
+    auto snapshot = std::make_shared<ShardSnapshot>();
+    snapshot->files = shard.table.num_files();
+    snapshot->segments = shard.table.num_segments();
+    snapshot->grants_per_sec = shard.window_grants / secs;
+    snapshot->revokes_per_sec = shard.window_revokes / secs;
+    auto& hot = snapshot->hot_files;
+    hot.assign(shard.window_requests.begin(), shard.window_requests.end());
+    size_t keep = std::min<size_t>(PFS_STATS_HOT_FILES, hot.size());
+    std::partial_sort(hot.begin(), hot.begin() + keep, hot.end(),
+                      [](const auto& a, const auto& b) { return a.second > b.second; });
+    hot.resize(keep);
+    std::atomic_store(&shard.snapshot, std::shared_ptr<const ShardSnapshot>(std::move(snapshot)));
+
+    shard.window_grants = 0;
+    shard.window_revokes = 0;
+    shard.window_requests.clear();
+    shard.window_start = now;
+}
+
+void TokenManager::stats(pfsmeta::StatsResponse* out) {
+    std::vector<std::pair<FileHandle, uint64_t>> hot;
+    for (auto& shard : shards) {
+        auto snapshot = std::atomic_load(&shard->snapshot);
+        auto* shard_out = out->add_shards();
+        shard_out->set_files(snapshot->files);
+        shard_out->set_segments(snapshot->segments);
+        shard_out->set_tasks(shard->tasks.load(std::memory_order_relaxed));
+        shard_out->set_grants_per_sec(snapshot->grants_per_sec);
+        shard_out->set_revokes_per_sec(snapshot->revokes_per_sec);
+        shard->wait_us.add_to(shard_out->mutable_wait_us());
+        shard->hold_us.add_to(shard_out->mutable_hold_us());
+
+        out->set_grants(out->grants() + shard->grants.load(std::memory_order_relaxed));
+        out->set_revokes(out->revokes() + shard->revokes.load(std::memory_order_relaxed));
+        out->set_grants_per_sec(out->grants_per_sec() + snapshot->grants_per_sec);
+        out->set_revokes_per_sec(out->revokes_per_sec() + snapshot->revokes_per_sec);
+        shard->wait_us.add_to(out->mutable_wait_us());
+        shard->hold_us.add_to(out->mutable_hold_us());
+        hot.insert(hot.end(), snapshot->hot_files.begin(), snapshot->hot_files.end());
+    }
+
+    // A file lives on one shard, so the busiest overall are among each
+    // shard's busiest
+    size_t keep = std::min<size_t>(PFS_STATS_HOT_FILES, hot.size());
+    std::partial_sort(hot.begin(), hot.begin() + keep, hot.end(),
+                      [](const auto& a, const auto& b) { return a.second > b.second; });
+    for (size_t i = 0; i < keep; ++i) {
+        auto* hot_file = out->add_hot_files();
+        hot_file->set_handle(hot[i].first);
+        hot_file->set_requests(hot[i].second);
+    }
+}
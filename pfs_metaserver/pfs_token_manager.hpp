@@ -0,0 +1,115 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "pfs_token_table.hpp"
+#include "pfs_stats.hpp"
+
+// Outcome of a token request: the range granted to the requester and the
+// ranges taken away from other clients to make room for it
+struct TokenDecision {
+    Token granted;
+    std::vector<Token> revoked;
+};
+
+// Token state partitioned over shards by file handle. Each shard owns the
+// TokenTable of its files and is driven by one thread that runs requests in
+// arrival order, so no locks are taken on token state and requests for
+// files on different shards never wait on each other. Handlers post to a
+// shard's lock-free inbox and block until their request has run.
+//
+// Each shard records how long requests queue for it and how long they
+// hold it, and every PFS_STATS_PUBLISH_MS publishes its table size, grant
+// and revoke rates and busiest files, so stats() never waits on a shard.
+class TokenManager {
+public:
+    explicit TokenManager(unsigned num_shards);
+    ~TokenManager();
+
+    // Revoke whatever conflicts with the request and grant it, widened to
+    // the largest range around it that no other client holds unless the
+    // want is exact
+    TokenDecision request(FileHandle handle, int client_id, int token_type,
+                          int64_t start, int64_t end);
+    // Like request() for every wanted token (client_id, handle,
+    // token_type and range), applied as one atomic step across all the
+    // shards involved. Decisions come back in the order of wants.
+    std::vector<TokenDecision> request_batch(const std::vector<Token>& wants);
+
+    void release(FileHandle handle, int client_id);
+    void release_client(int client_id);
+    bool has_tokens(FileHandle handle);
+
+    // Add the token statistics to out
+    void stats(pfsmeta::StatsResponse* out);
+
+private:
+    struct Task {
+        std::atomic<Task*> next{nullptr};
+        std::function<void(TokenTable&)> fn;
+        std::promise<void> done;
+        std::chrono::steady_clock::time_point queued;
+    };
+
+    // What a shard last published
+    struct ShardSnapshot {
+        size_t files = 0;
+        size_t segments = 0;
+        double grants_per_sec = 0;
+        double revokes_per_sec = 0;
+        std::vector<std::pair<FileHandle, uint64_t>> hot_files;  // Busiest first
+    };
+
+    // Multi-producer single-consumer queue (Vyukov); head is a stub node
+    // owned by the shard thread
+    struct Shard {
+        TokenTable table;
+        std::atomic<Task*> tail;
+        Task* head;
+        std::atomic<bool> sleeping{false};
+        std::mutex park_mutex;
+        std::condition_variable park_cv;
+        std::thread worker;
+
+        // Written by whoever runs on the shard, read by stats() at any time
+        std::atomic<uint64_t> tasks{0};
+        std::atomic<uint64_t> grants{0};
+        std::atomic<uint64_t> revokes{0};
+        LatencyHistogram wait_us;
+        LatencyHistogram hold_us;
+
+        // Owned by the shard like its table; summed up at each publish
+        uint64_t window_grants = 0;
+        uint64_t window_revokes = 0;
+        std::unordered_map<FileHandle, uint64_t> window_requests;
+        std::chrono::steady_clock::time_point window_start;
+        std::shared_ptr<const ShardSnapshot> snapshot;  // Accessed with std::atomic_load/store
+
+        Shard();
+        ~Shard();
+    };
+
+    size_t shard_index(FileHandle handle) const;
+    Shard& shard_for(FileHandle handle);
+    void run_on(Shard& shard, std::function<void(TokenTable&)> fn);
+    static TokenDecision decide(Shard& shard, const Token& want);
+    static void publish_if_due(Shard& shard, std::chrono::steady_clock::time_point now);
+    static void push(Shard& shard, Task* task);
+    static void wake(Shard& shard);
+    static Task* pop(Shard& shard);
+    void shard_loop(Shard& shard);
+
+    std::vector<std::unique_ptr<Shard>> shards;
+    std::atomic<bool> stopping{false};
+};
@@ -0,0 +1,251 @@
+#include "pfs_token_table.hpp"
+
+#include <algorithm>
+#include <iterator>
+
+int TokenTable::mode_of(const Holders& holders, int client_id) {
+    auto it = std::lower_bound(holders.begin(), holders.end(), std::make_pair(client_id, 0));
+    return (it != holders.end() && it->first == client_id) ? it->second : 0;
+}
+
+// Does anyone but client_id hold the segment in a mode token_type clashes with?
+bool TokenTable::conflicts_with(const Holders& holders, int client_id, int token_type) {
+    return std::any_of(holders.begin(), holders.end(), [&](const std::pair<int, int>& holder) {
+        return holder.first != client_id && (holder.second == TOKEN_WRITE || token_type == TOKEN_WRITE);
+    });
+}
+
+// Set client_id's mode in holders; mode 0 removes the client
+void TokenTable::set_mode(Holders& holders, int client_id, int mode) {
+    auto it = std::lower_bound(holders.begin(), holders.end(), std::make_pair(client_id, 0));
+    if (it != holders.end() && it->first == client_id) {
+        if (mode == 0) {
+            holders.erase(it);
+        } else {
+            it->second = mode;
+        }
+    } else if (mode != 0) {
+        holders.insert(it, {client_id, mode});
+    }
+}
+
+// Make sure no segment straddles offset, so one starts exactly there if any
+// segment covers it
+void TokenTable::split_at(FileTokens& tokens, int64_t offset) {
+    auto it = tokens.upper_bound(offset);
+    if (it == tokens.begin()) {
+        return;
+    }
+    --it;
+    if (it->first < offset && it->second.end >= offset) {
+        tokens.emplace(offset, Segment{it->second.end, it->second.holders});
+        it->second.end = offset - 1;
+        ++segments;
+    }
+}
+
+// Merge touching segments with identical holders across [start - 1, end + 1]
+void TokenTable::merge_around(FileTokens& tokens, int64_t start, int64_t end) {
+    auto it = tokens.lower_bound(start);
+    if (it != tokens.begin()) {
+        --it;
+    }
+    while (it != tokens.end() && it->first <= end + 1) {
+        auto next = std::next(it);
+        if (next != tokens.end() && it->second.end + 1 == next->first &&
+            it->second.holders == next->second.holders) {
+            it->second.end = next->second.end;
+            erase_segment(tokens, next);
+        } else {
+            it = next;
+        }
+    }
+}
+
+TokenTable::FileTokens::iterator TokenTable::erase_segment(FileTokens& tokens, FileTokens::iterator it) {
+    --segments;
+    return tokens.erase(it);
+}
+
+void TokenTable::erase_file_if_empty(FileHandle handle) {
+    auto found = files.find(handle);
+    if (found != files.end() && found->second.empty()) {
+        files.erase(found);
+    }
+}
+
+std::vector<Token> TokenTable::conflicts(FileHandle handle, int client_id, int token_type,
+                                         int64_t start, int64_t end) const {
+    std::vector<Token> result;
+    auto found = files.find(handle);
+    if (found == files.end()) {
+        return result;
+    }
+    const FileTokens& tokens = found->second;
+
+    // Index of each holder's last run in result, to extend it across segments
+    std::unordered_map<int, size_t> last_run;
+
+    auto it = tokens.upper_bound(start);
+    if (it != tokens.begin() && std::prev(it)->second.end >= start) {
+        --it;
+    }
+    for (; it != tokens.end() && it->first <= end; ++it) {
+        int64_t clip_start = std::max(it->first, start);
+        int64_t clip_end = std::min(it->second.end, end);
+        for (const auto& [holder, mode] : it->second.holders) {
+            if (holder == client_id || (mode != TOKEN_WRITE && token_type != TOKEN_WRITE)) {
+                continue;
+            }
+            auto run = last_run.find(holder);
+            if (run != last_run.end() && result[run->second].end_byte + 1 == clip_start &&
+                result[run->second].token_type == mode) {
+                result[run->second].end_byte = clip_end;
+            } else {
+                last_run[holder] = result.size();
+                result.emplace_back(holder, -1, handle, mode, clip_start, clip_end);
+            }
+        }
+    }
+    return result;
+}
+
+std::pair<int64_t, int64_t> TokenTable::free_range(FileHandle handle, int client_id, int token_type,
+                                                   int64_t start, int64_t end) const {
+    std::pair<int64_t, int64_t> range{0, TOKEN_RANGE_MAX};
+    auto found = files.find(handle);
+    if (found == files.end()) {
+        return range;
+    }
+    const FileTokens& tokens = found->second;
+
+    // Look at no more than the two nearest segments on either side. A
+    // segment that conflicts ends the range before it. One only the client
+    // holds, which the grant merges in, lets the walk take one more step;
+    // any other segment, or the second step, ends the range after it. The
+    // range is then free of conflicts but not always the widest possible.
+    auto only_client = [&](const Holders& holders) {
+        return holders.size() == 1 && holders.front().first == client_id;
+    };
+    int passed = 0;
+    for (auto it = tokens.lower_bound(start); it != tokens.begin();) {
+        --it;
+        if (conflicts_with(it->second.holders, client_id, token_type)) {
+            range.first = it->second.end + 1;
+            break;
+        }
+        if (!only_client(it->second.holders) || ++passed == 2) {
+            range.first = it->first;
+            break;
+        }
+    }
+    passed = 0;
+    for (auto it = tokens.upper_bound(end); it != tokens.end(); ++it) {
+        if (conflicts_with(it->second.holders, client_id, token_type)) {
+            range.second = it->first - 1;
+            break;
+        }
+        if (!only_client(it->second.holders) || ++passed == 2) {
+            range.second = it->second.end;
+            break;
+        }
+    }
+    return range;
+}
+
+void TokenTable::revoke(FileHandle handle, int client_id, int64_t start, int64_t end) {
+    auto found = files.find(handle);
+    if (found == files.end()) {
+        return;
+    }
+    FileTokens& tokens = found->second;
+    split_at(tokens, start);
+    split_at(tokens, end + 1);
+
+    for (auto it = tokens.lower_bound(start); it != tokens.end() && it->first <= end;) {
+        set_mode(it->second.holders, client_id, 0);
+        it = it->second.holders.empty() ? erase_segment(tokens, it) : std::next(it);
+    }
+    merge_around(tokens, start, end);
+    erase_file_if_empty(handle);
+}
+
+Token TokenTable::grant(FileHandle handle, int client_id, int token_type, int64_t start, int64_t end) {
+    FileTokens& tokens = files[handle];
+    split_at(tokens, start);
+    split_at(tokens, end + 1);
+
+    // Walk [start, end], joining existing segments and filling the gaps
+    int64_t cursor = start;
+    auto it = tokens.lower_bound(start);
+    while (cursor <= end) {
+        if (it == tokens.end() || it->first > cursor) {
+            int64_t gap_end = (it == tokens.end() || it->first > end) ? end : it->first - 1;
+            tokens.emplace_hint(it, cursor, Segment{gap_end, {{client_id, token_type}}});
+            ++segments;
+            cursor = gap_end + 1;
+        } else {
+            Holders& holders = it->second.holders;
+            set_mode(holders, client_id, std::max(mode_of(holders, client_id), token_type));
+            cursor = it->second.end + 1;
+            ++it;
+        }
+    }
+    merge_around(tokens, start, end);
+
+    // Report the whole run the client now holds around the request
+    auto first = std::prev(tokens.upper_bound(start));
+    auto last = first;
+    while (first != tokens.begin()) {
+        auto prev = std::prev(first);
+        if (prev->second.end + 1 != first->first || mode_of(prev->second.holders, client_id) < token_type) {
+            break;
+        }
+        first = prev;
+    }
+    for (auto next = std::next(last); next != tokens.end(); ++next) {
+        if (last->second.end + 1 != next->first || mode_of(next->second.holders, client_id) < token_type) {
+            break;
+        }
+        last = next;
+    }
+    return Token(client_id, -1, handle, token_type, first->first, last->second.end);
+}
+
+void TokenTable::release(FileHandle handle, int client_id) {
+    auto found = files.find(handle);
+    if (found == files.end()) {
+        return;
+    }
+    FileTokens& tokens = found->second;
+    for (auto it = tokens.begin(); it != tokens.end();) {
+        set_mode(it->second.holders, client_id, 0);
+        it = it->second.holders.empty() ? erase_segment(tokens, it) : std::next(it);
+    }
+    if (!tokens.empty()) {
+        merge_around(tokens, tokens.begin()->first, tokens.rbegin()->second.end);
+    }
+    erase_file_if_empty(handle);
+}
+
+void TokenTable::release_client(int client_id) {
+    std::vector<FileHandle> handles;
+    for (const auto& [handle, tokens] : files) {
+        handles.push_back(handle);
+    }
+    for (FileHandle handle : handles) {
+        release(handle, client_id);
+    }
+}
+
+bool TokenTable::has_tokens(FileHandle handle) const {
+    return files.find(handle) != files.end();
+}
+
+size_t TokenTable::num_files() const {
+    return files.size();
+}
+
+size_t TokenTable::num_segments() const {
+    return segments;
+}
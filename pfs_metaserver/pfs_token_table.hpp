@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "pfs_common/pfs_common.hpp"
+
+#define TOKEN_READ 1
+#define TOKEN_WRITE 2
+#define TOKEN_RANGE_MAX (INT64_MAX - 1)  // End of a token that runs past any EOF; end + 1 must not overflow
+
+// A byte-range token as the token manager hands it out
+struct Token {
+    int client_id;          // Client ID associated with the token
+    int fd;                 // File descriptor associated with the token
+    FileHandle handle;      // File the token is for
+    int token_type;         // 1 for READ, 2 for WRITE
+    int64_t start_byte;     // Start byte range of the token
+    int64_t end_byte;       // End byte range of the token
+    bool exact = false;     // Requested without widening into free space
+
+    Token(int c_id, int file_d, FileHandle file, int type, int64_t start, int64_t end)
+        : client_id(c_id), fd(file_d), handle(file), token_type(type), start_byte(start), end_byte(end) {}
+};
+
+// Byte-range tokens of every file. Each file's ranges are stored as an
+// ordered map of disjoint segments keyed by start offset; a segment lists
+// every client holding it and in which mode. Finding the holders of a range
+// is a lower_bound plus a walk over the k overlapping segments, and
+// neighbouring segments with the same holders are always merged, so a
+// client's adjacent or overlapping grants collapse into one range no matter
+// in what order they arrived.
+//
+// Ranges are inclusive, like the start_byte/end_byte of Token. Not
+// thread-safe; callers serialize access.
+class TokenTable {
+public:
+    // Ranges held by other clients that must be revoked before client_id can
+    // hold [start, end] in the given mode, one Token per holder and run,
+    // clipped to the requested range
+    std::vector<Token> conflicts(FileHandle handle, int client_id, int token_type,
+                                 int64_t start, int64_t end) const;
+
+    // A wide range around [start, end] that no other client holds in a
+    // conflicting mode, found by looking at no more than the two nearest
+    // segments on either side. [0, TOKEN_RANGE_MAX] if the file is
+    // uncontended. [start, end] itself must be free of conflicts.
+    std::pair<int64_t, int64_t> free_range(FileHandle handle, int client_id, int token_type,
+                                           int64_t start, int64_t end) const;
+
+    // Drop client_id's hold on [start, end]
+    void revoke(FileHandle handle, int client_id, int64_t start, int64_t end);
+
+    // Give client_id [start, end] in the given mode. Holding WRITE implies
+    // READ, so a client's READ on a range it writes is upgraded in place.
+    // Returns the whole coalesced range the client now holds in that mode
+    // around the request.
+    Token grant(FileHandle handle, int client_id, int token_type, int64_t start, int64_t end);
+
+    // Drop every range client_id holds on the file
+    void release(FileHandle handle, int client_id);
+
+    // Drop every range client_id holds on any file
+    void release_client(int client_id);
+
+    bool has_tokens(FileHandle handle) const;
+
+    size_t num_files() const;
+    size_t num_segments() const;
+
+private:
+    // (client_id, mode) pairs sorted by client_id
+    using Holders = std::vector<std::pair<int, int>>;
+
+    struct Segment {
+        int64_t end;  // Inclusive
+        Holders holders;
+    };
+    using FileTokens = std::map<int64_t, Segment>;
+
+    static int mode_of(const Holders& holders, int client_id);
+    static bool conflicts_with(const Holders& holders, int client_id, int token_type);
+    static void set_mode(Holders& holders, int client_id, int mode);
+
+    void split_at(FileTokens& tokens, int64_t offset);
+    void merge_around(FileTokens& tokens, int64_t start, int64_t end);
+    FileTokens::iterator erase_segment(FileTokens& tokens, FileTokens::iterator it);
+    void erase_file_if_empty(FileHandle handle);
+
+    std::unordered_map<FileHandle, FileTokens> files;
+    size_t segments = 0;  // Across all files
+};